@@ -0,0 +1,151 @@
+#include "Admission.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace booking {
+
+namespace {
+// Hard cap on the token buckets kept. A client forgotten for being the least recently seen
+// starts again from a full burst, which only matters for one that was already idle the longest.
+constexpr size_t kMaxTrackedClients = 4096;
+constexpr double kServiceTimeSmoothing = 0.1;
+constexpr auto kOverloadRetryAfter = std::chrono::seconds(1);
+
+size_t priorityIndex(RequestPriority priority) { return static_cast<size_t>(priority); }
+}  // namespace
+
+AdmissionController::Slot::Slot(AdmissionController *owner, Clock::time_point started)
+    : owner_(owner), started_(started) {}
+
+AdmissionController::Slot::Slot(Slot &&other) noexcept : owner_(other.owner_), started_(other.started_) {
+    other.owner_ = nullptr;
+}
+
+AdmissionController::Slot &AdmissionController::Slot::operator=(Slot &&other) noexcept {
+    if (this != &other) {
+        if (owner_) {
+            owner_->release(Clock::now() - started_);
+        }
+        owner_ = other.owner_;
+        started_ = other.started_;
+        other.owner_ = nullptr;
+    }
+    return *this;
+}
+
+AdmissionController::Slot::~Slot() {
+    if (owner_) {
+        owner_->release(Clock::now() - started_);
+    }
+}
+
+AdmissionController::AdmissionController(AdmissionOptions options) : options_(options) {
+    options_.maxInFlight = std::max<size_t>(options_.maxInFlight, 1);
+}
+
+const AdmissionOptions &AdmissionController::getOptions() const { return options_; }
+
+size_t AdmissionController::slotLimit(RequestPriority priority) const {
+    switch (priority) {
+        case RequestPriority::FrontDesk:
+            return options_.maxInFlight;
+        case RequestPriority::Read:
+            return std::max<size_t>(1, options_.maxInFlight * 3 / 4);
+        case RequestPriority::Background:
+            return std::max<size_t>(1, options_.maxInFlight / 2);
+    }
+    return options_.maxInFlight;
+}
+
+bool AdmissionController::higherPriorityWaiting(RequestPriority priority) const {
+    for (size_t i = 0; i < priorityIndex(priority); ++i) {
+        if (waiting_[i] > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool AdmissionController::takeToken(const std::string &client, Clock::time_point now, std::chrono::seconds &retryAfter) {
+    auto rate = options_.clientRequestsPerSecond;
+    if (rate <= 0) {
+        return true;
+    }
+    auto burst = std::max(options_.clientBurst, 1.0);
+    auto &shard = bucketShards_[std::hash<std::string>{}(client) % kBucketShards];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto found = shard.index.find(client);
+    if (found != shard.index.end()) {
+        shard.buckets.splice(shard.buckets.begin(), shard.buckets, found->second);
+    } else {
+        if (shard.buckets.size() >= kMaxTrackedClients / kBucketShards) {
+            shard.index.erase(shard.buckets.back().client);
+            shard.buckets.pop_back();
+        }
+        shard.buckets.push_front(TokenBucket{client, burst, now});
+        shard.index.emplace(client, shard.buckets.begin());
+    }
+    auto &bucket = shard.buckets.front();
+    bucket.tokens = std::min(burst, bucket.tokens + std::chrono::duration<double>(now - bucket.refilledAt).count() * rate);
+    bucket.refilledAt = now;
+    if (bucket.tokens < 1.0) {
+        retryAfter = std::chrono::seconds(static_cast<long long>(std::ceil((1.0 - bucket.tokens) / rate)));
+        return false;
+    }
+    bucket.tokens -= 1.0;
+    return true;
+}
+
+AdmissionController::Decision AdmissionController::admit(const std::string &client, RequestPriority priority) {
+    Decision decision;
+    auto now = Clock::now();
+    if (!takeToken(client, now, decision.retryAfter)) {
+        decision.result = AdmissionResult::RateLimited;
+        return decision;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto index = priorityIndex(priority);
+    auto limit = slotLimit(priority);
+    auto canStart = [&] { return inFlight_ < limit && !higherPriorityWaiting(priority); };
+    if (!canStart()) {
+        // Everything at this priority or above is served first; estimate how long that takes.
+        size_t ahead = 1;
+        for (size_t i = 0; i <= index; ++i) {
+            ahead += waiting_[i];
+        }
+        auto target = options_.queueTargets[index];
+        auto estimate = averageServiceSeconds_ * static_cast<double>(ahead) / static_cast<double>(limit);
+        if (estimate > std::chrono::duration<double>(target).count()) {
+            decision.result = AdmissionResult::Overloaded;
+            decision.retryAfter = kOverloadRetryAfter;
+            return decision;
+        }
+        ++waiting_[index];
+        bool started = slotFreed_.wait_until(lock, now + target, canStart);
+        --waiting_[index];
+        // Lower priorities may have been held back by this one.
+        slotFreed_.notify_all();
+        if (!started) {
+            decision.result = AdmissionResult::Overloaded;
+            decision.retryAfter = kOverloadRetryAfter;
+            return decision;
+        }
+    }
+    ++inFlight_;
+    decision.slot = Slot(this, Clock::now());
+    return decision;
+}
+
+void AdmissionController::release(Clock::duration serviceTime) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        --inFlight_;
+        averageServiceSeconds_ += kServiceTimeSmoothing *
+                                  (std::chrono::duration<double>(serviceTime).count() - averageServiceSeconds_);
+    }
+    slotFreed_.notify_all();
+}
+
+}  // namespace booking
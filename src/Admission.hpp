@@ -0,0 +1,116 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace booking {
+
+enum class RequestPriority {
+    // Writes from the front desk: seating, bookings, orders.
+    FrontDesk,
+    Read,
+    // Report and analytics polling.
+    Background
+};
+
+constexpr size_t kRequestPriorityCount = 3;
+
+struct AdmissionOptions {
+    // Requests executing at once. Reads may take three quarters of the slots and background
+    // polling half, so front-desk writes always find room.
+    size_t maxInFlight = 32;
+    // Longest a request may wait for a slot, per priority; one that would wait longer is turned
+    // away at once.
+    std::array<std::chrono::milliseconds, kRequestPriorityCount> queueTargets{
+        std::chrono::milliseconds(2000), std::chrono::milliseconds(250), std::chrono::milliseconds(100)};
+    // Token bucket per client address; a rate of 0 turns rate limiting off.
+    double clientRequestsPerSecond = 50;
+    double clientBurst = 100;
+};
+
+enum class AdmissionResult {
+    Admitted,
+    RateLimited,
+    Overloaded
+};
+
+// Bounds the requests executing at once and queues the rest by priority: a waiting request only
+// starts once no higher priority is waiting. Queue time is estimated from recent service times,
+// so a request that would miss its target is rejected without waiting at all.
+class AdmissionController {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // One in-flight slot, given back when destroyed.
+    class Slot {
+    public:
+        Slot() = default;
+        Slot(Slot &&other) noexcept;
+        Slot &operator=(Slot &&other) noexcept;
+        Slot(const Slot &) = delete;
+        Slot &operator=(const Slot &) = delete;
+        ~Slot();
+
+    private:
+        friend class AdmissionController;
+        Slot(AdmissionController *owner, Clock::time_point started);
+
+        AdmissionController *owner_ = nullptr;
+        Clock::time_point started_;
+    };
+
+    struct Decision {
+        AdmissionResult result = AdmissionResult::Admitted;
+        // When to try again, for rejected requests.
+        std::chrono::seconds retryAfter{0};
+        Slot slot;
+    };
+
+    explicit AdmissionController(AdmissionOptions options = {});
+    AdmissionController(const AdmissionController &) = delete;
+    AdmissionController &operator=(const AdmissionController &) = delete;
+
+    Decision admit(const std::string &client, RequestPriority priority);
+    const AdmissionOptions &getOptions() const;
+
+private:
+    struct TokenBucket {
+        std::string client;
+        double tokens = 0;
+        Clock::time_point refilledAt;
+    };
+
+    // Token buckets are split over shards by client, each under its own mutex, so rate limiting
+    // neither waits on the slot accounting below nor on unrelated clients.
+    static constexpr size_t kBucketShards = 16;
+    struct BucketShard {
+        std::mutex mutex;
+        // Most recently seen client first, and an index into them. Each shard keeps its share of
+        // kMaxTrackedClients; the least recently seen client is forgotten first.
+        std::list<TokenBucket> buckets;
+        std::unordered_map<std::string, std::list<TokenBucket>::iterator> index;
+    };
+
+    bool takeToken(const std::string &client, Clock::time_point now, std::chrono::seconds &retryAfter);
+    size_t slotLimit(RequestPriority priority) const;
+    bool higherPriorityWaiting(RequestPriority priority) const;
+    void release(Clock::duration serviceTime);
+
+    AdmissionOptions options_;
+    std::array<BucketShard, kBucketShards> bucketShards_;
+    // Guards the slot accounting, which is server-wide by nature.
+    std::mutex mutex_;
+    std::condition_variable slotFreed_;
+    size_t inFlight_ = 0;
+    std::array<size_t, kRequestPriorityCount> waiting_{};
+    // Moving average of how long a request holds its slot.
+    double averageServiceSeconds_ = 0.001;
+};
+
+}  // namespace booking
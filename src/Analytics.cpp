@@ -0,0 +1,209 @@
+#include "Analytics.hpp"
+
+#include <algorithm>
+
+namespace booking {
+
+namespace {
+constexpr int kMinutesPerHour = 60;
+constexpr int kMinutesPerDay = 24 * kMinutesPerHour;
+
+void addOccupancy(AnalyticsSummary &summary, const Reservation &reservation) {
+    auto local = toLocalDateTime(reservation.getDateTime());
+    auto weekday = local.weekday;
+    auto minute = static_cast<int>(local.minuteOfDay);
+    auto remaining = static_cast<int>(reservation.getDuration().count());
+    while (remaining > 0) {
+        auto span = std::min(remaining, kMinutesPerHour - minute % kMinutesPerHour);
+        summary.occupiedSeatMinutes[weekday][static_cast<size_t>(minute / kMinutesPerHour)] +=
+            static_cast<std::int64_t>(reservation.getPartySize()) * span;
+        remaining -= span;
+        minute += span;
+        if (minute >= kMinutesPerDay) {
+            minute = 0;
+            weekday = (weekday + 1) % AnalyticsSummary::kDaysPerWeek;
+        }
+    }
+}
+
+void scanDay(const BookingSheet &sheet, const AnalyticsQuery &query, SheetMinutes now, AnalyticsSummary &summary) {
+    ++summary.days;
+    summary.revenue += sheet.getRevenue();
+
+    std::int64_t seats = 0;
+    for (const auto &table : sheet.getTables()) {
+        if (table.getStatus() != TableStatus::OutOfService) {
+            seats += table.getCapacity();
+        }
+    }
+    if (auto midnight = parseDateTime(sheet.getDate() + " 00:00")) {
+        auto weekday = toLocalDateTime(*midnight).weekday;
+        auto open = std::clamp(query.openMinute, 0, kMinutesPerDay);
+        auto close = std::clamp(query.closeMinute, open, kMinutesPerDay);
+        for (auto minute = open; minute < close;) {
+            auto hour = minute / kMinutesPerHour;
+            auto next = std::min((hour + 1) * kMinutesPerHour, close);
+            summary.availableSeatMinutes[weekday][static_cast<size_t>(hour)] += seats * (next - minute);
+            minute = next;
+        }
+        summary.openSeatMinutes += seats * (close - open);
+    }
+
+    for (const auto &reservation : sheet.getReservations()) {
+        ++summary.reservations;
+        auto status = reservation.getStatus();
+        if (status == ReservationStatus::Cancelled) {
+            ++summary.cancelled;
+        } else if (status == ReservationStatus::Open) {
+            if (reservation.getEndMinutes() <= now) {
+                ++summary.noShows;
+            }
+        } else {
+            if (status == ReservationStatus::Completed) {
+                ++summary.completed;
+                summary.turnMinutes += reservation.getDuration().count();
+            }
+            addOccupancy(summary, reservation);
+        }
+    }
+}
+}  // namespace
+
+void AnalyticsSummary::merge(const AnalyticsSummary &other) {
+    days += other.days;
+    reservations += other.reservations;
+    cancelled += other.cancelled;
+    noShows += other.noShows;
+    completed += other.completed;
+    turnMinutes += other.turnMinutes;
+    openSeatMinutes += other.openSeatMinutes;
+    revenue += other.revenue;
+    for (size_t weekday = 0; weekday < kDaysPerWeek; ++weekday) {
+        for (size_t hour = 0; hour < kHoursPerDay; ++hour) {
+            occupiedSeatMinutes[weekday][hour] += other.occupiedSeatMinutes[weekday][hour];
+            availableSeatMinutes[weekday][hour] += other.availableSeatMinutes[weekday][hour];
+        }
+    }
+}
+
+double AnalyticsSummary::noShowRate() const {
+    auto expected = reservations - cancelled;
+    return expected == 0 ? 0.0 : static_cast<double>(noShows) / static_cast<double>(expected);
+}
+
+double AnalyticsSummary::averageTurnMinutes() const {
+    return completed == 0 ? 0.0 : static_cast<double>(turnMinutes) / static_cast<double>(completed);
+}
+
+Money AnalyticsSummary::revenuePerSeatHour() const {
+    if (openSeatMinutes == 0) {
+        return Money{};
+    }
+    return Money::fromCents(revenue.getCents() * kMinutesPerHour / openSeatMinutes);
+}
+
+std::optional<double> AnalyticsSummary::occupancy(size_t weekday, size_t hour) const {
+    auto available = availableSeatMinutes[weekday][hour];
+    if (available == 0) {
+        return std::nullopt;
+    }
+    return static_cast<double>(occupiedSeatMinutes[weekday][hour]) / static_cast<double>(available);
+}
+
+AnalyticsEngine::AnalyticsEngine() : AnalyticsEngine(std::thread::hardware_concurrency()) {}
+
+AnalyticsEngine::AnalyticsEngine(size_t workerCount) {
+    workerCount = std::max<size_t>(1, workerCount);
+    workers_.reserve(workerCount);
+    for (size_t i = 0; i < workerCount; ++i) {
+        workers_.emplace_back(&AnalyticsEngine::workerLoop, this, i);
+    }
+}
+
+AnalyticsEngine::~AnalyticsEngine() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto &worker : workers_) {
+        worker.join();
+    }
+}
+
+size_t AnalyticsEngine::getWorkerCount() const { return workers_.size(); }
+
+AnalyticsPlan AnalyticsEngine::plan(const Restaurant &restaurant, const AnalyticsQuery &query) {
+    auto inRange = [&](const std::string &date) {
+        return (query.fromDate.empty() || date >= query.fromDate) && (query.toDate.empty() || date <= query.toDate);
+    };
+    AnalyticsPlan plan;
+    plan.query = query;
+    plan.now = toSheetMinutes(std::chrono::system_clock::now());
+    for (const auto &sheet : restaurant.getArchivedSheets()) {
+        if (inRange(sheet->getDate())) {
+            plan.archivedSheets.push_back(sheet);
+        }
+    }
+    if (inRange(restaurant.getBookingSheet().getDate())) {
+        scanDay(restaurant.getBookingSheet(), query, plan.now, plan.liveDay);
+    }
+    return plan;
+}
+
+AnalyticsSummary AnalyticsEngine::analyze(const AnalyticsPlan &plan) {
+    const auto &sheets = plan.archivedSheets;
+    std::vector<AnalyticsSummary> partials(workers_.size());
+    runJob(sheets.size(), [&](size_t worker, size_t task) {
+        scanDay(*sheets[task], plan.query, plan.now, partials[worker]);
+    });
+    AnalyticsSummary total = plan.liveDay;
+    for (const auto &partial : partials) {
+        total.merge(partial);
+    }
+    return total;
+}
+
+AnalyticsSummary AnalyticsEngine::analyze(const Restaurant &restaurant, const AnalyticsQuery &query) {
+    return analyze(plan(restaurant, query));
+}
+
+void AnalyticsEngine::runJob(size_t taskCount, const Task &task) {
+    std::lock_guard<std::mutex> job(jobMutex_);
+    std::unique_lock<std::mutex> lock(mutex_);
+    task_ = &task;
+    taskCount_ = taskCount;
+    nextTask_ = 0;
+    busyWorkers_ = workers_.size();
+    ++generation_;
+    wake_.notify_all();
+    done_.wait(lock, [&] { return busyWorkers_ == 0; });
+    task_ = nullptr;
+}
+
+void AnalyticsEngine::workerLoop(size_t worker) {
+    std::uint64_t seen = 0;
+    while (true) {
+        const Task *task = nullptr;
+        size_t taskCount = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [&] { return stopping_ || generation_ != seen; });
+            if (stopping_) {
+                return;
+            }
+            seen = generation_;
+            task = task_;
+            taskCount = taskCount_;
+        }
+        for (auto next = nextTask_.fetch_add(1); next < taskCount; next = nextTask_.fetch_add(1)) {
+            (*task)(worker, next);
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--busyWorkers_ == 0) {
+            done_.notify_all();
+        }
+    }
+}
+
+}  // namespace booking
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "ReservationSystem.hpp"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace booking {
+
+// Days to scan, as inclusive "YYYY-MM-DD" bounds (empty for open-ended), and the opening hours
+// that seat capacity is measured over, in local minutes of the day.
+struct AnalyticsQuery {
+    std::string fromDate;
+    std::string toDate;
+    int openMinute = 11 * 60;
+    int closeMinute = 23 * 60;
+};
+
+// Aggregates over a set of days. Every worker fills its own copy and the copies are merged at
+// the end, so a scan shares nothing between threads.
+struct AnalyticsSummary {
+    static constexpr size_t kDaysPerWeek = 7;
+    static constexpr size_t kHoursPerDay = 24;
+    // Indexed by local weekday (0 is Sunday), then hour.
+    using HourGrid = std::array<std::array<std::int64_t, kHoursPerDay>, kDaysPerWeek>;
+
+    size_t days = 0;
+    size_t reservations = 0;
+    size_t cancelled = 0;
+    // Reservations still Open after their seating ended: the party never came.
+    size_t noShows = 0;
+    size_t completed = 0;
+    // Booked seating length of completed parties; the sheet does not record actual departures.
+    std::int64_t turnMinutes = 0;
+    // Seats times opening minutes, over all days scanned.
+    std::int64_t openSeatMinutes = 0;
+    Money revenue;
+    // Guest-minutes of seated and completed parties, and the seat-minutes on offer, per cell.
+    HourGrid occupiedSeatMinutes{};
+    HourGrid availableSeatMinutes{};
+
+    void merge(const AnalyticsSummary &other);
+    // Share of reservations that were not cancelled but never showed up.
+    double noShowRate() const;
+    double averageTurnMinutes() const;
+    Money revenuePerSeatHour() const;
+    // Empty for cells outside opening hours.
+    std::optional<double> occupancy(size_t weekday, size_t hour) const;
+};
+
+// The days an analytics query covers, taken from a restaurant in one go. The live sheet keeps
+// changing, so it is scanned while taking the plan; archived sheets never change once archived,
+// so the plan only shares them, which keeps them alive if the restaurant retires them meanwhile.
+struct AnalyticsPlan {
+    AnalyticsQuery query;
+    SheetMinutes now = 0;
+    std::vector<std::shared_ptr<const BookingSheet>> archivedSheets;
+    AnalyticsSummary liveDay;
+};
+
+// Fixed pool of workers for analytics scans, partitioned by day. Jobs run one at a time; within
+// a job the workers pull days off a shared counter, so one that draws light days simply takes
+// more of them.
+class AnalyticsEngine {
+public:
+    AnalyticsEngine();
+    explicit AnalyticsEngine(size_t workerCount);
+    AnalyticsEngine(const AnalyticsEngine &) = delete;
+    AnalyticsEngine &operator=(const AnalyticsEngine &) = delete;
+    ~AnalyticsEngine();
+
+    size_t getWorkerCount() const;
+    // Picks the archived sheets in the query's range and scans the live sheet if it is in range.
+    // Only this needs the restaurant held still; it never waits on the worker pool.
+    static AnalyticsPlan plan(const Restaurant &restaurant, const AnalyticsQuery &query);
+    // Scans the planned archived sheets on the workers, one job at a time across all callers.
+    AnalyticsSummary analyze(const AnalyticsPlan &plan);
+    // Both of the above, for a caller that keeps the restaurant from changing until this returns.
+    AnalyticsSummary analyze(const Restaurant &restaurant, const AnalyticsQuery &query);
+
+private:
+    using Task = std::function<void(size_t worker, size_t task)>;
+
+    void runJob(size_t taskCount, const Task &task);
+    void workerLoop(size_t worker);
+
+    std::mutex jobMutex_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    const Task *task_ = nullptr;
+    size_t taskCount_ = 0;
+    std::atomic<size_t> nextTask_{0};
+    std::uint64_t generation_ = 0;
+    size_t busyWorkers_ = 0;
+    bool stopping_ = false;
+    std::vector<std::thread> workers_;
+};
+
+}  // namespace booking
@@ -0,0 +1,222 @@
+#include "ConnectionReactor.hpp"
+
+#include <algorithm>
+
+namespace booking {
+
+namespace {
+// A stop request is noticed within this long even when no deadline is due.
+constexpr int kStopCheckMillis = 250;
+
+// Canned replies get one attempt: a client that will not take a few hundred bytes is not worth
+// waiting for.
+void sendOnce(SocketHandle socket, const std::string &text) {
+    ConnectionLimits noWait;
+    noWait.writeTimeout = std::chrono::milliseconds(0);
+    sendWithin(socket, text.c_str(), text.size(), noWait);
+}
+}  // namespace
+
+ConnectionReactor::ConnectionReactor(SocketHandle listener,
+                                     const ConnectionLimits &limits,
+                                     FrameRequest frame,
+                                     RequestReady ready,
+                                     CannedReply reply)
+    : listener_(listener),
+      limits_(limits),
+      frame_(std::move(frame)),
+      ready_(std::move(ready)),
+      reply_(std::move(reply)) {}
+
+ConnectionReactor::Clock::time_point ConnectionReactor::run(const std::atomic<bool> &stopRequested,
+                                                             std::chrono::milliseconds drainTimeout) {
+    setSocketBlocking(listener_, false);
+    std::vector<PollDescriptor> descriptors;
+    std::vector<std::uint64_t> ids;
+    std::optional<Clock::time_point> drainEnd;
+    while (true) {
+        auto now = Clock::now();
+        if (!drainEnd && stopRequested.load()) {
+            drainEnd = now + drainTimeout;
+        }
+        if (drainEnd && (pending_.empty() || now >= *drainEnd)) {
+            break;
+        }
+
+        descriptors.clear();
+        ids.clear();
+        for (const auto &[id, pending] : pending_) {
+            PollDescriptor descriptor{};
+            descriptor.fd = pending.socket;
+            descriptor.events = POLLIN;
+            descriptors.push_back(descriptor);
+            ids.push_back(id);
+        }
+        if (!drainEnd) {
+            PollDescriptor listening{};
+            listening.fd = listener_;
+            listening.events = POLLIN;
+            descriptors.push_back(listening);
+        }
+
+        if (portablePoll(descriptors.data(), descriptors.size(), millisUntilNextDeadline(now, drainEnd)) < 0) {
+            continue;
+        }
+        for (size_t i = 0; i < ids.size(); ++i) {
+            if (descriptors[i].revents == 0) {
+                continue;
+            }
+            auto it = pending_.find(ids[i]);
+            if (it != pending_.end() && !readAvailable(it->first, it->second)) {
+                pending_.erase(it);
+            }
+        }
+        if (!drainEnd && (descriptors.back().revents & POLLIN)) {
+            acceptAll();
+        }
+        expireDeadlines(Clock::now());
+        pendingCount_.store(pending_.size(), std::memory_order_relaxed);
+    }
+
+    for (auto &entry : pending_) {
+        drop(entry.second, 503);
+    }
+    pending_.clear();
+    pendingCount_.store(0, std::memory_order_relaxed);
+    deadlines_ = {};
+    return *drainEnd;
+}
+
+void ConnectionReactor::acceptAll() {
+    while (true) {
+        SocketHandle socket = accept(listener_, nullptr, nullptr);
+        if (socket == INVALID_SOCKET_HANDLE) {
+            return;  // Drained, or a transient failure the next poll retries.
+        }
+        setSocketBlocking(socket, false);
+        auto clientHost = describePeerHost(socket);
+        if (pending_.size() >= limits_.maxPendingConnections || !claimClientSlot(clientHost)) {
+            sendOnce(socket, reply_(503));
+            closeSocket(socket);
+            continue;
+        }
+        auto id = nextId_++;
+        auto &pending = pending_[id];
+        pending.socket = socket;
+        pending.clientHost = std::move(clientHost);
+        pending.accepted = Clock::now();
+        pending.phaseStarted = pending.accepted;
+        pending.lastProgress = pending.accepted;
+        scheduleDeadline(id, pending);
+    }
+}
+
+bool ConnectionReactor::readAvailable(std::uint64_t id, Pending &pending) {
+    char temp[4096];
+    while (true) {
+        int received = portableRecv(pending.socket, temp, sizeof(temp));
+        if (received < 0 && lastSocketErrorWouldBlock()) {
+            break;
+        }
+        if (received <= 0) {
+            drop(pending, 0);
+            return false;
+        }
+        auto now = Clock::now();
+        pending.buffer.append(temp, static_cast<size_t>(received));
+        pending.lastProgress = now;
+        pending.phaseBytes += static_cast<size_t>(received);
+
+        if (pending.requestLength == 0) {
+            auto length = frame_(pending.buffer);
+            if (length == std::string::npos) {
+                drop(pending, 400);
+                return false;
+            }
+            if (length > 0) {
+                // Headers are in; the body gets its own, longer budget.
+                pending.requestLength = length;
+                pending.phaseStarted = now;
+                pending.phaseBytes = 0;
+            }
+        }
+        if (pending.requestLength > 0 && pending.buffer.size() >= pending.requestLength) {
+            pending.buffer.resize(pending.requestLength);
+            if (!ready_(pending.socket, std::move(pending.buffer), pending.clientHost, pending.accepted)) {
+                drop(pending, 503);
+            }
+            return false;
+        }
+    }
+    scheduleDeadline(id, pending);
+    return true;
+}
+
+void ConnectionReactor::scheduleDeadline(std::uint64_t id, Pending &pending) {
+    auto phaseTimeout = pending.requestLength == 0 ? limits_.headerTimeout : limits_.bodyTimeout;
+    auto deadline = transferDeadline(limits_, phaseTimeout, pending.phaseStarted, pending.lastProgress, pending.phaseBytes);
+    if (deadline != pending.deadline) {
+        pending.deadline = deadline;
+        deadlines_.emplace(deadline, id);
+    }
+}
+
+int ConnectionReactor::millisUntilNextDeadline(Clock::time_point now, std::optional<Clock::time_point> drainEnd) {
+    while (!deadlines_.empty()) {
+        auto it = pending_.find(deadlines_.top().second);
+        if (it != pending_.end() && it->second.deadline == deadlines_.top().first) {
+            break;
+        }
+        deadlines_.pop();
+    }
+    // Before a stop, wake up now and then to notice one; during the drain, at its end.
+    auto wakeAt = drainEnd ? *drainEnd : now + std::chrono::milliseconds(kStopCheckMillis);
+    if (!deadlines_.empty()) {
+        wakeAt = std::min(wakeAt, deadlines_.top().first);
+    }
+    auto wait = std::chrono::ceil<std::chrono::milliseconds>(wakeAt - now).count();
+    return static_cast<int>(std::max<long long>(0, wait));
+}
+
+void ConnectionReactor::expireDeadlines(Clock::time_point now) {
+    while (!deadlines_.empty() && deadlines_.top().first <= now) {
+        auto entry = deadlines_.top();
+        deadlines_.pop();
+        auto it = pending_.find(entry.second);
+        if (it == pending_.end() || it->second.deadline != entry.first) {
+            continue;
+        }
+        drop(it->second, 408);
+        pending_.erase(it);
+    }
+}
+
+void ConnectionReactor::drop(Pending &pending, int status) {
+    if (status != 0) {
+        sendOnce(pending.socket, reply_(status));
+    }
+    closeSocket(pending.socket);
+    release(pending.clientHost);
+}
+
+bool ConnectionReactor::claimClientSlot(const std::string &clientHost) {
+    std::lock_guard<std::mutex> lock(clientsMutex_);
+    auto &count = connectionsPerClient_[clientHost];
+    if (limits_.maxConnectionsPerClient > 0 && count >= limits_.maxConnectionsPerClient) {
+        return false;
+    }
+    ++count;
+    return true;
+}
+
+size_t ConnectionReactor::pendingConnections() const { return pendingCount_.load(std::memory_order_relaxed); }
+
+void ConnectionReactor::release(const std::string &clientHost) {
+    std::lock_guard<std::mutex> lock(clientsMutex_);
+    auto it = connectionsPerClient_.find(clientHost);
+    if (it != connectionsPerClient_.end() && --it->second == 0) {
+        connectionsPerClient_.erase(it);
+    }
+}
+
+}  // namespace booking
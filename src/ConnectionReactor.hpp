@@ -0,0 +1,102 @@
+#pragma once
+
+#include "Net.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace booking {
+
+// Reads requests off every accepted connection from one thread. The listening socket and each
+// connection still sending its request are non-blocking and polled together, and all of their
+// deadlines share one min-heap, so a client that stalls costs a buffer rather than a thread.
+// Only a connection whose request has fully arrived is handed on.
+class ConnectionReactor {
+public:
+    using Clock = std::chrono::steady_clock;
+    // Once the headers at the front of `buffer` are complete, the length of the whole request
+    // including its body; 0 while they are incomplete; npos for one that can never be served.
+    using FrameRequest = std::function<size_t(const std::string &buffer)>;
+    // Takes over a connection whose request has arrived, returning false when there is no
+    // capacity for it; the reactor then answers 503 itself. `accepted` is when the connection
+    // was accepted.
+    using RequestReady = std::function<bool(SocketHandle socket,
+                                            std::string request,
+                                            const std::string &clientHost,
+                                            Clock::time_point accepted)>;
+    // The full response text for a connection the reactor gives up on: 400, 408 or 503.
+    using CannedReply = std::function<std::string(int status)>;
+
+    ConnectionReactor(SocketHandle listener,
+                      const ConnectionLimits &limits,
+                      FrameRequest frame,
+                      RequestReady ready,
+                      CannedReply reply);
+    ConnectionReactor(const ConnectionReactor &) = delete;
+    ConnectionReactor &operator=(const ConnectionReactor &) = delete;
+
+    // Accepts and reads until `stopRequested` is set, then stops accepting and keeps reading the
+    // requests already arriving for up to `drainTimeout`; any still incomplete get a 503.
+    // Returns the end of that drain period so callers can bound the rest of theirs by it. The
+    // listening socket is left open.
+    Clock::time_point run(const std::atomic<bool> &stopRequested, std::chrono::milliseconds drainTimeout);
+    // Gives back the client's connection slot once a connection handed to RequestReady closes.
+    // Safe from any thread.
+    void release(const std::string &clientHost);
+    // Connections still sending their request, as of the last poll. Safe from any thread.
+    size_t pendingConnections() const;
+
+private:
+    struct Pending {
+        SocketHandle socket = INVALID_SOCKET_HANDLE;
+        std::string clientHost;
+        std::string buffer;
+        Clock::time_point accepted;
+        // Known once the headers are in.
+        size_t requestLength = 0;
+        Clock::time_point phaseStarted;
+        Clock::time_point lastProgress;
+        size_t phaseBytes = 0;
+        Clock::time_point deadline;
+    };
+
+    void acceptAll();
+    // False once the connection has been handed on or dropped.
+    bool readAvailable(std::uint64_t id, Pending &pending);
+    void scheduleDeadline(std::uint64_t id, Pending &pending);
+    void expireDeadlines(Clock::time_point now);
+    void drop(Pending &pending, int status);
+    bool claimClientSlot(const std::string &clientHost);
+    int millisUntilNextDeadline(Clock::time_point now, std::optional<Clock::time_point> drainEnd);
+
+    SocketHandle listener_;
+    ConnectionLimits limits_;
+    FrameRequest frame_;
+    RequestReady ready_;
+    CannedReply reply_;
+
+    std::unordered_map<std::uint64_t, Pending> pending_;
+    // pending_.size(), published for other threads.
+    std::atomic<size_t> pendingCount_{0};
+    std::uint64_t nextId_ = 1;
+    // (deadline, connection id), earliest first. A connection's entry goes stale when its
+    // deadline moves; stale entries are skipped as they surface.
+    using DeadlineEntry = std::pair<Clock::time_point, std::uint64_t>;
+    std::priority_queue<DeadlineEntry, std::vector<DeadlineEntry>, std::greater<DeadlineEntry>> deadlines_;
+
+    std::mutex clientsMutex_;
+    // Open connections per client address, from accept until release().
+    std::unordered_map<std::string, size_t> connectionsPerClient_;
+};
+
+}  // namespace booking
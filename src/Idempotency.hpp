@@ -0,0 +1,120 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace booking {
+
+enum class IdempotencyOutcome {
+    Executed,
+    // The response stored for an earlier request with the same key.
+    Replayed,
+    // The key was first used for a different request; nothing was run.
+    KeyMismatch
+};
+
+// Remembers the response to each Idempotency-Key for `ttl`, keeping at most `capacity` keys
+// (oldest dropped first, including keys given up by failed attempts). A repeat must carry the
+// same canonical request text, compared in full, not by hash. A repeat that arrives while the
+// first request is still running waits on this table's own lock, never the caller's. Responses
+// with a status of 500 or more are not kept, so a retry runs again. Response needs a public
+// `status`.
+template <typename Response>
+class IdempotencyTable {
+public:
+    IdempotencyTable(size_t capacity, std::chrono::seconds ttl) : capacity_(capacity), ttl_(ttl) {}
+
+    template <typename Execute>
+    std::pair<Response, IdempotencyOutcome> run(const std::string &key, const std::string &request, Execute &&execute) {
+        std::shared_ptr<Entry> entry;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (!entry) {
+                auto now = Clock::now();
+                expire(now);
+                auto it = entries_.find(key);
+                if (it == entries_.end()) {
+                    entry = std::make_shared<Entry>(Entry{key, request, now + ttl_});
+                    entries_.emplace(key, entry);
+                    order_.push_back(entry);
+                    expire(now);
+                    break;
+                }
+                auto existing = it->second;
+                if (existing->request != request) {
+                    return {Response{}, IdempotencyOutcome::KeyMismatch};
+                }
+                finished_.wait(lock, [&] { return existing->finished; });
+                if (existing->stored) {
+                    return {existing->response, IdempotencyOutcome::Replayed};
+                }
+                // The first attempt failed and gave the key up; try to claim it.
+            }
+        }
+
+        bool stored = false;
+        try {
+            entry->response = execute();
+            stored = entry->response.status < 500;
+        } catch (...) {
+            release(*entry, false);
+            throw;
+        }
+        release(*entry, stored);
+        return {entry->response, IdempotencyOutcome::Executed};
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+    struct Entry {
+        std::string key;
+        std::string request;
+        Clock::time_point expiresAt;
+        bool finished = false;
+        bool stored = false;
+        Response response{};
+    };
+
+    void release(Entry &entry, bool stored) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            entry.finished = true;
+            entry.stored = stored;
+            auto it = entries_.find(entry.key);
+            if (!stored && it != entries_.end() && it->second.get() == &entry) {
+                entries_.erase(it);
+            }
+        }
+        finished_.notify_all();
+    }
+
+    // Keys are claimed in expiry order, so the oldest is always at the front of order_. The bound
+    // is on order_, which still holds entries released by failed attempts, so those cannot pile
+    // up past `capacity` until their TTL. Waiters hold their entry, so dropping one that is still
+    // running only means later repeats run again.
+    void expire(Clock::time_point now) {
+        while (!order_.empty() && (order_.front()->expiresAt <= now || order_.size() > capacity_)) {
+            auto it = entries_.find(order_.front()->key);
+            if (it != entries_.end() && it->second == order_.front()) {
+                entries_.erase(it);
+            }
+            order_.pop_front();
+        }
+    }
+
+    size_t capacity_;
+    Clock::duration ttl_;
+    std::mutex mutex_;
+    std::condition_variable finished_;
+    std::unordered_map<std::string, std::shared_ptr<Entry>> entries_;
+    std::deque<std::shared_ptr<Entry>> order_;
+};
+
+}  // namespace booking
@@ -0,0 +1,396 @@
+#include "JsonSerialization.hpp"
+
+#include <iomanip>
+#include <tuple>
+
+namespace booking {
+
+std::string escapeJson(std::string_view value) {
+    std::ostringstream oss;
+    for (char ch : value) {
+        switch (ch) {
+            case '\\':
+                oss << "\\\\";
+                break;
+            case '"':
+                oss << "\\\"";
+                break;
+            case '\n':
+                oss << "\\n";
+                break;
+            case '\r':
+                oss << "\\r";
+                break;
+            case '\t':
+                oss << "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(ch) < 0x20) {
+                    oss << "\\u" << std::hex << std::uppercase << std::setw(4) << std::setfill('0')
+                        << static_cast<int>(static_cast<unsigned char>(ch)) << std::nouppercase << std::dec;
+                } else {
+                    oss << ch;
+                }
+                break;
+        }
+    }
+    return oss.str();
+}
+
+std::string tableStatusToString(TableStatus status) {
+    switch (status) {
+        case TableStatus::Free:
+            return "Free";
+        case TableStatus::Reserved:
+            return "Reserved";
+        case TableStatus::Occupied:
+            return "Occupied";
+        case TableStatus::OutOfService:
+            return "OutOfService";
+    }
+    return "Unknown";
+}
+
+std::string reservationStatusToString(ReservationStatus status) {
+    switch (status) {
+        case ReservationStatus::Open:
+            return "Open";
+        case ReservationStatus::Seated:
+            return "Seated";
+        case ReservationStatus::Completed:
+            return "Completed";
+        case ReservationStatus::Cancelled:
+            return "Cancelled";
+    }
+    return "Unknown";
+}
+
+std::string tablesToJson(const Restaurant &restaurant) {
+    std::ostringstream oss;
+    oss << '[';
+    const auto &sheet = restaurant.getBookingSheet();
+    const auto &tables = sheet.getTables();
+    const auto &reservations = sheet.getReservations();
+    const auto &orders = sheet.getOrders();
+    for (size_t i = 0; i < tables.size(); ++i) {
+        const auto &table = tables[i];
+        if (i > 0) {
+            oss << ',';
+        }
+        oss << '{'
+            << "\"id\":" << table.getId() << ','
+            << "\"capacity\":" << table.getCapacity() << ','
+            << "\"location\":\"" << escapeJson(table.getLocation()) << "\",";
+        oss << "\"status\":\"" << tableStatusToString(table.getStatus()) << "\",";
+        oss << "\"adjacentTableIds\":";
+        writeTableIdArray(oss, sheet.getAdjacentTableIds(table.getId()));
+        oss << ',';
+        oss << "\"reservations\":[";
+        bool firstReservation = true;
+        for (const auto &reservation : reservations) {
+            if (!reservation.usesTable(table.getId())) {
+                continue;
+            }
+            if (reservation.getStatus() == ReservationStatus::Cancelled) {
+                continue;
+            }
+            if (!firstReservation) {
+                oss << ',';
+            }
+            firstReservation = false;
+            oss << '{'
+                << "\"id\":\"" << reservation.getId() << "\",";
+            oss << "\"customer\":\"" << escapeJson(sheet.getCustomer(reservation).getName()) << "\",";
+            oss << "\"partySize\":" << reservation.getPartySize() << ',';
+            oss << "\"status\":\"" << reservationStatusToString(reservation.getStatus()) << "\",";
+            oss << "\"orders\":[";
+            bool firstOrder = true;
+            for (const auto &order : orders) {
+                if (order.getReservationId() != reservation.getId()) {
+                    continue;
+                }
+                if (!firstOrder) {
+                    oss << ',';
+                }
+                firstOrder = false;
+                oss << "\"" << order.getId() << "\"";
+            }
+            oss << ']';
+            oss << '}';
+        }
+        oss << ']';
+        oss << '}';
+    }
+    oss << ']';
+    return oss.str();
+}
+
+std::string reservationToJson(const BookingSheet &sheet, const Reservation &reservation) {
+    const auto &customer = sheet.getCustomer(reservation);
+    std::ostringstream oss;
+    oss << '{';
+    oss << "\"id\":\"" << reservation.getId() << "\",";
+    oss << "\"customer\":\"" << escapeJson(customer.getName()) << "\",";
+    oss << "\"phone\":\"" << escapeJson(customer.getPhone()) << "\",";
+    oss << "\"email\":\"" << escapeJson(customer.getEmail()) << "\",";
+    oss << "\"preference\":\"" << escapeJson(customer.getPreference()) << "\",";
+    oss << "\"partySize\":" << reservation.getPartySize() << ',';
+    char timeText[kDateTimeTextLength];
+    oss << "\"time\":\"";
+    oss.write(timeText, static_cast<std::streamsize>(formatDateTime(reservation.getDateTime(), timeText)));
+    oss << "\",\"endTime\":\"";
+    oss.write(timeText, static_cast<std::streamsize>(formatDateTime(reservation.getEndTime(), timeText)));
+    oss << "\",";
+    oss << "\"durationMinutes\":" << reservation.getDuration().count() << ',';
+    oss << "\"status\":\"" << reservationStatusToString(reservation.getStatus()) << "\",";
+    oss << "\"notes\":\"" << escapeJson(reservation.getNotes()) << "\",";
+    oss << "\"tableId\":";
+    if (reservation.getTableId()) {
+        oss << *reservation.getTableId();
+    } else {
+        oss << "null";
+    }
+    oss << ",\"tableIds\":";
+    writeTableIdArray(oss, reservation.getTableIds());
+    oss << ',';
+    oss << "\"lastModified\":\"";
+    oss.write(timeText, static_cast<std::streamsize>(formatDateTime(reservation.getLastModified(), timeText)));
+    oss << "\",";
+    oss << "\"version\":" << reservation.getVersion();
+    oss << '}';
+    return oss.str();
+}
+
+std::string reservationsToJson(const Restaurant &restaurant) {
+    std::ostringstream oss;
+    oss << '[';
+    const auto &sheet = restaurant.getBookingSheet();
+    const auto &reservations = sheet.getReservations();
+    for (size_t i = 0; i < reservations.size(); ++i) {
+        if (i > 0) {
+            oss << ',';
+        }
+        oss << reservationToJson(sheet, reservations[i]);
+    }
+    oss << ']';
+    return oss.str();
+}
+
+std::string ordersToJson(const Restaurant &restaurant) {
+    std::ostringstream oss;
+    oss << '[';
+    const auto &orders = restaurant.getBookingSheet().getOrders();
+    for (size_t i = 0; i < orders.size(); ++i) {
+        const auto &order = orders[i];
+        if (i > 0) {
+            oss << ',';
+        }
+        oss << '{';
+        oss << "\"id\":\"" << order.getId() << "\",";
+        oss << "\"reservationId\":\"" << order.getReservationId() << "\",";
+        oss << "\"total\":" << order.getTotal().toString() << ',';
+        oss << "\"items\":[";
+        const auto &items = order.getItems();
+        for (size_t j = 0; j < items.size(); ++j) {
+            const auto &item = items[j];
+            if (j > 0) {
+                oss << ',';
+            }
+            oss << '{';
+            const auto *menuItem = restaurant.findMenuItem(item.getMenuItemId());
+            oss << "\"name\":\"" << escapeJson(menuItem ? std::string_view(menuItem->getName()) : std::string_view{}) << "\",";
+            oss << "\"category\":\"" << escapeJson(menuItem ? std::string_view(menuItem->getCategory()) : std::string_view{}) << "\",";
+            oss << "\"price\":" << item.getPriceAtOrderTime().toString() << ',';
+            oss << "\"quantity\":" << item.getQuantity() << ',';
+            oss << "\"lineTotal\":" << item.getLineTotal().toString();
+            oss << '}';
+        }
+        oss << ']';
+        oss << '}';
+    }
+    oss << ']';
+    return oss.str();
+}
+
+std::string customerHistoryToJson(const Restaurant &restaurant, CustomerId id) {
+    const auto &directory = restaurant.getBookingSheet().getCustomers();
+    const auto &customer = directory.get(id);
+    const auto &reservationIds = directory.getReservationIds(id);
+    std::ostringstream oss;
+    oss << '{';
+    oss << "\"id\":" << id << ',';
+    oss << "\"name\":\"" << escapeJson(customer.getName()) << "\",";
+    oss << "\"phone\":\"" << escapeJson(customer.getPhone()) << "\",";
+    oss << "\"email\":\"" << escapeJson(customer.getEmail()) << "\",";
+    oss << "\"preference\":\"" << escapeJson(customer.getPreference()) << "\",";
+    oss << "\"reservationCount\":" << reservationIds.size() << ',';
+    oss << "\"reservations\":[";
+    bool first = true;
+    for (const auto &reservationId : reservationIds) {
+        const auto *sheet = restaurant.findSheetHolding(reservationId);
+        if (!sheet) {
+            continue;
+        }
+        if (!first) {
+            oss << ',';
+        }
+        first = false;
+        oss << reservationToJson(*sheet, *sheet->findReservationById(reservationId));
+    }
+    oss << "]}";
+    return oss.str();
+}
+
+std::string menuToJson(const Restaurant &restaurant) {
+    std::ostringstream oss;
+    oss << '[';
+    const auto &menu = restaurant.getMenu();
+    for (size_t i = 0; i < menu.size(); ++i) {
+        const auto &item = menu[i];
+        if (i > 0) {
+            oss << ',';
+        }
+        oss << '{';
+        oss << "\"name\":\"" << escapeJson(item.getName()) << "\",";
+        oss << "\"category\":\"" << escapeJson(item.getCategory()) << "\",";
+        oss << "\"price\":" << item.getPrice().toString();
+        oss << '}';
+    }
+    oss << ']';
+    return oss.str();
+}
+
+std::string popularDishesToJson(const std::vector<DishCount> &dishes, std::chrono::minutes window) {
+    std::ostringstream oss;
+    oss << "{\"windowMinutes\":" << window.count() << ",\"items\":[";
+    for (size_t i = 0; i < dishes.size(); ++i) {
+        if (i > 0) {
+            oss << ',';
+        }
+        oss << "{\"name\":\"" << escapeJson(dishes[i].name) << "\",\"quantity\":" << dishes[i].quantity
+            << ",\"estimated\":" << (dishes[i].estimated ? "true" : "false") << '}';
+    }
+    oss << "]}";
+    return oss.str();
+}
+
+void writeWaitEstimate(std::ostringstream &oss, const WaitEstimate &estimate) {
+    oss << "\"partiesAhead\":" << estimate.partiesAhead << ",\"etaMinutes\":";
+    if (estimate.wait) {
+        oss << estimate.wait->count();
+    } else {
+        oss << "null";
+    }
+}
+
+std::string walkInOutcomeToJson(const BookingSheet &sheet, const WalkInOutcome &outcome) {
+    std::ostringstream oss;
+    oss << "{\"success\":true,";
+    if (outcome.reservation) {
+        oss << "\"seated\":true,\"id\":\"" << outcome.reservation->getId() << "\"}";
+        return oss.str();
+    }
+    // A newly queued party is always last in line.
+    oss << "\"seated\":false,\"id\":\"" << *outcome.waitlistId << "\",\"position\":" << sheet.getWaitlist().size()
+        << ',';
+    writeWaitEstimate(oss, sheet.estimateWaitlist().back());
+    oss << '}';
+    return oss.str();
+}
+
+std::string waitlistToJson(const BookingSheet &sheet) {
+    const auto &waitlist = sheet.getWaitlist();
+    auto estimates = sheet.estimateWaitlist();
+    std::ostringstream oss;
+    oss << '[';
+    char timeText[kDateTimeTextLength];
+    for (size_t i = 0; i < waitlist.size(); ++i) {
+        const auto &entry = waitlist[i];
+        const auto &customer = sheet.getCustomers().get(entry.customerId);
+        if (i > 0) {
+            oss << ',';
+        }
+        oss << '{';
+        oss << "\"id\":\"" << entry.id << "\",";
+        oss << "\"position\":" << i + 1 << ',';
+        oss << "\"customer\":\"" << escapeJson(customer.getName()) << "\",";
+        oss << "\"phone\":\"" << escapeJson(customer.getPhone()) << "\",";
+        oss << "\"partySize\":" << entry.partySize << ',';
+        oss << "\"joinedAt\":\"";
+        oss.write(timeText, static_cast<std::streamsize>(formatDateTime(fromSheetMinutes(entry.joinedAt), timeText)));
+        oss << "\",\"notes\":\"" << escapeJson(entry.notes) << "\",";
+        writeWaitEstimate(oss, estimates[i]);
+        oss << '}';
+    }
+    oss << ']';
+    return oss.str();
+}
+
+std::string staffToJson(const Restaurant &restaurant) {
+    std::ostringstream oss;
+    oss << '[';
+    const auto &staff = restaurant.getStaff();
+    for (size_t i = 0; i < staff.size(); ++i) {
+        const auto &member = staff[i];
+        if (i > 0) {
+            oss << ',';
+        }
+        oss << '{';
+        oss << "\"name\":\"" << escapeJson(member->getName()) << "\",";
+        oss << "\"role\":\"" << escapeJson(member->getRole().getName()) << "\",";
+        oss << "\"contact\":\"" << escapeJson(member->getContact()) << "\"";
+        oss << '}';
+    }
+    oss << ']';
+    return oss.str();
+}
+
+std::string reportToJson(const Report &report, bool includeBreakdown) {
+    std::ostringstream oss;
+    oss << '{';
+    oss << "\"date\":\"" << escapeJson(report.getDate()) << "\",";
+    oss << "\"totalReservations\":" << report.getTotalReservations() << ',';
+    oss << "\"reservationsByStatus\":{";
+    for (size_t i = 0; i < kReservationStatusCount; ++i) {
+        auto status = static_cast<ReservationStatus>(i);
+        if (i > 0) {
+            oss << ',';
+        }
+        oss << '"' << reservationStatusToString(status) << "\":" << report.getReservationCount(status);
+    }
+    oss << "},";
+    oss << "\"seatedGuests\":" << report.getSeatedGuests() << ',';
+    oss << "\"revenue\":" << report.getRevenue().toString() << ',';
+    oss << "\"series\":[";
+    char timeText[kDateTimeTextLength];
+    const auto &series = report.getSeries();
+    for (size_t i = 0; i < series.size(); ++i) {
+        if (i > 0) {
+            oss << ',';
+        }
+        oss << "{\"start\":\"";
+        oss.write(timeText, static_cast<std::streamsize>(formatDateTime(series[i].start, timeText)));
+        oss << "\",\"covers\":" << series[i].covers << ",\"revenue\":" << series[i].revenue.toString() << '}';
+    }
+    oss << ']';
+    if (!includeBreakdown) {
+        oss << '}';
+        return oss.str();
+    }
+    oss << ",\"breakdownOffset\":" << report.getBreakdownOffset() << ',';
+    oss << "\"breakdown\":[";
+    const auto &breakdown = report.getReservationBreakdown();
+    for (size_t i = 0; i < breakdown.size(); ++i) {
+        if (i > 0) {
+            oss << ',';
+        }
+        oss << '{';
+        oss << "\"reservationId\":\"" << std::get<0>(breakdown[i]) << "\",";
+        oss << "\"status\":\"" << reservationStatusToString(std::get<1>(breakdown[i])) << "\"";
+        oss << '}';
+    }
+    oss << "]}";
+    return oss.str();
+}
+
+}  // namespace booking
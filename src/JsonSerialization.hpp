@@ -0,0 +1,46 @@
+#pragma once
+
+#include "ReservationSystem.hpp"
+
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace booking {
+
+// JSON views of the booking model, as served by the web API.
+
+std::string escapeJson(std::string_view value);
+std::string tableStatusToString(TableStatus status);
+std::string reservationStatusToString(ReservationStatus status);
+
+template <typename TableIds>
+void writeTableIdArray(std::ostringstream &oss, const TableIds &tableIds) {
+    oss << '[';
+    for (size_t i = 0; i < tableIds.size(); ++i) {
+        if (i > 0) {
+            oss << ',';
+        }
+        oss << tableIds[i];
+    }
+    oss << ']';
+}
+
+// Writes the "partiesAhead" and "etaMinutes" fields, without braces.
+void writeWaitEstimate(std::ostringstream &oss, const WaitEstimate &estimate);
+
+std::string tablesToJson(const Restaurant &restaurant);
+std::string reservationToJson(const BookingSheet &sheet, const Reservation &reservation);
+std::string reservationsToJson(const Restaurant &restaurant);
+std::string ordersToJson(const Restaurant &restaurant);
+std::string customerHistoryToJson(const Restaurant &restaurant, CustomerId id);
+std::string menuToJson(const Restaurant &restaurant);
+std::string popularDishesToJson(const std::vector<DishCount> &dishes, std::chrono::minutes window);
+std::string walkInOutcomeToJson(const BookingSheet &sheet, const WalkInOutcome &outcome);
+std::string waitlistToJson(const BookingSheet &sheet);
+std::string staffToJson(const Restaurant &restaurant);
+std::string reportToJson(const Report &report, bool includeBreakdown);
+
+}  // namespace booking
@@ -0,0 +1,87 @@
+#include "Metrics.hpp"
+
+namespace booking {
+
+namespace {
+constexpr std::int64_t kBucketBoundsNanos[DurationHistogram::kBucketCount] = {
+    10'000,     25'000,     50'000,      100'000,     250'000,     500'000,       1'000'000,     2'500'000,
+    5'000'000,  10'000'000, 25'000'000,  50'000'000,  100'000'000, 250'000'000,   1'000'000'000, 5'000'000'000,
+};
+
+void writeSeconds(std::ostream &out, std::int64_t nanos) {
+    // Bucket bounds and sums print exactly, without locale or stream precision getting involved.
+    out << nanos / 1'000'000'000;
+    auto fraction = std::to_string(nanos % 1'000'000'000);
+    fraction.insert(0, 9 - fraction.size(), '0');
+    fraction.erase(fraction.find_last_not_of('0') + 1);
+    if (!fraction.empty()) {
+        out << '.' << fraction;
+    }
+}
+}  // namespace
+
+size_t currentMetricShard() {
+    static std::atomic<size_t> nextShard{0};
+    thread_local size_t shard = nextShard.fetch_add(1, std::memory_order_relaxed) % kMetricShards;
+    return shard;
+}
+
+void DurationHistogram::observe(std::chrono::steady_clock::duration elapsed) {
+    auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    if (nanos < 0) {
+        nanos = 0;
+    }
+    size_t bucket = 0;
+    while (bucket < kBucketCount && nanos > kBucketBoundsNanos[bucket]) {
+        ++bucket;
+    }
+    counters_.add(bucket);
+    counters_.add(kSumSlot, static_cast<std::uint64_t>(nanos));
+}
+
+std::uint64_t DurationHistogram::count() const {
+    std::uint64_t count = 0;
+    for (size_t bucket = 0; bucket <= kBucketCount; ++bucket) {
+        count += counters_.total(bucket);
+    }
+    return count;
+}
+
+void DurationHistogram::write(std::ostream &out, const std::string &name, const std::string &labels) const {
+    auto separator = labels.empty() ? "" : ",";
+    std::uint64_t cumulative = 0;
+    for (size_t bucket = 0; bucket < kBucketCount; ++bucket) {
+        cumulative += counters_.total(bucket);
+        out << name << "_bucket{" << labels << separator << "le=\"";
+        writeSeconds(out, kBucketBoundsNanos[bucket]);
+        out << "\"} " << cumulative << '\n';
+    }
+    cumulative += counters_.total(kBucketCount);
+    out << name << "_bucket{" << labels << separator << "le=\"+Inf\"} " << cumulative << '\n';
+    auto braced = labels.empty() ? std::string() : '{' + labels + '}';
+    out << name << "_sum" << braced << ' ';
+    writeSeconds(out, static_cast<std::int64_t>(counters_.total(kSumSlot)));
+    out << '\n' << name << "_count" << braced << ' ' << cumulative << '\n';
+}
+
+void writeMetricHeader(std::ostream &out, const char *name, const char *type, const char *help) {
+    out << "# HELP " << name << ' ' << help << "\n# TYPE " << name << ' ' << type << '\n';
+}
+
+std::string escapeLabelValue(const std::string &value) {
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            escaped.push_back('\\');
+            escaped.push_back(c);
+        } else if (c == '\n') {
+            escaped += "\\n";
+        } else {
+            escaped.push_back(c);
+        }
+    }
+    return escaped;
+}
+
+}  // namespace booking
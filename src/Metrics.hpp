@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace booking {
+
+// Counter updates are spread over this many cache-line-sized shards.
+constexpr size_t kMetricShards = 16;
+
+// The shard the calling thread writes to. Threads are assigned round robin on first use, so
+// concurrent writers rarely share a cache line.
+size_t currentMetricShard();
+
+// N counters updated with relaxed atomic adds on the calling thread's shard, never under a lock.
+// Reads sum the shards, so a total taken while others write may miss their latest additions.
+template <size_t N>
+class ShardedCounters {
+public:
+    void add(size_t index, std::uint64_t amount = 1) {
+        shards_[currentMetricShard()].values[index].fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    std::uint64_t total(size_t index) const {
+        std::uint64_t sum = 0;
+        for (const auto &shard : shards_) {
+            sum += shard.values[index].load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+private:
+    struct alignas(64) Shard {
+        Shard() {
+            for (auto &value : values) {
+                value.store(0, std::memory_order_relaxed);
+            }
+        }
+        std::array<std::atomic<std::uint64_t>, N> values;
+    };
+
+    std::array<Shard, kMetricShards> shards_;
+};
+
+// A Prometheus histogram of durations with fixed buckets from 10 us to 5 s.
+class DurationHistogram {
+public:
+    static constexpr size_t kBucketCount = 16;
+
+    void observe(std::chrono::steady_clock::duration elapsed);
+    std::uint64_t count() const;
+    // Writes the _bucket, _sum and _count series. `labels` is empty or `key="value",...`.
+    void write(std::ostream &out, const std::string &name, const std::string &labels) const;
+
+private:
+    // One slot per bucket plus +Inf, each counted once rather than cumulatively, then the sum
+    // in nanoseconds.
+    static constexpr size_t kSumSlot = kBucketCount + 1;
+    ShardedCounters<kBucketCount + 2> counters_;
+};
+
+// The # HELP and # TYPE lines that start a metric family.
+void writeMetricHeader(std::ostream &out, const char *name, const char *type, const char *help);
+
+// Escapes a label value for the Prometheus text format.
+std::string escapeLabelValue(const std::string &value);
+
+}  // namespace booking
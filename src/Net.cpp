@@ -0,0 +1,440 @@
+#include "Net.hpp"
+
+#ifdef _WIN32
+#ifdef _MSC_VER
+#pragma comment(lib, "ws2_32.lib")
+#endif
+#else
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+namespace booking {
+
+#ifdef _WIN32
+using SendSize = int;
+
+void closeSocket(SocketHandle socket) { closesocket(socket); }
+
+void shutdownSocket(SocketHandle socket) { shutdown(socket, SD_BOTH); }
+
+SocketEnvironment::SocketEnvironment() {
+    WSADATA data;
+    if (WSAStartup(MAKEWORD(2, 2), &data) != 0) {
+        throw std::runtime_error("Failed to initialize Winsock");
+    }
+}
+
+SocketEnvironment::~SocketEnvironment() { WSACleanup(); }
+
+bool setSocketBlocking(SocketHandle socket, bool blocking) {
+    u_long nonBlocking = blocking ? 0 : 1;
+    return ioctlsocket(socket, FIONBIO, &nonBlocking) == 0;
+}
+
+bool lastSocketErrorWouldBlock() { return WSAGetLastError() == WSAEWOULDBLOCK; }
+
+int portablePoll(PollDescriptor *descriptors, size_t count, int timeoutMillis) {
+    return WSAPoll(descriptors, static_cast<ULONG>(count), timeoutMillis);
+}
+#else
+using SendSize = ssize_t;
+
+#ifdef MSG_NOSIGNAL
+constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+constexpr int kSendFlags = 0;
+#endif
+
+void closeSocket(SocketHandle socket) { close(socket); }
+
+void shutdownSocket(SocketHandle socket) { shutdown(socket, SHUT_RDWR); }
+
+SocketEnvironment::SocketEnvironment() = default;
+
+SocketEnvironment::~SocketEnvironment() = default;
+
+bool setSocketBlocking(SocketHandle socket, bool blocking) {
+    int flags = fcntl(socket, F_GETFL, 0);
+    if (flags < 0) {
+        return false;
+    }
+    flags = blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK);
+    return fcntl(socket, F_SETFL, flags) == 0;
+}
+
+bool lastSocketErrorWouldBlock() { return errno == EAGAIN || errno == EWOULDBLOCK; }
+
+int portablePoll(PollDescriptor *descriptors, size_t count, int timeoutMillis) {
+    return poll(descriptors, static_cast<nfds_t>(count), timeoutMillis);
+}
+#endif
+
+std::chrono::steady_clock::time_point transferDeadline(const ConnectionLimits &limits,
+                                                       std::chrono::milliseconds phaseTimeout,
+                                                       std::chrono::steady_clock::time_point started,
+                                                       std::chrono::steady_clock::time_point lastProgress,
+                                                       size_t bytes) {
+    auto deadline = std::min(started + phaseTimeout, lastProgress + limits.idleTimeout);
+    if (limits.minBytesPerSecond > 0) {
+        // Every byte buys 1/minBytesPerSecond of a second beyond the grace period.
+        auto earned = std::chrono::milliseconds(bytes * 1000 / limits.minBytesPerSecond);
+        deadline = std::min(deadline, started + std::max(limits.minRateGrace, earned));
+    }
+    return deadline;
+}
+
+int portableSend(SocketHandle socket, const char *data, size_t length) {
+    size_t totalSent = 0;
+    while (totalSent < length) {
+#ifdef _WIN32
+        SendSize chunk = send(socket, data + totalSent, static_cast<int>(length - totalSent), 0);
+#else
+        SendSize chunk = send(socket, data + totalSent, length - totalSent, kSendFlags);
+#endif
+        if (chunk <= 0) {
+            return -1;
+        }
+        totalSent += static_cast<size_t>(chunk);
+    }
+    return static_cast<int>(totalSent);
+}
+
+int portableRecv(SocketHandle socket, char *data, size_t length) {
+#ifdef _WIN32
+    return recv(socket, data, static_cast<int>(length), 0);
+#else
+    return static_cast<int>(recv(socket, data, length, 0));
+#endif
+}
+
+bool sendWithin(SocketHandle socket, const char *data, size_t length, const ConnectionLimits &limits) {
+    auto started = std::chrono::steady_clock::now();
+    auto lastProgress = started;
+    size_t sent = 0;
+    while (sent < length) {
+#ifdef _WIN32
+        SendSize chunk = send(socket, data + sent, static_cast<int>(length - sent), 0);
+#else
+        SendSize chunk = send(socket, data + sent, length - sent, kSendFlags);
+#endif
+        auto now = std::chrono::steady_clock::now();
+        if (chunk > 0) {
+            sent += static_cast<size_t>(chunk);
+            lastProgress = now;
+            continue;
+        }
+        if (chunk == 0 || !lastSocketErrorWouldBlock()) {
+            return false;
+        }
+        auto deadline = transferDeadline(limits, limits.writeTimeout, started, lastProgress, sent);
+        if (now >= deadline) {
+            return false;
+        }
+        PollDescriptor descriptor{};
+        descriptor.fd = socket;
+        descriptor.events = POLLOUT;
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() + 1;
+        if (portablePoll(&descriptor, 1, static_cast<int>(wait)) < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+namespace {
+// Connections waiting to be accepted; the old fixed 10 dropped SYNs under any burst.
+constexpr int kListenBacklog = SOMAXCONN;
+
+bool readPeerAddress(SocketHandle socket, std::string &host, int &port, bool &isV6) {
+    sockaddr_storage address{};
+    socklen_t length = sizeof(address);
+    if (getpeername(socket, reinterpret_cast<sockaddr *>(&address), &length) != 0) {
+        return false;
+    }
+    char text[INET6_ADDRSTRLEN] = {};
+    isV6 = address.ss_family == AF_INET6;
+    if (isV6) {
+        const auto *v6 = reinterpret_cast<const sockaddr_in6 *>(&address);
+        inet_ntop(AF_INET6, &v6->sin6_addr, text, sizeof(text));
+        port = ntohs(v6->sin6_port);
+    } else {
+        const auto *v4 = reinterpret_cast<const sockaddr_in *>(&address);
+        inet_ntop(AF_INET, &v4->sin_addr, text, sizeof(text));
+        port = ntohs(v4->sin_port);
+    }
+    host = text;
+    return true;
+}
+}  // namespace
+
+std::string describePeer(SocketHandle socket) {
+    std::string host;
+    int port = 0;
+    bool isV6 = false;
+    if (!readPeerAddress(socket, host, port, isV6)) {
+        return "unknown";
+    }
+    if (isV6) {
+        return "[" + host + "]:" + std::to_string(port);
+    }
+    return host + ":" + std::to_string(port);
+}
+
+std::string describePeerHost(SocketHandle socket) {
+    std::string host;
+    int port = 0;
+    bool isV6 = false;
+    if (!readPeerAddress(socket, host, port, isV6)) {
+        return "unknown";
+    }
+    return host;
+}
+
+SocketHandle createListeningSocket(int port) {
+    SocketHandle serverFd = INVALID_SOCKET_HANDLE;
+
+#ifdef AF_INET6
+    serverFd = socket(AF_INET6, SOCK_STREAM, 0);
+    if (serverFd != INVALID_SOCKET_HANDLE) {
+#ifdef _WIN32
+        char reuse = 1;
+        setsockopt(serverFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        char dualStack = 0;
+        setsockopt(serverFd, IPPROTO_IPV6, IPV6_V6ONLY, &dualStack, sizeof(dualStack));
+#else
+        int reuse = 1;
+        setsockopt(serverFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        int dualStack = 0;
+        setsockopt(serverFd, IPPROTO_IPV6, IPV6_V6ONLY, &dualStack, sizeof(dualStack));
+#endif
+
+        sockaddr_in6 address{};
+        address.sin6_family = AF_INET6;
+        address.sin6_addr = in6addr_any;
+        address.sin6_port = htons(static_cast<uint16_t>(port));
+
+        if (bind(serverFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0) {
+            if (listen(serverFd, kListenBacklog) == 0) {
+                return serverFd;
+            }
+        }
+        closeSocket(serverFd);
+        serverFd = INVALID_SOCKET_HANDLE;
+    }
+#endif
+
+    serverFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (serverFd == INVALID_SOCKET_HANDLE) {
+        throw std::runtime_error("Failed to create socket");
+    }
+
+#ifdef _WIN32
+    char opt = 1;
+    setsockopt(serverFd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+#else
+    int opt = 1;
+    setsockopt(serverFd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+#endif
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+
+    if (bind(serverFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) {
+        closeSocket(serverFd);
+        throw std::runtime_error("Failed to bind socket");
+    }
+
+    if (listen(serverFd, kListenBacklog) < 0) {
+        closeSocket(serverFd);
+        throw std::runtime_error("Failed to listen on socket");
+    }
+
+    return serverFd;
+}
+
+SocketHandle connectToHost(const std::string &host, int port) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *results = nullptr;
+    auto service = std::to_string(port);
+    if (getaddrinfo(host.c_str(), service.c_str(), &hints, &results) != 0) {
+        return INVALID_SOCKET_HANDLE;
+    }
+    SocketHandle connected = INVALID_SOCKET_HANDLE;
+    for (auto *entry = results; entry != nullptr; entry = entry->ai_next) {
+        SocketHandle candidate = socket(entry->ai_family, entry->ai_socktype, entry->ai_protocol);
+        if (candidate == INVALID_SOCKET_HANDLE) {
+            continue;
+        }
+        if (connect(candidate, entry->ai_addr, static_cast<socklen_t>(entry->ai_addrlen)) == 0) {
+            connected = candidate;
+            break;
+        }
+        closeSocket(candidate);
+    }
+    freeaddrinfo(results);
+    return connected;
+}
+
+#ifdef _WIN32
+SocketHandle createHandoffListener(const std::string &) {
+    throw std::runtime_error("Listening socket hand-off is not supported on Windows");
+}
+
+void closeHandoffListener(SocketHandle listener, const std::string &) { closeSocket(listener); }
+
+SocketHandle connectHandoff(const std::string &) { return INVALID_SOCKET_HANDLE; }
+
+bool sendSocketHandle(SocketHandle, SocketHandle) { return false; }
+
+SocketHandle receiveSocketHandle(SocketHandle) { return INVALID_SOCKET_HANDLE; }
+#else
+namespace {
+bool toUnixAddress(const std::string &path, sockaddr_un &address) {
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+}  // namespace
+
+SocketHandle createHandoffListener(const std::string &path) {
+    sockaddr_un address{};
+    if (!toUnixAddress(path, address)) {
+        throw std::runtime_error("Invalid hand-off socket path: " + path);
+    }
+    SocketHandle listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener == INVALID_SOCKET_HANDLE) {
+        throw std::runtime_error("Failed to create hand-off socket");
+    }
+    unlink(path.c_str());
+    if (bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(listener, 1) != 0) {
+        closeSocket(listener);
+        throw std::runtime_error("Failed to listen on hand-off socket " + path);
+    }
+    return listener;
+}
+
+void closeHandoffListener(SocketHandle listener, const std::string &path) {
+    closeSocket(listener);
+    unlink(path.c_str());
+}
+
+SocketHandle connectHandoff(const std::string &path) {
+    sockaddr_un address{};
+    if (!toUnixAddress(path, address)) {
+        return INVALID_SOCKET_HANDLE;
+    }
+    SocketHandle channel = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (channel == INVALID_SOCKET_HANDLE) {
+        return INVALID_SOCKET_HANDLE;
+    }
+    if (connect(channel, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        closeSocket(channel);
+        return INVALID_SOCKET_HANDLE;
+    }
+    return channel;
+}
+
+bool sendSocketHandle(SocketHandle channel, SocketHandle handle) {
+    // The descriptor rides as ancillary data on a single ordinary byte.
+    char marker = 'L';
+    iovec payload{&marker, 1};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr message{};
+    message.msg_iov = &payload;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(header), &handle, sizeof(int));
+    return sendmsg(channel, &message, kSendFlags) == 1;
+}
+
+SocketHandle receiveSocketHandle(SocketHandle channel) {
+    char marker = 0;
+    iovec payload{&marker, 1};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr message{};
+    message.msg_iov = &payload;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    if (recvmsg(channel, &message, 0) != 1) {
+        return INVALID_SOCKET_HANDLE;
+    }
+    for (cmsghdr *header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+            SocketHandle handle = INVALID_SOCKET_HANDLE;
+            std::memcpy(&handle, CMSG_DATA(header), sizeof(int));
+            return handle;
+        }
+    }
+    return INVALID_SOCKET_HANDLE;
+}
+#endif
+
+SocketReader::SocketReader(SocketHandle socket) : socket_(socket) {}
+
+bool SocketReader::fill() {
+    if (offset_ > 0) {
+        buffer_.erase(0, offset_);
+        offset_ = 0;
+    }
+    char temp[4096];
+    int received = portableRecv(socket_, temp, sizeof(temp));
+    if (received <= 0) {
+        return false;
+    }
+    buffer_.append(temp, static_cast<size_t>(received));
+    return true;
+}
+
+bool SocketReader::readLine(std::string &line, size_t maxLength) {
+    while (true) {
+        auto newline = buffer_.find('\n', offset_);
+        if (newline != std::string::npos) {
+            line.assign(buffer_, offset_, newline - offset_);
+            offset_ = newline + 1;
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            return true;
+        }
+        if (buffer_.size() - offset_ > maxLength || !fill()) {
+            return false;
+        }
+    }
+}
+
+bool SocketReader::readExact(size_t length, std::string &out) {
+    while (buffer_.size() - offset_ < length) {
+        if (!fill()) {
+            return false;
+        }
+    }
+    out.assign(buffer_, offset_, length);
+    offset_ += length;
+    return true;
+}
+
+}  // namespace booking
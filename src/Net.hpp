@@ -0,0 +1,129 @@
+#pragma once
+
+#ifdef _WIN32
+#ifndef _WIN32_WINNT
+#define _WIN32_WINNT 0x0600
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#endif
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+namespace booking {
+
+#ifdef _WIN32
+using SocketHandle = SOCKET;
+constexpr SocketHandle INVALID_SOCKET_HANDLE = INVALID_SOCKET;
+using PollDescriptor = WSAPOLLFD;
+#else
+using SocketHandle = int;
+constexpr SocketHandle INVALID_SOCKET_HANDLE = -1;
+using PollDescriptor = pollfd;
+#endif
+
+// How long a client may take over each part of an exchange. A transfer is abandoned when its
+// phase runs out, when it stalls for idleTimeout, or when, after minRateGrace, it has averaged
+// fewer than minBytesPerSecond.
+struct ConnectionLimits {
+    std::chrono::milliseconds headerTimeout{10000};
+    std::chrono::milliseconds bodyTimeout{30000};
+    std::chrono::milliseconds writeTimeout{30000};
+    std::chrono::milliseconds idleTimeout{5000};
+    std::chrono::milliseconds minRateGrace{5000};
+    size_t minBytesPerSecond = 256;
+    // Open connections per client address, counting those still being read.
+    size_t maxConnectionsPerClient = 16;
+    // Connections still sending their request; each costs a buffer, not a thread.
+    size_t maxPendingConnections = 4096;
+};
+
+// The moment a transfer that began at `started`, last moved bytes at `lastProgress` and has moved
+// `bytes` in total must be abandoned.
+std::chrono::steady_clock::time_point transferDeadline(const ConnectionLimits &limits,
+                                                       std::chrono::milliseconds phaseTimeout,
+                                                       std::chrono::steady_clock::time_point started,
+                                                       std::chrono::steady_clock::time_point lastProgress,
+                                                       size_t bytes);
+
+void closeSocket(SocketHandle socket);
+
+// Interrupts any thread blocked on the socket without releasing the handle.
+void shutdownSocket(SocketHandle socket);
+
+// Formats the remote address of a connected socket as "host:port".
+std::string describePeer(SocketHandle socket);
+
+// The remote host of a connected socket, without the port; "unknown" if it cannot be read.
+std::string describePeerHost(SocketHandle socket);
+
+class SocketEnvironment {
+public:
+    SocketEnvironment();
+    SocketEnvironment(const SocketEnvironment &) = delete;
+    SocketEnvironment &operator=(const SocketEnvironment &) = delete;
+    ~SocketEnvironment();
+};
+
+// Sends the whole buffer, returning the number of bytes sent or -1 on failure.
+int portableSend(SocketHandle socket, const char *data, size_t length);
+
+// Receives up to `length` bytes, returning the byte count, 0 on orderly close or -1 on failure.
+int portableRecv(SocketHandle socket, char *data, size_t length);
+
+bool setSocketBlocking(SocketHandle socket, bool blocking);
+
+// True when the last failed call on a non-blocking socket only means it would have blocked.
+bool lastSocketErrorWouldBlock();
+
+// poll(2) or WSAPoll; a negative timeout waits indefinitely.
+int portablePoll(PollDescriptor *descriptors, size_t count, int timeoutMillis);
+
+// Sends the whole buffer on a non-blocking socket, waiting in poll between chunks. Returns false
+// if the peer fails or misses the write deadlines in `limits`.
+bool sendWithin(SocketHandle socket, const char *data, size_t length, const ConnectionLimits &limits);
+
+SocketHandle createListeningSocket(int port);
+
+// Opens a TCP connection to host:port, returning INVALID_SOCKET_HANDLE on failure.
+SocketHandle connectToHost(const std::string &host, int port);
+
+// A Unix domain socket at `path` through which a successor process can take over the listening
+// socket. Any stale socket file at `path` is replaced. POSIX only; throws elsewhere.
+SocketHandle createHandoffListener(const std::string &path);
+// Closes a hand-off listener and removes its socket file.
+void closeHandoffListener(SocketHandle listener, const std::string &path);
+// Connects to a hand-off listener, returning INVALID_SOCKET_HANDLE on failure.
+SocketHandle connectHandoff(const std::string &path);
+// Passes a duplicate of `handle` to the process on the other end of `channel` (SCM_RIGHTS).
+bool sendSocketHandle(SocketHandle channel, SocketHandle handle);
+// Receives a handle passed with sendSocketHandle, or INVALID_SOCKET_HANDLE.
+SocketHandle receiveSocketHandle(SocketHandle channel);
+
+// Buffered reader for line-framed protocols running over a socket.
+class SocketReader {
+public:
+    explicit SocketReader(SocketHandle socket);
+
+    // Reads up to and excluding the next '\n' (a trailing '\r' is stripped).
+    bool readLine(std::string &line, size_t maxLength = 64 * 1024);
+    bool readExact(size_t length, std::string &out);
+
+private:
+    bool fill();
+
+    SocketHandle socket_;
+    std::string buffer_;
+    size_t offset_ = 0;
+};
+
+}  // namespace booking
@@ -0,0 +1,163 @@
+#include "Popularity.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <unordered_set>
+
+namespace booking {
+
+namespace {
+constexpr auto kMinHeapOrder = [](const auto &lhs, const auto &rhs) { return lhs.first > rhs.first; };
+
+size_t sketchColumn(size_t hash, size_t row) {
+    // One 64-bit finaliser per row, seeded differently, gives the rows independent columns.
+    auto mixed = static_cast<std::uint64_t>(hash) ^ (0x9E3779B97F4A7C15ULL * (row + 1));
+    mixed ^= mixed >> 33;
+    mixed *= 0xFF51AFD7ED558CCDULL;
+    mixed ^= mixed >> 33;
+    return static_cast<size_t>(mixed % DishPopularity::kSketchWidth);
+}
+}  // namespace
+
+std::int64_t DishPopularity::epochOf(std::chrono::system_clock::time_point at) {
+    return std::chrono::floor<std::chrono::minutes>(at).time_since_epoch() / kBucketWidth;
+}
+
+std::uint32_t DishPopularity::estimate(const Sketch &sketch, size_t hash) {
+    auto smallest = sketch[0][sketchColumn(hash, 0)];
+    for (size_t row = 1; row < kSketchDepth; ++row) {
+        smallest = std::min(smallest, sketch[row][sketchColumn(hash, row)]);
+    }
+    return smallest;
+}
+
+DishPopularity::Bucket &DishPopularity::bucketFor(std::int64_t epoch) {
+    if (buckets_.empty()) {
+        buckets_.resize(kBucketCount);
+    }
+    auto slot = static_cast<size_t>(((epoch % static_cast<std::int64_t>(kBucketCount)) + kBucketCount) % kBucketCount);
+    auto &bucket = buckets_[slot];
+    if (bucket.epoch < epoch) {
+        // The slot last held a bucket that has since left the window.
+        bucket.epoch = epoch;
+        std::fill(bucket.exact.begin(), bucket.exact.end(), 0);
+        bucket.sketch.clear();
+        bucket.candidates.clear();
+    }
+    return bucket;
+}
+
+void DishPopularity::record(const std::string &dish, int quantity, std::chrono::system_clock::time_point at) {
+    if (quantity <= 0) {
+        return;
+    }
+    auto epoch = epochOf(at);
+    auto &bucket = bucketFor(epoch);
+    if (bucket.epoch != epoch) {
+        return;  // Older than anything the ring still holds.
+    }
+    auto count = static_cast<std::uint32_t>(quantity);
+    auto it = exactIndex_.find(dish);
+    if (it == exactIndex_.end() && exactNames_.size() < kExactDishLimit) {
+        it = exactIndex_.emplace(dish, exactNames_.size()).first;
+        exactNames_.push_back(dish);
+    }
+    if (it == exactIndex_.end()) {
+        recordSketched(bucket, dish, count);
+        return;
+    }
+    if (bucket.exact.size() <= it->second) {
+        bucket.exact.resize(it->second + 1, 0);
+    }
+    bucket.exact[it->second] += count;
+}
+
+void DishPopularity::recordSketched(Bucket &bucket, const std::string &dish, std::uint32_t quantity) {
+    if (bucket.sketch.empty()) {
+        bucket.sketch.emplace_back();
+        for (auto &row : bucket.sketch.front()) {
+            row.fill(0);
+        }
+    }
+    auto &sketch = bucket.sketch.front();
+    auto hash = std::hash<std::string>{}(dish);
+    for (size_t row = 0; row < kSketchDepth; ++row) {
+        sketch[row][sketchColumn(hash, row)] += quantity;
+    }
+    auto count = estimate(sketch, hash);
+
+    auto &heap = bucket.candidates;
+    auto existing = std::find_if(heap.begin(), heap.end(), [&](const auto &entry) { return entry.second == dish; });
+    if (existing != heap.end()) {
+        existing->first = count;
+        std::make_heap(heap.begin(), heap.end(), kMinHeapOrder);
+    } else if (heap.size() < kCandidatesPerBucket) {
+        heap.emplace_back(count, dish);
+        std::push_heap(heap.begin(), heap.end(), kMinHeapOrder);
+    } else if (count > heap.front().first) {
+        std::pop_heap(heap.begin(), heap.end(), kMinHeapOrder);
+        heap.back() = {count, dish};
+        std::push_heap(heap.begin(), heap.end(), kMinHeapOrder);
+    }
+}
+
+std::vector<DishCount> DishPopularity::top(size_t limit,
+                                           std::chrono::minutes window,
+                                           std::chrono::system_clock::time_point now) const {
+    std::vector<DishCount> result;
+    if (buckets_.empty() || limit == 0) {
+        return result;
+    }
+    auto last = epochOf(now);
+    auto span = std::clamp<std::int64_t>((window + kBucketWidth - std::chrono::minutes(1)) / kBucketWidth,
+                                         1,
+                                         static_cast<std::int64_t>(kBucketCount));
+    auto first = last - span + 1;
+
+    std::vector<std::int64_t> exactTotals(exactNames_.size(), 0);
+    std::vector<const Sketch *> sketches;
+    std::unordered_set<std::string> candidates;
+    for (const auto &bucket : buckets_) {
+        if (bucket.epoch < first || bucket.epoch > last) {
+            continue;
+        }
+        for (size_t i = 0; i < bucket.exact.size(); ++i) {
+            exactTotals[i] += bucket.exact[i];
+        }
+        if (!bucket.sketch.empty()) {
+            sketches.push_back(&bucket.sketch.front());
+            for (const auto &entry : bucket.candidates) {
+                candidates.insert(entry.second);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < exactTotals.size(); ++i) {
+        if (exactTotals[i] > 0) {
+            result.push_back(DishCount{exactNames_[i], exactTotals[i], false});
+        }
+    }
+    for (const auto &dish : candidates) {
+        auto hash = std::hash<std::string>{}(dish);
+        std::int64_t total = 0;
+        for (const auto *sketch : sketches) {
+            total += estimate(*sketch, hash);
+        }
+        result.push_back(DishCount{dish, total, true});
+    }
+    auto order = [](const DishCount &lhs, const DishCount &rhs) {
+        if (lhs.quantity != rhs.quantity) {
+            return lhs.quantity > rhs.quantity;
+        }
+        return lhs.name < rhs.name;
+    };
+    if (result.size() > limit) {
+        std::partial_sort(result.begin(), result.begin() + static_cast<std::ptrdiff_t>(limit), result.end(), order);
+        result.resize(limit);
+    } else {
+        std::sort(result.begin(), result.end(), order);
+    }
+    return result;
+}
+
+}  // namespace booking
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace booking {
+
+struct DishCount {
+    std::string name;
+    std::int64_t quantity = 0;
+    // True when the count comes from the sketch and may overstate the real figure.
+    bool estimated = false;
+};
+
+// Quantities ordered per dish over a sliding window of up to a day, in five-minute buckets kept
+// in a ring. The first kExactDishLimit dishes seen get exact counters; any beyond that share a
+// count-min sketch per bucket, with a small min-heap of each bucket's heaviest dishes as the
+// candidates for top-K. Recording is O(1) and memory is bounded whatever the size of the menu.
+class DishPopularity {
+public:
+    static constexpr auto kBucketWidth = std::chrono::minutes(5);
+    static constexpr size_t kBucketCount = 24 * 12;
+    static constexpr size_t kExactDishLimit = 128;
+    static constexpr size_t kSketchDepth = 4;
+    static constexpr size_t kSketchWidth = 256;
+    static constexpr size_t kCandidatesPerBucket = 16;
+
+    void record(const std::string &dish, int quantity, std::chrono::system_clock::time_point at);
+    // The `limit` most ordered dishes over the `window` ending at `now` (clamped to a day),
+    // most ordered first.
+    std::vector<DishCount> top(size_t limit,
+                               std::chrono::minutes window,
+                               std::chrono::system_clock::time_point now) const;
+
+private:
+    using Sketch = std::array<std::array<std::uint32_t, kSketchWidth>, kSketchDepth>;
+    struct Bucket {
+        std::int64_t epoch = -1;
+        // Indexed like exactNames_; grows as dishes are first seen.
+        std::vector<std::uint32_t> exact;
+        // Allocated on the first sketched dish of the bucket.
+        std::vector<Sketch> sketch;
+        // Min-heap on quantity.
+        std::vector<std::pair<std::uint32_t, std::string>> candidates;
+    };
+
+    static std::int64_t epochOf(std::chrono::system_clock::time_point at);
+    static std::uint32_t estimate(const Sketch &sketch, size_t hash);
+    Bucket &bucketFor(std::int64_t epoch);
+    void recordSketched(Bucket &bucket, const std::string &dish, std::uint32_t quantity);
+
+    std::unordered_map<std::string, size_t> exactIndex_;
+    std::vector<std::string> exactNames_;
+    // Sized on the first record, so sheets that never take orders stay small.
+    std::vector<Bucket> buckets_;
+};
+
+}  // namespace booking
@@ -0,0 +1,471 @@
+#include "Replication.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <utility>
+
+namespace booking {
+
+namespace {
+constexpr size_t kMaxRecordsPerBatch = 256;
+constexpr auto kHeartbeatInterval = std::chrono::milliseconds(1000);
+constexpr auto kReconnectDelay = std::chrono::milliseconds(1000);
+
+std::int64_t toMillis(std::chrono::system_clock::time_point timePoint) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(timePoint.time_since_epoch()).count();
+}
+
+bool sendText(SocketHandle socket, const std::string &text) {
+    return portableSend(socket, text.data(), text.size()) >= 0;
+}
+
+std::string encodeBatch(const std::vector<MutationRecord> &records, std::uint64_t lastSequence) {
+    std::ostringstream batch;
+    batch << "B " << records.size() << ' ' << lastSequence << '\n';
+    for (const auto &record : records) {
+        batch << "M " << record.sequence << ' ' << toMillis(record.recordedAt) << ' ' << record.tenant << ' '
+              << record.changes.size() << '\n'
+              << record.changes;
+    }
+    return batch.str();
+}
+
+bool readBatch(SocketReader &reader, std::vector<MutationRecord> &records, std::uint64_t &lastSequence) {
+    std::string line;
+    if (!reader.readLine(line) || line.size() < 2 || line[0] != 'B') {
+        return false;
+    }
+    size_t count = 0;
+    std::istringstream header(line.substr(2));
+    if (!(header >> count >> lastSequence)) {
+        return false;
+    }
+    records.clear();
+    for (size_t i = 0; i < count; ++i) {
+        if (!reader.readLine(line) || line.size() < 2 || line[0] != 'M') {
+            return false;
+        }
+        MutationRecord record;
+        std::int64_t recordedAtMillis = 0;
+        size_t changesLength = 0;
+        std::istringstream fields(line.substr(2));
+        if (!(fields >> record.sequence >> recordedAtMillis >> record.tenant >> changesLength)) {
+            return false;
+        }
+        if (!reader.readExact(changesLength, record.changes)) {
+            return false;
+        }
+        record.recordedAt = std::chrono::system_clock::time_point(std::chrono::milliseconds(recordedAtMillis));
+        records.push_back(std::move(record));
+    }
+    return true;
+}
+
+std::string encodeSnapshot(const StateSnapshot &snapshot) {
+    std::ostringstream out;
+    out << "S " << snapshot.sequence << ' ' << snapshot.restaurants.size() << '\n';
+    for (const auto &[tenant, state] : snapshot.restaurants) {
+        out << "T " << tenant << ' ' << state.size() << '\n' << state;
+    }
+    return out.str();
+}
+
+bool readSnapshot(SocketReader &reader, StateSnapshot &snapshot) {
+    std::string line;
+    size_t count = 0;
+    if (!reader.readLine(line) || line.size() < 2 || line[0] != 'S') {
+        return false;
+    }
+    std::istringstream header(line.substr(2));
+    if (!(header >> snapshot.sequence >> count)) {
+        return false;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        std::string tenant;
+        std::string state;
+        size_t length = 0;
+        if (!reader.readLine(line) || line.size() < 2 || line[0] != 'T') {
+            return false;
+        }
+        std::istringstream fields(line.substr(2));
+        if (!(fields >> tenant >> length) || !reader.readExact(length, state)) {
+            return false;
+        }
+        snapshot.restaurants.emplace_back(std::move(tenant), std::move(state));
+    }
+    return true;
+}
+}  // namespace
+
+MutationLog::MutationLog(size_t capacity) : capacity_(std::max<size_t>(capacity, 1)) {}
+
+std::uint64_t MutationLog::append(std::string tenant, std::string changes) {
+    MutationRecord record{0, std::chrono::system_clock::now(), std::move(tenant), std::move(changes)};
+    MutationRecord dropped;
+    std::uint64_t sequence = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sequence = base_ + records_.size() + 1;
+        record.sequence = sequence;
+        records_.push_back(std::move(record));
+        if (records_.size() > capacity_) {
+            // Freed once the lock is released.
+            dropped = std::move(records_.front());
+            records_.pop_front();
+            ++base_;
+        }
+    }
+    appended_.notify_all();
+    return sequence;
+}
+
+void MutationLog::startAfter(std::uint64_t sequence) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    base_ = sequence;
+    records_.clear();
+}
+
+bool MutationLog::canResumeAfter(std::uint64_t sequence) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return sequence >= base_ && sequence <= base_ + records_.size();
+}
+
+std::uint64_t MutationLog::lastSequence() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return base_ + records_.size();
+}
+
+std::optional<std::chrono::system_clock::time_point> MutationLog::recordedAt(std::uint64_t sequence) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (records_.empty() || sequence > base_ + records_.size()) {
+        return std::nullopt;
+    }
+    return records_[sequence > base_ ? sequence - base_ - 1 : 0].recordedAt;
+}
+
+std::vector<MutationRecord> MutationLog::readAfter(std::uint64_t sequence,
+                                                   size_t maxCount,
+                                                   std::chrono::milliseconds wait) const {
+    std::unique_lock<std::mutex> lock(mutex_);
+    appended_.wait_for(lock, wait, [&] { return base_ + records_.size() > sequence; });
+    std::vector<MutationRecord> result;
+    if (sequence < base_ || base_ + records_.size() <= sequence) {
+        return result;
+    }
+    auto begin = records_.begin() + static_cast<std::ptrdiff_t>(sequence - base_);
+    auto count = std::min(maxCount, static_cast<size_t>(records_.end() - begin));
+    result.assign(begin, begin + static_cast<std::ptrdiff_t>(count));
+    return result;
+}
+
+ReplicationHub::ReplicationHub() {
+    std::random_device device;
+    std::uniform_int_distribution<std::uint64_t> distribution(1);
+    epoch_ = distribution(device);
+}
+
+MutationLog &ReplicationHub::getLog() { return log_; }
+
+const MutationLog &ReplicationHub::getLog() const { return log_; }
+
+std::uint64_t ReplicationHub::getEpoch() const { return epoch_; }
+
+void ReplicationHub::setSnapshotSource(SnapshotFunction source) { snapshotSource_ = std::move(source); }
+
+void ReplicationHub::continueFrom(std::uint64_t epoch, std::uint64_t sequence) {
+    epoch_ = epoch;
+    log_.startAfter(sequence);
+}
+
+void ReplicationHub::updateSession(int id, std::uint64_t ackedSequence) {
+    std::lock_guard<std::mutex> lock(sessionsMutex_);
+    for (auto &session : sessions_) {
+        if (session.id == id) {
+            session.ackedSequence = ackedSequence;
+        }
+    }
+}
+
+// Wire format, after the HTTP response head:
+//   primary -> replica  "H <epoch> <resume>\n"; when <resume> is 0, a snapshot follows:
+//                       "S <sequence> <count>\n" and <count> restaurants, each
+//                       "T <tenant> <stateLength>\n<state>"
+//   primary -> replica  "B <count> <lastSequence>\n" followed by <count> records, each
+//                       "M <sequence> <recordedAtMillis> <tenant> <changesLength>\n<changes>"
+//   replica -> primary  "A <appliedSequence>\n" once the whole batch has been applied.
+// An empty batch doubles as the heartbeat that keeps lag figures fresh. A successor process is
+// sent just the "H" line and a snapshot.
+void ReplicationHub::serveReplica(SocketHandle socket,
+                                  const std::string &peer,
+                                  std::uint64_t fromSequence,
+                                  std::uint64_t epoch) {
+    bool resume = epoch == epoch_ && log_.canResumeAfter(fromSequence);
+    std::string hello = "H " + std::to_string(epoch_) + (resume ? " 1\n" : " 0\n");
+    if (!resume) {
+        auto snapshot = snapshotSource_();
+        fromSequence = snapshot.sequence;
+        hello += encodeSnapshot(snapshot);
+    }
+    if (!sendText(socket, hello)) {
+        return;
+    }
+
+    int id = 0;
+    {
+        std::lock_guard<std::mutex> lock(sessionsMutex_);
+        id = nextSessionId_++;
+        sessions_.push_back(Session{id, peer, fromSequence});
+    }
+
+    SocketReader reader(socket);
+    std::uint64_t sent = fromSequence;
+    while (true) {
+        if (!log_.canResumeAfter(sent)) {
+            // The records this replica needs next have been dropped; it reconnects for a snapshot.
+            break;
+        }
+        auto records = log_.readAfter(sent, kMaxRecordsPerBatch, kHeartbeatInterval);
+        if (!sendText(socket, encodeBatch(records, log_.lastSequence()))) {
+            break;
+        }
+        if (!records.empty()) {
+            sent = records.back().sequence;
+        }
+
+        std::string ack;
+        if (!reader.readLine(ack) || ack.size() < 3 || ack[0] != 'A') {
+            break;
+        }
+        std::uint64_t acked = 0;
+        std::istringstream iss(ack.substr(2));
+        if (!(iss >> acked)) {
+            break;
+        }
+        updateSession(id, acked);
+        if (draining_.load() && acked >= log_.lastSequence()) {
+            break;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(sessionsMutex_);
+    sessions_.erase(std::remove_if(sessions_.begin(), sessions_.end(), [&](const Session &session) {
+                        return session.id == id;
+                    }),
+                    sessions_.end());
+}
+
+void ReplicationHub::drain() { draining_ = true; }
+
+bool ReplicationHub::sendState(SocketHandle socket, const StateSnapshot &snapshot) const {
+    return sendText(socket, "H " + std::to_string(epoch_) + " 0\n" + encodeSnapshot(snapshot));
+}
+
+bool receiveState(SocketHandle socket, std::uint64_t &epoch, StateSnapshot &snapshot) {
+    SocketReader reader(socket);
+    std::string line;
+    if (!reader.readLine(line) || line.size() < 2 || line[0] != 'H') {
+        return false;
+    }
+    std::istringstream hello(line.substr(2));
+    return static_cast<bool>(hello >> epoch) && readSnapshot(reader, snapshot);
+}
+
+std::vector<ReplicaStatus> ReplicationHub::getReplicaStatuses() const {
+    std::vector<Session> sessions;
+    {
+        std::lock_guard<std::mutex> lock(sessionsMutex_);
+        sessions = sessions_;
+    }
+    auto last = log_.lastSequence();
+    auto now = std::chrono::system_clock::now();
+    std::vector<ReplicaStatus> statuses;
+    statuses.reserve(sessions.size());
+    for (const auto &session : sessions) {
+        ReplicaStatus status;
+        status.peer = session.peer;
+        status.ackedSequence = session.ackedSequence;
+        status.lagEntries = last > session.ackedSequence ? last - session.ackedSequence : 0;
+        if (status.lagEntries > 0) {
+            if (auto oldestPending = log_.recordedAt(session.ackedSequence + 1)) {
+                status.lag = std::chrono::duration_cast<std::chrono::milliseconds>(now - *oldestPending);
+            }
+        }
+        statuses.push_back(std::move(status));
+    }
+    return statuses;
+}
+
+ReplicaClient::ReplicaClient(std::string host, int port, std::string token, ApplyFunction apply, InstallFunction install)
+    : host_(std::move(host)),
+      port_(port),
+      token_(std::move(token)),
+      apply_(std::move(apply)),
+      install_(std::move(install)) {}
+
+ReplicaClient::~ReplicaClient() { stop(); }
+
+void ReplicaClient::start() {
+    if (running_.exchange(true)) {
+        return;
+    }
+    thread_ = std::thread(&ReplicaClient::run, this);
+}
+
+void ReplicaClient::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(socketMutex_);
+        if (socket_ != INVALID_SOCKET_HANDLE) {
+            shutdownSocket(socket_);
+        }
+    }
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+const std::string &ReplicaClient::getHost() const { return host_; }
+
+int ReplicaClient::getPort() const { return port_; }
+
+bool ReplicaClient::isConnected() const { return connected_.load(); }
+
+bool ReplicaClient::hasDiverged() const { return diverged_.load(); }
+
+std::uint64_t ReplicaClient::getAppliedSequence() const { return appliedSequence_.load(); }
+
+std::uint64_t ReplicaClient::getPrimarySequence() const { return primarySequence_.load(); }
+
+std::uint64_t ReplicaClient::getEpoch() const { return epoch_.load(); }
+
+std::uint64_t ReplicaClient::getResyncCount() const { return resyncs_.load(); }
+
+void ReplicaClient::run() {
+    while (running_.load() && !diverged_.load()) {
+        SocketHandle socket = connectToHost(host_, port_);
+        if (socket != INVALID_SOCKET_HANDLE) {
+            {
+                std::lock_guard<std::mutex> lock(socketMutex_);
+                socket_ = socket;
+            }
+            connected_ = true;
+            follow(socket);
+            connected_ = false;
+            {
+                std::lock_guard<std::mutex> lock(socketMutex_);
+                socket_ = INVALID_SOCKET_HANDLE;
+            }
+            closeSocket(socket);
+        }
+        auto deadline = std::chrono::steady_clock::now() + kReconnectDelay;
+        while (running_.load() && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+    }
+}
+
+bool ReplicaClient::follow(SocketHandle socket) {
+    std::ostringstream handshake;
+    handshake << "GET " << kReplicationStreamPath << "?from=" << appliedSequence_.load() << "&epoch=" << epoch_.load()
+              << " HTTP/1.1\r\n"
+              << "Host: " << host_ << "\r\n";
+    if (!token_.empty()) {
+        handshake << "X-Staff-Token: " << token_ << "\r\n";
+    }
+    handshake << "\r\n";
+    if (!sendText(socket, handshake.str())) {
+        return false;
+    }
+
+    SocketReader reader(socket);
+    std::string line;
+    if (!reader.readLine(line) || line.find(" 200 ") == std::string::npos) {
+        return false;
+    }
+    while (reader.readLine(line)) {
+        if (line.empty()) {
+            break;
+        }
+    }
+
+    std::uint64_t epoch = 0;
+    int resume = 0;
+    if (!reader.readLine(line) || line.size() < 2 || line[0] != 'H') {
+        return false;
+    }
+    std::istringstream hello(line.substr(2));
+    if (!(hello >> epoch >> resume)) {
+        return false;
+    }
+    if (!resume) {
+        StateSnapshot snapshot;
+        if (!readSnapshot(reader, snapshot)) {
+            return false;
+        }
+        try {
+            install_(snapshot);
+        } catch (const std::exception &ex) {
+            std::cerr << ex.what() << "; no longer following the primary" << std::endl;
+            diverged_ = true;
+            return false;
+        }
+        appliedSequence_ = snapshot.sequence;
+    }
+    epoch_ = epoch;
+
+    std::vector<MutationRecord> records;
+    while (running_.load()) {
+        std::uint64_t primaryLast = 0;
+        if (!readBatch(reader, records, primaryLast)) {
+            return false;
+        }
+        primarySequence_ = primaryLast;
+        for (const auto &record : records) {
+            // Records at or below what we already applied can arrive again after a reconnect.
+            if (record.sequence <= appliedSequence_.load()) {
+                continue;
+            }
+            try {
+                apply_(record);
+            } catch (const std::exception &ex) {
+                std::cerr << ex.what() << "; starting over from a snapshot" << std::endl;
+                epoch_ = 0;
+                ++resyncs_;
+                return false;
+            }
+            appliedSequence_ = record.sequence;
+        }
+        if (!sendText(socket, "A " + std::to_string(appliedSequence_.load()) + "\n")) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool parseHostPort(const std::string &value, std::string &host, int &port) {
+    auto colon = value.rfind(':');
+    if (colon == std::string::npos || colon == 0 || colon + 1 >= value.size()) {
+        return false;
+    }
+    host = value.substr(0, colon);
+    if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+        host = host.substr(1, host.size() - 2);
+    }
+    try {
+        size_t consumed = 0;
+        port = std::stoi(value.substr(colon + 1), &consumed);
+        if (consumed != value.size() - colon - 1) {
+            return false;
+        }
+    } catch (...) {
+        return false;
+    }
+    return port > 0 && port <= 65535;
+}
+
+}  // namespace booking
@@ -0,0 +1,186 @@
+#pragma once
+
+#include "Net.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace booking {
+
+// What one write did to one restaurant: the resulting state of every record it touched, as
+// returned by Restaurant::takeChanges. Replicas store it as is, so nothing the primary decided
+// (ids, times, tables) is decided again on their clock.
+struct MutationRecord {
+    std::uint64_t sequence = 0;
+    std::chrono::system_clock::time_point recordedAt;
+    std::string tenant;
+    std::string changes;
+};
+
+// Every restaurant's state at one position in the log, for a replica that cannot resume from
+// the log itself.
+struct StateSnapshot {
+    std::uint64_t sequence = 0;
+    // Restaurant id and Restaurant::exportState.
+    std::vector<std::pair<std::string, std::string>> restaurants;
+};
+
+// In-memory log of mutations in the order the primary applied them. Only the latest `capacity`
+// records are held; a replica further behind than that starts over from a snapshot.
+//
+// One log, under one mutex, serves every restaurant: replicas follow a single sequence, and a
+// snapshot is one position in it. The lock only covers a deque push (and pop), the record's
+// strings having been built by the caller beforehand.
+class MutationLog {
+public:
+    static constexpr size_t kDefaultCapacity = 65536;
+
+    explicit MutationLog(size_t capacity = kDefaultCapacity);
+
+    std::uint64_t append(std::string tenant, std::string changes);
+    // Numbers the next record sequence + 1, for a log carried on from another process that did
+    // not pass its records along. Call before the first append.
+    void startAfter(std::uint64_t sequence);
+    // True when every record after `sequence` is still held.
+    bool canResumeAfter(std::uint64_t sequence) const;
+    std::uint64_t lastSequence() const;
+    // Records no longer held report the time of the oldest one that is.
+    std::optional<std::chrono::system_clock::time_point> recordedAt(std::uint64_t sequence) const;
+    // Returns up to maxCount records after `sequence`, waiting up to `wait` for new ones.
+    std::vector<MutationRecord> readAfter(std::uint64_t sequence,
+                                          size_t maxCount,
+                                          std::chrono::milliseconds wait) const;
+
+private:
+    mutable std::mutex mutex_;
+    mutable std::condition_variable appended_;
+    size_t capacity_;
+    // Sequence of the record before records_.front().
+    std::uint64_t base_ = 0;
+    std::deque<MutationRecord> records_;
+};
+
+struct ReplicaStatus {
+    std::string peer;
+    std::uint64_t ackedSequence = 0;
+    std::uint64_t lagEntries = 0;
+    std::chrono::milliseconds lag{0};
+};
+
+// Primary side: owns the mutation log and streams it to connected replicas.
+class ReplicationHub {
+public:
+    using SnapshotFunction = std::function<StateSnapshot()>;
+
+    // Draws a random epoch for the log.
+    ReplicationHub();
+
+    MutationLog &getLog();
+    const MutationLog &getLog() const;
+    // Sequence numbers only mean something within one epoch: a replica that followed another
+    // primary, or an earlier run of this one, has to start over from a snapshot.
+    std::uint64_t getEpoch() const;
+    // Builds the snapshots for such replicas; set before the first one connects.
+    void setSnapshotSource(SnapshotFunction source);
+    // Carries on the log of the server this one took over from: the same epoch, numbering on
+    // after `sequence`, so its replicas resume here without a snapshot.
+    void continueFrom(std::uint64_t epoch, std::uint64_t sequence);
+
+    // Runs a replication session on an already-accepted socket until the replica disconnects.
+    // The replica resumes after `fromSequence` if `epoch` is this log's, else from a snapshot.
+    void serveReplica(SocketHandle socket, const std::string &peer, std::uint64_t fromSequence, std::uint64_t epoch);
+    std::vector<ReplicaStatus> getReplicaStatuses() const;
+    // From now on each session ends once its replica has acknowledged the whole log.
+    void drain();
+    // Writes the epoch and `snapshot` to `socket` for a successor process; see receiveState.
+    bool sendState(SocketHandle socket, const StateSnapshot &snapshot) const;
+
+private:
+    struct Session {
+        int id;
+        std::string peer;
+        std::uint64_t ackedSequence;
+    };
+
+    void updateSession(int id, std::uint64_t ackedSequence);
+
+    MutationLog log_;
+    std::uint64_t epoch_;
+    SnapshotFunction snapshotSource_;
+    std::atomic<bool> draining_{false};
+    mutable std::mutex sessionsMutex_;
+    std::vector<Session> sessions_;
+    int nextSessionId_ = 1;
+};
+
+// Replica side: follows a primary and hands every received record to `apply`, after handing a
+// snapshot to `install` whenever the primary cannot resume from where this replica is. When
+// `apply` throws, the local state no longer matches the primary's; the replica reconnects and
+// starts over from a snapshot. When `install` throws, the replica cannot hold the primary's
+// state at all and stops following it.
+class ReplicaClient {
+public:
+    using ApplyFunction = std::function<void(const MutationRecord &)>;
+    using InstallFunction = std::function<void(const StateSnapshot &)>;
+
+    // A non-empty `token` is sent as X-Staff-Token.
+    ReplicaClient(std::string host, int port, std::string token, ApplyFunction apply, InstallFunction install);
+    ReplicaClient(const ReplicaClient &) = delete;
+    ReplicaClient &operator=(const ReplicaClient &) = delete;
+    ~ReplicaClient();
+
+    void start();
+    void stop();
+
+    const std::string &getHost() const;
+    int getPort() const;
+    bool isConnected() const;
+    bool hasDiverged() const;
+    std::uint64_t getAppliedSequence() const;
+    std::uint64_t getPrimarySequence() const;
+    // The epoch of the log being followed; 0 before the first snapshot.
+    std::uint64_t getEpoch() const;
+    // Times a record failed to apply and the replica started over from a snapshot.
+    std::uint64_t getResyncCount() const;
+
+private:
+    void run();
+    bool follow(SocketHandle socket);
+
+    std::string host_;
+    int port_;
+    std::string token_;
+    ApplyFunction apply_;
+    InstallFunction install_;
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+    std::atomic<bool> connected_{false};
+    std::atomic<bool> diverged_{false};
+    std::atomic<std::uint64_t> appliedSequence_{0};
+    std::atomic<std::uint64_t> primarySequence_{0};
+    std::atomic<std::uint64_t> epoch_{0};
+    std::atomic<std::uint64_t> resyncs_{0};
+    std::mutex socketMutex_;
+    SocketHandle socket_ = INVALID_SOCKET_HANDLE;
+};
+
+// Path a replica requests on the primary's HTTP port to start streaming.
+constexpr const char *kReplicationStreamPath = "/api/replication/stream";
+
+// Reads what ReplicationHub::sendState wrote.
+bool receiveState(SocketHandle socket, std::uint64_t &epoch, StateSnapshot &snapshot);
+
+// Splits "host:port" (or "[v6]:port"); returns false when the port is missing or invalid.
+bool parseHostPort(const std::string &value, std::string &host, int &port);
+
+}  // namespace booking
@@ -1,33 +1,203 @@
 #include "ReservationSystem.hpp"
 
 #include <algorithm>
+#include <charconv>
 #include <ctime>
-#include <iomanip>
+#include <limits>
+#include <mutex>
+#include <ostream>
+#include <random>
+#include <shared_mutex>
 #include <sstream>
 
 namespace booking {
 
 namespace {
 constexpr int kDefaultSeatingDurationMinutes = 120;
-}  // namespace
+constexpr SheetMinutes kReportBucketMinutes = 15;
+constexpr size_t kInitialArenaBytes = 64 * 1024;
+
+// Change lines (see BookingSheet::takeChanges) are a tag and tab-separated fields. Text fields
+// escape the characters that would split a field or a line.
+void appendField(std::string &line, std::string_view value) {
+    line.push_back('\t');
+    for (char ch : value) {
+        switch (ch) {
+        case '%':
+            line += "%25";
+            break;
+        case '\t':
+            line += "%09";
+            break;
+        case '\n':
+            line += "%0A";
+            break;
+        case '\r':
+            line += "%0D";
+            break;
+        default:
+            line.push_back(ch);
+        }
+    }
+}
 
-Permission::Permission(std::string name) : name_(std::move(name)) {}
+void appendNumber(std::string &line, std::int64_t value) {
+    line.push_back('\t');
+    line += std::to_string(value);
+}
 
-const std::string &Permission::getName() const { return name_; }
+std::vector<std::string> splitFields(std::string_view line) {
+    std::vector<std::string> fields(1);
+    for (size_t i = 0; i < line.size(); ++i) {
+        unsigned escaped = 0;
+        if (line[i] == '\t') {
+            fields.emplace_back();
+        } else if (line[i] == '%' && i + 2 < line.size() &&
+                   std::from_chars(line.data() + i + 1, line.data() + i + 3, escaped, 16).ptr == line.data() + i + 3) {
+            fields.back().push_back(static_cast<char>(escaped));
+            i += 2;
+        } else {
+            fields.back().push_back(line[i]);
+        }
+    }
+    return fields;
+}
 
-Role::Role(std::string name, std::vector<Permission> permissions)
-    : name_(std::move(name)), permissions_(std::move(permissions)) {}
+template <typename Number>
+bool parseField(const std::string &text, Number &value) {
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return error == std::errc() && end == text.data() + text.size();
+}
 
-const std::string &Role::getName() const { return name_; }
+void appendCustomerLine(std::string &changes, CustomerId id, const Customer &customer) {
+    changes += 'C';
+    appendNumber(changes, id);
+    appendField(changes, customer.getName());
+    appendField(changes, customer.getPhone());
+    appendField(changes, customer.getEmail());
+    appendField(changes, customer.getPreference());
+    changes += '\n';
+}
 
-const std::vector<Permission> &Role::getPermissions() const { return permissions_; }
+void appendWaitlistLine(std::string &changes, const WaitlistEntry &entry) {
+    changes += 'Q';
+    appendField(changes, entry.id.toString());
+    appendNumber(changes, entry.customerId);
+    appendNumber(changes, entry.partySize);
+    appendNumber(changes, entry.joinedAt);
+    appendField(changes, entry.notes);
+    changes += '\n';
+}
 
-bool Role::hasPermission(const std::string &permission) const {
-    return std::any_of(permissions_.begin(), permissions_.end(), [&](const Permission &p) {
-        return p.getName() == permission;
-    });
+void appendReservationLine(std::string &changes, const Reservation &reservation) {
+    changes += 'R';
+    appendField(changes, reservation.getId().toString());
+    appendNumber(changes, reservation.getCustomerId());
+    appendNumber(changes, reservation.getPartySize());
+    appendNumber(changes, reservation.getStartMinutes());
+    appendNumber(changes, reservation.getDuration().count());
+    appendNumber(changes, toSheetMinutes(reservation.getLastModified()));
+    appendNumber(changes, reservation.getVersion());
+    appendNumber(changes, static_cast<int>(reservation.getStatus()));
+    std::string tables;
+    for (int tableId : reservation.getTableIds()) {
+        tables += (tables.empty() ? "" : ",") + std::to_string(tableId);
+    }
+    appendField(changes, tables);
+    appendField(changes, reservation.getNotes());
+    changes += '\n';
+}
+
+void appendOrderLine(std::string &changes, const Order &order) {
+    changes += 'O';
+    appendField(changes, order.getId().toString());
+    appendField(changes, order.getReservationId().toString());
+    changes += '\n';
+}
+
+void appendItemLine(std::string &changes, RecordId orderId, const OrderItem &item) {
+    changes += 'I';
+    appendField(changes, orderId.toString());
+    appendNumber(changes, item.getMenuItemId());
+    appendNumber(changes, item.getPriceAtOrderTime().getCents());
+    appendNumber(changes, item.getQuantity());
+    appendNumber(changes, toSheetMinutes(item.getOrderedAt()));
+    changes += '\n';
+}
+
+bool parseTableIds(const std::string &text, std::vector<int> &tableIds) {
+    size_t begin = 0;
+    while (begin < text.size()) {
+        auto end = std::min(text.find(',', begin), text.size());
+        int tableId = 0;
+        if (!parseField(text.substr(begin, end - begin), tableId)) {
+            return false;
+        }
+        tableIds.push_back(tableId);
+        begin = end + 1;
+    }
+    return true;
+}
+}  // namespace
+
+size_t RecordId::format(char *buffer) const {
+    buffer[0] = getPrefix();
+    // Reservation and walk-in numbers are zero-padded to four digits; order and waitlist numbers are not.
+    const size_t minDigits = getPrefix() == 'R' || getPrefix() == 'W' ? 4 : 1;
+    char digits[8];
+    auto result = std::to_chars(digits, digits + sizeof(digits), getNumber());
+    auto count = static_cast<size_t>(result.ptr - digits);
+    size_t length = 1;
+    for (size_t i = count; i < minDigits; ++i) {
+        buffer[length++] = '0';
+    }
+    std::copy(digits, result.ptr, buffer + length);
+    return length + count;
+}
+
+std::string RecordId::toString() const {
+    char buffer[kMaxTextLength];
+    return std::string(buffer, format(buffer));
+}
+
+std::optional<RecordId> RecordId::parse(std::string_view text) {
+    if (text.size() < 2 || text.size() > kMaxTextLength) {
+        return std::nullopt;
+    }
+    char prefix = text.front();
+    if (prefix < 'A' || prefix > 'Z') {
+        return std::nullopt;
+    }
+    std::uint32_t number = 0;
+    const char *begin = text.data() + 1;
+    const char *end = text.data() + text.size();
+    auto result = std::from_chars(begin, end, number);
+    if (result.ec != std::errc{} || result.ptr != end || number > kNumberMask || number == 0) {
+        return std::nullopt;
+    }
+    return RecordId(prefix, number);
+}
+
+std::ostream &operator<<(std::ostream &os, RecordId id) {
+    char buffer[RecordId::kMaxTextLength];
+    return os.write(buffer, static_cast<std::streamsize>(id.format(buffer)));
+}
+
+std::optional<Permission> parsePermission(std::string_view name) {
+    for (size_t i = 0; i < kPermissionCount; ++i) {
+        if (kPermissionNames[i] == name) {
+            return static_cast<Permission>(i);
+        }
+    }
+    return std::nullopt;
 }
 
+Role::Role(std::string name, PermissionSet permissions) : name_(std::move(name)), permissions_(permissions) {}
+
+const std::string &Role::getName() const { return name_; }
+
+PermissionSet Role::getPermissions() const { return permissions_; }
+
 Staff::Staff(std::string name, std::string contact, Role role)
     : name_(std::move(name)), contact_(std::move(contact)), role_(std::move(role)) {}
 
@@ -38,69 +208,195 @@ const std::string &Staff::getContact() const { return contact_; }
 const Role &Staff::getRole() const { return role_; }
 
 FrontDeskStaff::FrontDeskStaff(std::string name, std::string contact)
-    : Staff(std::move(name), std::move(contact), Role{"Front Desk", {Permission{"CreateReservation"}, Permission{"UpdateReservation"}}}) {}
+    : Staff(std::move(name),
+            std::move(contact),
+            Role{"Front Desk",
+                 {Permission::CreateReservation,
+                  Permission::UpdateReservation,
+                  Permission::RecordOrders,
+                  Permission::ViewCustomers}}) {}
 
 Manager::Manager(std::string name, std::string contact)
-    : Staff(std::move(name), std::move(contact),
-            Role{"Manager", {Permission{"CreateReservation"},
-                              Permission{"UpdateReservation"},
-                              Permission{"ManageStaff"},
-                              Permission{"ViewReports"}}}) {}
-
-MenuItem::MenuItem(std::string name, std::string category, double price)
+    : Staff(std::move(name),
+            std::move(contact),
+            Role{"Manager",
+                 {Permission::CreateReservation,
+                  Permission::UpdateReservation,
+                  Permission::RecordOrders,
+                  Permission::ManageStaff,
+                  Permission::ViewReports,
+                  Permission::ViewCustomers,
+                  Permission::StreamReplication,
+                  Permission::CloseDay}}) {}
+
+MenuItem::MenuItem(std::string name, std::string category, Money price)
     : name_(std::move(name)), category_(std::move(category)), price_(price) {}
 
+MenuItemId MenuItem::getId() const { return id_; }
+
 const std::string &MenuItem::getName() const { return name_; }
 
 const std::string &MenuItem::getCategory() const { return category_; }
 
-double MenuItem::getPrice() const { return price_; }
+Money MenuItem::getPrice() const { return price_; }
+
+OrderItem::OrderItem(MenuItemId menuItemId, Money priceAtOrderTime, int quantity, SheetMinutes orderedAt)
+    : menuItemId_(menuItemId), quantity_(quantity), orderedAt_(orderedAt), priceAtOrderTime_(priceAtOrderTime) {}
 
-OrderItem::OrderItem(MenuItem item, int quantity) : item_(std::move(item)), quantity_(quantity) {}
+MenuItemId OrderItem::getMenuItemId() const { return menuItemId_; }
 
-const MenuItem &OrderItem::getItem() const { return item_; }
+Money OrderItem::getPriceAtOrderTime() const { return priceAtOrderTime_; }
 
 int OrderItem::getQuantity() const { return quantity_; }
 
-double OrderItem::getLineTotal() const { return item_.getPrice() * static_cast<double>(quantity_); }
+Money OrderItem::getLineTotal() const { return priceAtOrderTime_ * quantity_; }
 
-Order::Order(std::string id, std::string reservationId)
-    : id_(std::move(id)), reservationId_(std::move(reservationId)) {}
+std::chrono::system_clock::time_point OrderItem::getOrderedAt() const { return fromSheetMinutes(orderedAt_); }
 
-const std::string &Order::getId() const { return id_; }
+Order::Order(RecordId id, RecordId reservationId, const allocator_type &allocator)
+    : id_(id), reservationId_(reservationId), items_(allocator) {}
 
-const std::string &Order::getReservationId() const { return reservationId_; }
+Order::Order(const Order &other, const allocator_type &allocator)
+    : id_(other.id_), reservationId_(other.reservationId_), items_(other.items_, allocator), total_(other.total_) {}
 
-void Order::addItem(const MenuItem &item, int quantity) {
-    if (quantity <= 0) {
-        return;
+Order::Order(Order &&other, const allocator_type &allocator)
+    : id_(other.id_),
+      reservationId_(other.reservationId_),
+      items_(std::move(other.items_), allocator),
+      total_(other.total_) {}
+
+RecordId Order::getId() const { return id_; }
+
+RecordId Order::getReservationId() const { return reservationId_; }
+
+void Order::addItem(const OrderItem &item) {
+    items_.push_back(item);
+    total_ += item.getLineTotal();
+}
+
+const std::pmr::vector<OrderItem> &Order::getItems() const { return items_; }
+
+Money Order::getTotal() const { return total_; }
+
+Customer::Customer(std::string_view name,
+                   std::string_view phone,
+                   std::string_view email,
+                   std::string_view preference,
+                   const allocator_type &allocator)
+    : name_(name, allocator), phone_(phone, allocator), email_(email, allocator), preference_(preference, allocator) {}
+
+Customer::Customer(const Customer &other, const allocator_type &allocator)
+    : name_(other.name_, allocator),
+      phone_(other.phone_, allocator),
+      email_(other.email_, allocator),
+      preference_(other.preference_, allocator) {}
+
+Customer::Customer(Customer &&other, const allocator_type &allocator)
+    : name_(std::move(other.name_), allocator),
+      phone_(std::move(other.phone_), allocator),
+      email_(std::move(other.email_), allocator),
+      preference_(std::move(other.preference_), allocator) {}
+
+std::string_view Customer::getName() const { return name_; }
+
+std::string_view Customer::getPhone() const { return phone_; }
+
+std::string_view Customer::getEmail() const { return email_; }
+
+std::string_view Customer::getPreference() const { return preference_; }
+
+CustomerDirectory::CustomerDirectory(const allocator_type &allocator)
+    : customers_(allocator), phoneKeys_(allocator), reservationIds_(allocator), byPhone_(allocator) {}
+
+CustomerId CustomerDirectory::upsert(const Customer &customer) {
+    auto key = normalizePhone(customer.getPhone());
+    auto it = key.empty() ? byPhone_.end() : byPhone_.find(key);
+    if (it != byPhone_.end()) {
+        auto &existing = customers_[it->second];
+        // Someone else booking on a known number (a colleague, a family member) must not rename
+        // or re-profile the guest on file.
+        if (existing.getName() == customer.getName()) {
+            existing = Customer{existing.getName(),
+                                customer.getPhone(),
+                                customer.getEmail().empty() ? existing.getEmail() : customer.getEmail(),
+                                customer.getPreference().empty() ? existing.getPreference() : customer.getPreference(),
+                                customers_.get_allocator()};
+        }
+        return it->second;
+    }
+    return append(customer, key);
+}
+
+bool CustomerDirectory::restore(CustomerId id, const Customer &customer) {
+    if (id > customers_.size()) {
+        return false;
+    }
+    auto key = normalizePhone(customer.getPhone());
+    if (id == customers_.size()) {
+        if (!key.empty() && byPhone_.count(key) > 0) {
+            return false;
+        }
+        append(customer, key);
+        return true;
+    }
+    // upsert never moves a customer to another number, so neither may restore.
+    if (std::string_view(phoneKeys_[id]) != key) {
+        return false;
+    }
+    customers_[id] = customer;
+    return true;
+}
+
+CustomerId CustomerDirectory::append(const Customer &customer, const std::string &key) {
+    auto id = static_cast<CustomerId>(customers_.size());
+    customers_.push_back(customer);
+    phoneKeys_.emplace_back(key);
+    reservationIds_.emplace_back();
+    if (!key.empty()) {
+        byPhone_.emplace(phoneKeys_.back(), id);
     }
-    items_.emplace_back(item, quantity);
+    return id;
 }
 
-const std::vector<OrderItem> &Order::getItems() const { return items_; }
+const Customer &CustomerDirectory::get(CustomerId id) const { return customers_.at(id); }
 
-double Order::calculateTotal() const {
-    double total = 0.0;
-    for (const auto &item : items_) {
-        total += item.getLineTotal();
+std::optional<CustomerId> CustomerDirectory::findByPhone(std::string_view phone) const {
+    auto key = normalizePhone(phone);
+    auto it = key.empty() ? byPhone_.end() : byPhone_.find(key);
+    if (it == byPhone_.end()) {
+        return std::nullopt;
     }
-    return total;
+    return it->second;
 }
 
-Customer::Customer(std::string name, std::string phone, std::string email, std::string preference)
-    : name_(std::move(name)),
-      phone_(std::move(phone)),
-      email_(std::move(email)),
-      preference_(std::move(preference)) {}
+size_t CustomerDirectory::size() const { return customers_.size(); }
 
-const std::string &Customer::getName() const { return name_; }
+void CustomerDirectory::addReservation(CustomerId id, RecordId reservationId) {
+    auto &ids = reservationIds_.at(id);
+    if (std::find(ids.begin(), ids.end(), reservationId) == ids.end()) {
+        ids.push_back(reservationId);
+    }
+}
 
-const std::string &Customer::getPhone() const { return phone_; }
+void CustomerDirectory::removeReservation(CustomerId id, RecordId reservationId) {
+    auto &ids = reservationIds_.at(id);
+    ids.erase(std::remove(ids.begin(), ids.end(), reservationId), ids.end());
+}
 
-const std::string &Customer::getEmail() const { return email_; }
+const std::pmr::vector<RecordId> &CustomerDirectory::getReservationIds(CustomerId id) const {
+    return reservationIds_.at(id);
+}
 
-const std::string &Customer::getPreference() const { return preference_; }
+std::string CustomerDirectory::normalizePhone(std::string_view phone) {
+    std::string digits;
+    digits.reserve(phone.size());
+    for (char ch : phone) {
+        if (ch >= '0' && ch <= '9') {
+            digits.push_back(ch);
+        }
+    }
+    return digits;
+}
 
 Table::Table(int id, int capacity, std::string location)
     : id_(id), capacity_(capacity), location_(std::move(location)) {}
@@ -115,115 +411,199 @@ const std::string &Table::getLocation() const { return location_; }
 
 void Table::setStatus(TableStatus status) { status_ = status; }
 
-Reservation::Reservation(std::string id,
-                         Customer customer,
+Reservation::Reservation(RecordId id,
+                         CustomerId customerId,
                          int partySize,
                          std::chrono::system_clock::time_point time,
                          std::chrono::minutes duration,
-                         std::string notes)
-    : id_(std::move(id)),
-      customer_(std::move(customer)),
+                         std::string_view notes,
+                         const allocator_type &allocator)
+    : id_(id),
+      customerId_(customerId),
       partySize_(partySize),
-      time_(time),
-      duration_(duration),
-      notes_(std::move(notes)),
-      lastModified_(std::chrono::system_clock::now()) {}
-
-const std::string &Reservation::getId() const { return id_; }
-
-const Customer &Reservation::getCustomer() const { return customer_; }
+      start_(toSheetMinutes(time)),
+      durationMinutes_(static_cast<SheetMinutes>(duration.count())),
+      lastModified_(toSheetMinutes(std::chrono::system_clock::now())),
+      tableIds_(allocator),
+      notes_(notes, allocator) {}
+
+Reservation::Reservation(const Reservation &other, const allocator_type &allocator)
+    : id_(other.id_),
+      customerId_(other.customerId_),
+      partySize_(other.partySize_),
+      start_(other.start_),
+      durationMinutes_(other.durationMinutes_),
+      lastModified_(other.lastModified_),
+      status_(other.status_),
+      version_(other.version_),
+      tableIds_(other.tableIds_, allocator),
+      notes_(other.notes_, allocator) {}
+
+Reservation::Reservation(Reservation &&other, const allocator_type &allocator)
+    : id_(other.id_),
+      customerId_(other.customerId_),
+      partySize_(other.partySize_),
+      start_(other.start_),
+      durationMinutes_(other.durationMinutes_),
+      lastModified_(other.lastModified_),
+      status_(other.status_),
+      version_(other.version_),
+      tableIds_(std::move(other.tableIds_), allocator),
+      notes_(std::move(other.notes_), allocator) {}
+
+RecordId Reservation::getId() const { return id_; }
+
+CustomerId Reservation::getCustomerId() const { return customerId_; }
 
 int Reservation::getPartySize() const { return partySize_; }
 
 ReservationStatus Reservation::getStatus() const { return status_; }
 
-std::chrono::system_clock::time_point Reservation::getDateTime() const { return time_; }
+std::chrono::system_clock::time_point Reservation::getDateTime() const { return fromSheetMinutes(start_); }
 
-std::chrono::minutes Reservation::getDuration() const { return duration_; }
+std::chrono::minutes Reservation::getDuration() const { return std::chrono::minutes(durationMinutes_); }
 
-const std::string &Reservation::getNotes() const { return notes_; }
+std::string_view Reservation::getNotes() const { return notes_; }
 
-std::optional<int> Reservation::getTableId() const { return tableId_; }
+std::optional<int> Reservation::getTableId() const {
+    if (tableIds_.empty()) {
+        return std::nullopt;
+    }
+    return tableIds_.front();
+}
 
-std::chrono::system_clock::time_point Reservation::getLastModified() const { return lastModified_; }
+const Reservation::TableIdList &Reservation::getTableIds() const { return tableIds_; }
 
-void Reservation::assignTable(int tableId) {
-    tableId_ = tableId;
-    lastModified_ = std::chrono::system_clock::now();
+bool Reservation::usesTable(int tableId) const {
+    return std::find(tableIds_.begin(), tableIds_.end(), tableId) != tableIds_.end();
 }
 
-void Reservation::clearTable() {
-    tableId_.reset();
-    lastModified_ = std::chrono::system_clock::now();
-}
+std::chrono::system_clock::time_point Reservation::getLastModified() const { return fromSheetMinutes(lastModified_); }
 
-void Reservation::updateStatus(ReservationStatus status) {
-    status_ = status;
-    lastModified_ = std::chrono::system_clock::now();
-}
+std::uint32_t Reservation::getVersion() const { return version_; }
+
+std::chrono::system_clock::time_point Reservation::getEndTime() const { return fromSheetMinutes(getEndMinutes()); }
+
+SheetMinutes Reservation::getStartMinutes() const { return start_; }
+
+SheetMinutes Reservation::getEndMinutes() const { return start_ + durationMinutes_; }
 
-void Reservation::setCustomer(Customer customer) {
-    customer_ = std::move(customer);
-    lastModified_ = std::chrono::system_clock::now();
+ReservationEdit Reservation::edit() { return ReservationEdit(*this); }
+
+ReservationEdit::ReservationEdit(Reservation &reservation) : reservation_(reservation) {}
+
+ReservationEdit::~ReservationEdit() {
+    if (changed_) {
+        reservation_.lastModified_ = toSheetMinutes(std::chrono::system_clock::now());
+        ++reservation_.version_;
+    }
 }
 
-void Reservation::setPartySize(int partySize) {
-    partySize_ = partySize;
-    lastModified_ = std::chrono::system_clock::now();
+ReservationEdit &ReservationEdit::setCustomerId(CustomerId customerId) {
+    reservation_.customerId_ = customerId;
+    changed_ = true;
+    return *this;
 }
 
-void Reservation::setDateTime(std::chrono::system_clock::time_point time) {
-    time_ = time;
-    lastModified_ = std::chrono::system_clock::now();
+ReservationEdit &ReservationEdit::setPartySize(int partySize) {
+    reservation_.partySize_ = partySize;
+    changed_ = true;
+    return *this;
 }
 
-void Reservation::setDuration(std::chrono::minutes duration) {
-    duration_ = duration;
-    lastModified_ = std::chrono::system_clock::now();
+ReservationEdit &ReservationEdit::setDateTime(std::chrono::system_clock::time_point time) {
+    reservation_.start_ = toSheetMinutes(time);
+    changed_ = true;
+    return *this;
 }
 
-void Reservation::setNotes(const std::string &notes) {
-    notes_ = notes;
-    lastModified_ = std::chrono::system_clock::now();
+ReservationEdit &ReservationEdit::setDuration(std::chrono::minutes duration) {
+    reservation_.durationMinutes_ = static_cast<SheetMinutes>(duration.count());
+    changed_ = true;
+    return *this;
 }
 
-void Reservation::markSeated() { updateStatus(ReservationStatus::Seated); }
+ReservationEdit &ReservationEdit::setNotes(std::string_view notes) {
+    reservation_.notes_ = notes;
+    changed_ = true;
+    return *this;
+}
 
-void Reservation::markCompleted() { updateStatus(ReservationStatus::Completed); }
+ReservationEdit &ReservationEdit::setStatus(ReservationStatus status) {
+    reservation_.status_ = status;
+    changed_ = true;
+    return *this;
+}
 
-void Reservation::cancel() { updateStatus(ReservationStatus::Cancelled); }
+ReservationEdit &ReservationEdit::setTables(const std::vector<int> &tableIds) {
+    reservation_.tableIds_.assign(tableIds.begin(), tableIds.end());
+    changed_ = true;
+    return *this;
+}
 
-std::chrono::system_clock::time_point Reservation::getEndTime() const { return time_ + duration_; }
+ReservationEdit &ReservationEdit::clearTables() {
+    reservation_.tableIds_.clear();
+    changed_ = true;
+    return *this;
+}
 
 Report::Report(std::string date,
-               int totalReservations,
+               StatusCounts reservationsByStatus,
                int seatedGuests,
-               double revenue,
-               std::vector<std::tuple<std::string, ReservationStatus>> reservationBreakdown)
+               Money revenue,
+               std::vector<ReportBucket> series,
+               std::vector<std::tuple<RecordId, ReservationStatus>> reservationBreakdown,
+               size_t breakdownOffset)
     : date_(std::move(date)),
-      totalReservations_(totalReservations),
+      reservationsByStatus_(reservationsByStatus),
       seatedGuests_(seatedGuests),
       revenue_(revenue),
-      reservationBreakdown_(std::move(reservationBreakdown)) {}
+      series_(std::move(series)),
+      reservationBreakdown_(std::move(reservationBreakdown)),
+      breakdownOffset_(breakdownOffset) {}
 
 const std::string &Report::getDate() const { return date_; }
 
-int Report::getTotalReservations() const { return totalReservations_; }
+int Report::getTotalReservations() const {
+    int total = 0;
+    for (int count : reservationsByStatus_) {
+        total += count;
+    }
+    return total;
+}
+
+int Report::getReservationCount(ReservationStatus status) const {
+    return reservationsByStatus_[static_cast<size_t>(status)];
+}
 
 int Report::getSeatedGuests() const { return seatedGuests_; }
 
-double Report::getRevenue() const { return revenue_; }
+Money Report::getRevenue() const { return revenue_; }
 
-const std::vector<std::tuple<std::string, ReservationStatus>> &Report::getReservationBreakdown() const {
+const std::vector<ReportBucket> &Report::getSeries() const { return series_; }
+
+const std::vector<std::tuple<RecordId, ReservationStatus>> &Report::getReservationBreakdown() const {
     return reservationBreakdown_;
 }
 
+size_t Report::getBreakdownOffset() const { return breakdownOffset_; }
+
 std::string Report::summary() const {
     std::ostringstream oss;
     oss << "Report for " << date_ << '\n';
-    oss << "Total reservations: " << totalReservations_ << '\n';
+    oss << "Total reservations: " << getTotalReservations() << '\n';
     oss << "Guests seated: " << seatedGuests_ << '\n';
     oss << "Revenue: " << formatCurrency(revenue_) << '\n';
+    if (!series_.empty()) {
+        oss << "By 15 minutes:" << '\n';
+        for (const auto &bucket : series_) {
+            oss << "  - " << formatDateTime(bucket.start) << ": " << bucket.covers << " guests, "
+                << formatCurrency(bucket.revenue) << '\n';
+        }
+    }
+    if (reservationBreakdown_.empty()) {
+        return oss.str();
+    }
     oss << "Reservation breakdown:" << '\n';
     for (const auto &[id, status] : reservationBreakdown_) {
         oss << "  - " << id << ": ";
@@ -246,7 +626,12 @@ std::string Report::summary() const {
     return oss.str();
 }
 
-BookingSheet::BookingSheet(std::string date) : date_(std::move(date)) {}
+BookingSheet::BookingSheet(std::string date)
+    : date_(std::move(date)),
+      arena_(std::make_unique<std::pmr::monotonic_buffer_resource>(kInitialArenaBytes)),
+      reservations_(arena_.get()),
+      orders_(arena_.get()),
+      customers_(std::make_shared<CustomerDirectory>()) {}
 
 const std::string &BookingSheet::getDate() const { return date_; }
 
@@ -254,16 +639,61 @@ std::vector<Table> &BookingSheet::getTables() { return tables_; }
 
 const std::vector<Table> &BookingSheet::getTables() const { return tables_; }
 
-const std::vector<Reservation> &BookingSheet::getReservations() const { return reservations_; }
+const BookingSheet::ReservationList &BookingSheet::getReservations() const { return reservations_; }
+
+const BookingSheet::OrderList &BookingSheet::getOrders() const { return orders_; }
+
+const CustomerDirectory &BookingSheet::getCustomers() const { return *customers_; }
 
-const std::vector<Order> &BookingSheet::getOrders() const { return orders_; }
+const Customer &BookingSheet::getCustomer(const Reservation &reservation) const {
+    return customers_->get(reservation.getCustomerId());
+}
+
+void BookingSheet::addTable(const Table &table) {
+    tablePositions_.emplace(table.getId(), tables_.size());
+    tables_.push_back(table);
+    tableSchedules_.emplace_back();
+    tableNeighbours_.emplace_back();
+
+    auto classIt = std::lower_bound(capacityClasses_.begin(), capacityClasses_.end(), table.getCapacity());
+    if (classIt == capacityClasses_.end() || *classIt != table.getCapacity()) {
+        capacityClasses_.insert(classIt, table.getCapacity());
+        waitingPerClass_.assign(capacityClasses_.size() + 1, 0);
+        for (const auto &entry : waitlist_) {
+            ++waitingPerClass_[waitClassOf(entry.partySize)];
+        }
+    }
+    waitTimelinesDirty_ = true;
+}
+
+bool BookingSheet::joinTables(int firstTableId, int secondTableId) {
+    auto first = findTablePosition(firstTableId);
+    auto second = findTablePosition(secondTableId);
+    if (!first || !second || *first == *second) {
+        return false;
+    }
+    auto &firstNeighbours = tableNeighbours_[*first];
+    if (std::find(firstNeighbours.begin(), firstNeighbours.end(), *second) == firstNeighbours.end()) {
+        firstNeighbours.push_back(*second);
+        tableNeighbours_[*second].push_back(*first);
+    }
+    return true;
+}
 
-void BookingSheet::addTable(const Table &table) { tables_.push_back(table); }
+std::vector<int> BookingSheet::getAdjacentTableIds(int tableId) const {
+    std::vector<int> ids;
+    if (auto position = findTablePosition(tableId)) {
+        for (auto neighbour : tableNeighbours_[*position]) {
+            ids.push_back(tables_[neighbour].getId());
+        }
+    }
+    return ids;
+}
 
 std::optional<int> BookingSheet::findAvailableTableId(int partySize,
                                                       std::chrono::system_clock::time_point time,
                                                       std::chrono::minutes duration,
-                                                      const std::optional<std::string> &ignoreReservationId) const {
+                                                      std::optional<RecordId> ignoreReservationId) const {
     auto ids = findAllAvailableTableIds(partySize, time, duration, ignoreReservationId);
     if (ids.empty()) {
         return std::nullopt;
@@ -274,254 +704,1008 @@ std::optional<int> BookingSheet::findAvailableTableId(int partySize,
 std::vector<int> BookingSheet::findAllAvailableTableIds(int partySize,
                                                         std::chrono::system_clock::time_point time,
                                                         std::chrono::minutes duration,
-                                                        const std::optional<std::string> &ignoreReservationId) const {
-    std::vector<int> ids;
-    for (const auto &table : tables_) {
-        if (table.getStatus() == TableStatus::OutOfService) {
+                                                        std::optional<RecordId> ignoreReservationId) const {
+    auto start = toSheetMinutes(time);
+    auto end = start + static_cast<SheetMinutes>(duration.count());
+    std::vector<size_t> positions;
+    for (size_t position = 0; position < tables_.size(); ++position) {
+        const auto &table = tables_[position];
+        if (table.getStatus() == TableStatus::OutOfService || table.getCapacity() < partySize) {
             continue;
         }
-        if (table.getCapacity() < partySize) {
-            continue;
+        if (isSlotFree(position, start, end, ignoreReservationId)) {
+            positions.push_back(position);
         }
-        if (isTableAvailable(table.getId(), time, duration, ignoreReservationId)) {
-            ids.push_back(table.getId());
+    }
+    std::sort(positions.begin(), positions.end(), [&](size_t lhs, size_t rhs) {
+        const auto &lhsTable = tables_[lhs];
+        const auto &rhsTable = tables_[rhs];
+        if (lhsTable.getCapacity() == rhsTable.getCapacity()) {
+            return lhsTable.getId() < rhsTable.getId();
         }
+        return lhsTable.getCapacity() < rhsTable.getCapacity();
+    });
+    std::vector<int> ids;
+    ids.reserve(positions.size());
+    for (auto position : positions) {
+        ids.push_back(tables_[position].getId());
     }
-    std::sort(ids.begin(), ids.end(), [&](int lhs, int rhs) {
-        const auto *lhsTable = getTableById(lhs);
-        const auto *rhsTable = getTableById(rhs);
-        if (!lhsTable || !rhsTable) {
-            return lhs < rhs;
+    return ids;
+}
+
+namespace {
+// Branch and bound over connected sets of free tables. Each set is enumerated exactly once, grown
+// only from its lowest position through "exclusive" neighbours (the ESU scheme), so no memo of
+// visited sets is needed. Adding a table never removes seats, so a branch ends as soon as it seats
+// the party, and is cut when even the largest remaining tables could not reach the party size or
+// when it can no longer beat the best set found so far.
+class TableSetSearch {
+public:
+    TableSetSearch(const std::vector<Table> &tables,
+                   const std::vector<std::vector<size_t>> &neighbours,
+                   const std::vector<char> &free,
+                   int partySize)
+        : tables_(tables), neighbours_(neighbours), free_(free), partySize_(partySize) {
+        for (size_t position = 0; position < tables_.size(); ++position) {
+            if (free_[position]) {
+                largestCapacity_ = std::max(largestCapacity_, tables_[position].getCapacity());
+            }
         }
-        if (lhsTable->getCapacity() == rhsTable->getCapacity()) {
-            return lhs < rhs;
+    }
+
+    std::vector<size_t> run() {
+        for (size_t root = 0; root < tables_.size() && !isOptimal(); ++root) {
+            if (!free_[root]) {
+                continue;
+            }
+            current_.assign(1, root);
+            capacity_ = tables_[root].getCapacity();
+            std::vector<size_t> extension;
+            for (auto neighbour : neighbours_[root]) {
+                if (neighbour > root && free_[neighbour]) {
+                    extension.push_back(neighbour);
+                }
+            }
+            extend(root, std::move(extension));
         }
-        return lhsTable->getCapacity() < rhsTable->getCapacity();
-    });
+        return best_;
+    }
+
+private:
+    static constexpr size_t kMaxTables = 4;
+
+    bool isOptimal() const { return !best_.empty() && bestWaste_ == 0 && best_.size() == 1; }
+
+    bool inOrNextToCurrent(size_t position) const {
+        for (auto member : current_) {
+            if (member == position) {
+                return true;
+            }
+            const auto &adjacent = neighbours_[member];
+            if (std::find(adjacent.begin(), adjacent.end(), position) != adjacent.end()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void extend(size_t root, std::vector<size_t> extension) {
+        if (capacity_ >= partySize_) {
+            int waste = capacity_ - partySize_;
+            if (best_.empty() || waste < bestWaste_ || (waste == bestWaste_ && current_.size() < best_.size())) {
+                best_ = current_;
+                bestWaste_ = waste;
+            }
+            return;
+        }
+        auto slotsLeft = kMaxTables - current_.size();
+        if (slotsLeft == 0 || capacity_ + static_cast<int>(slotsLeft) * largestCapacity_ < partySize_) {
+            return;
+        }
+        // Any completion has at least one more table and zero or more wasted seats.
+        if (!best_.empty() && bestWaste_ == 0 && best_.size() <= current_.size() + 1) {
+            return;
+        }
+        while (!extension.empty()) {
+            auto next = extension.back();
+            extension.pop_back();
+            auto nextExtension = extension;
+            for (auto neighbour : neighbours_[next]) {
+                if (neighbour > root && free_[neighbour] && !inOrNextToCurrent(neighbour) &&
+                    std::find(nextExtension.begin(), nextExtension.end(), neighbour) == nextExtension.end()) {
+                    nextExtension.push_back(neighbour);
+                }
+            }
+            current_.push_back(next);
+            capacity_ += tables_[next].getCapacity();
+            extend(root, std::move(nextExtension));
+            capacity_ -= tables_[next].getCapacity();
+            current_.pop_back();
+        }
+    }
+
+    const std::vector<Table> &tables_;
+    const std::vector<std::vector<size_t>> &neighbours_;
+    const std::vector<char> &free_;
+    int partySize_;
+    int largestCapacity_ = 0;
+    std::vector<size_t> current_;
+    int capacity_ = 0;
+    std::vector<size_t> best_;
+    int bestWaste_ = 0;
+};
+}  // namespace
+
+std::vector<size_t> findTableSetPositions(const std::vector<Table> &tables,
+                                          const std::vector<std::vector<size_t>> &neighbours,
+                                          const std::vector<char> &free,
+                                          int partySize) {
+    return TableSetSearch(tables, neighbours, free, partySize).run();
+}
+
+std::vector<int> BookingSheet::findAvailableTableSet(int partySize,
+                                                     std::chrono::system_clock::time_point time,
+                                                     std::chrono::minutes duration,
+                                                     std::optional<RecordId> ignoreReservationId) const {
+    auto start = toSheetMinutes(time);
+    auto end = start + static_cast<SheetMinutes>(duration.count());
+    std::vector<char> free(tables_.size(), 0);
+    for (size_t position = 0; position < tables_.size(); ++position) {
+        free[position] = tables_[position].getStatus() != TableStatus::OutOfService &&
+                         isSlotFree(position, start, end, ignoreReservationId);
+    }
+    std::vector<int> ids;
+    for (auto position : findTableSetPositions(tables_, tableNeighbours_, free, partySize)) {
+        ids.push_back(tables_[position].getId());
+    }
+    std::sort(ids.begin(), ids.end());
     return ids;
 }
 
-Reservation &BookingSheet::createReservationRecord(std::string id,
-                                                  const Customer &customer,
+std::vector<AvailableSlot> BookingSheet::findAvailableSlots(int partySize,
+                                                           std::chrono::system_clock::time_point from,
+                                                           std::chrono::system_clock::time_point to,
+                                                           std::chrono::minutes duration,
+                                                           size_t limit,
+                                                           std::chrono::minutes step) const {
+    std::vector<AvailableSlot> slots;
+    auto first = toSheetMinutes(from);
+    auto last = toSheetMinutes(to);
+    if (limit == 0 || duration.count() <= 0 || duration.count() > kMaxSeatingDurationMinutes ||
+        step.count() <= 0 || step.count() > kMaxSeatingDurationMinutes) {
+        return slots;
+    }
+    auto length = static_cast<SheetMinutes>(duration.count());
+    auto stride = static_cast<SheetMinutes>(step.count());
+    // Leaves headroom for last + length and the grid rounding below.
+    last = std::min(last, std::numeric_limits<SheetMinutes>::max() - 2 * kMaxSeatingDurationMinutes);
+    if (last < first) {
+        return slots;
+    }
+
+    // A table can take a seating starting at t when some gap [free, busy) in its schedule holds
+    // [t, t + length), i.e. t is in [free, busy - length]. Each such start range, clipped to
+    // [first, last], becomes an opening and a closing event.
+    struct Event {
+        SheetMinutes time;
+        int delta;
+        size_t position;
+    };
+    std::vector<Event> events;
+    auto addRange = [&](size_t position, SheetMinutes free, SheetMinutes busy) {
+        auto begin = std::max(free, first);
+        auto end = std::min(busy - length, last) + 1;
+        if (begin < end) {
+            events.push_back(Event{begin, 1, position});
+            events.push_back(Event{end, -1, position});
+        }
+    };
+    for (size_t position = 0; position < tables_.size(); ++position) {
+        if (tables_[position].getStatus() == TableStatus::OutOfService) {
+            continue;
+        }
+        const auto &schedule = tableSchedules_[position];
+        // Ends are sorted like starts, so skip straight to the first booking still running at `first`.
+        auto it = std::upper_bound(schedule.begin(), schedule.end(), first, [](SheetMinutes value, const TableBooking &booking) {
+            return value < booking.end;
+        });
+        auto free = it == schedule.begin() ? std::numeric_limits<SheetMinutes>::min() : std::prev(it)->end;
+        for (; it != schedule.end() && it->start < last + length; ++it) {
+            addRange(position, free, it->start);
+            free = it->end;
+        }
+        addRange(position, free, std::numeric_limits<SheetMinutes>::max() - length);
+    }
+    std::sort(events.begin(), events.end(), [](const Event &lhs, const Event &rhs) {
+        return lhs.time < rhs.time;
+    });
+
+    // Between two event times the set of usable tables is fixed, so one search covers the whole
+    // segment and its grid points.
+    std::vector<char> free(tables_.size(), 0);
+    for (size_t i = 0; i < events.size() && slots.size() < limit;) {
+        auto segmentStart = events[i].time;
+        for (; i < events.size() && events[i].time == segmentStart; ++i) {
+            free[events[i].position] = events[i].delta > 0;
+        }
+        auto segmentEnd = i < events.size() ? events[i].time : last + 1;
+        auto positions = findTableSetPositions(tables_, tableNeighbours_, free, partySize);
+        if (positions.empty()) {
+            continue;
+        }
+        std::vector<int> ids;
+        for (auto position : positions) {
+            ids.push_back(tables_[position].getId());
+        }
+        std::sort(ids.begin(), ids.end());
+        auto onGrid = [&](SheetMinutes minutes) {
+            auto remainder = ((minutes % stride) + stride) % stride;
+            return remainder == 0 ? minutes : minutes + stride - remainder;
+        };
+        auto time = onGrid(segmentStart) < segmentEnd ? onGrid(segmentStart) : segmentStart;
+        for (; time < segmentEnd && slots.size() < limit; time = onGrid(time + 1)) {
+            slots.push_back(AvailableSlot{fromSheetMinutes(time), ids});
+        }
+    }
+    return slots;
+}
+
+Reservation &BookingSheet::createReservationRecord(RecordId id,
+                                                  CustomerId customerId,
                                                   int partySize,
                                                   std::chrono::system_clock::time_point time,
                                                   std::chrono::minutes duration,
-                                                  const std::string &notes) {
-    reservations_.emplace_back(std::move(id), customer, partySize, time, duration, notes);
+                                                  const std::string &notes,
+                                                  const std::vector<int> &tableIds) {
+    noteReservation(id);
+    reservations_.emplace_back(id, customerId, partySize, time, duration, notes);
+    reservationIndex_.emplace(id, reservations_.size() - 1);
     Reservation &reservation = reservations_.back();
-    auto tableId = findAvailableTableId(partySize, time, duration, reservation.getId());
-    if (tableId) {
-        reservation.assignTable(*tableId);
+    customers_->addReservation(customerId, reservation.getId());
+    if (!tableIds.empty()) {
+        setTables(reservation, tableIds);
     }
+    tallyReservation(reservation, 1);
     return reservation;
 }
 
-std::string BookingSheet::formatNumberedId(char prefix, int number) const {
-    std::ostringstream oss;
-    oss << prefix << std::setw(4) << std::setfill('0') << number;
-    return oss.str();
-}
-
 Reservation &BookingSheet::createReservation(const Customer &customer,
                                              int partySize,
                                              std::chrono::system_clock::time_point time,
                                              std::chrono::minutes duration,
                                              const std::string &notes) {
-    auto id = formatNumberedId('R', nextReservationNumber_++);
-    return createReservationRecord(std::move(id), customer, partySize, time, duration, notes);
+    auto customerId = customers_->upsert(customer);
+    noteCustomer(customerId);
+    auto tableIds = findAvailableTableSet(partySize, time, duration);
+    return createReservationRecord(RecordId('R', nextReservationNumber_++),
+                                   customerId,
+                                   partySize,
+                                   time,
+                                   duration,
+                                   notes,
+                                   tableIds);
 }
 
-Reservation &BookingSheet::recordWalkIn(const Customer &customer, int partySize, const std::string &notes) {
-    auto now = std::chrono::system_clock::now();
-    auto id = formatNumberedId('W', nextWalkInNumber_++);
-    auto &reservation = createReservationRecord(id, customer, partySize, now,
-                                                std::chrono::minutes(kDefaultSeatingDurationMinutes), notes);
-    reservation.markSeated();
+Reservation &BookingSheet::seatWalkIn(CustomerId customerId,
+                                      int partySize,
+                                      const std::string &notes,
+                                      std::chrono::system_clock::time_point now,
+                                      const std::vector<int> &tableIds) {
+    auto &reservation = createReservationRecord(RecordId('W', nextWalkInNumber_++),
+                                                customerId,
+                                                partySize,
+                                                now,
+                                                std::chrono::minutes(kDefaultSeatingDurationMinutes),
+                                                notes,
+                                                tableIds);
+    tallyReservation(reservation, -1);
+    reservation.edit().setStatus(ReservationStatus::Seated);
+    tallyReservation(reservation, 1);
     return reservation;
 }
 
-bool BookingSheet::autoAssignTable(const std::string &id) {
-    auto reservation = findReservationById(id);
-    if (!reservation) {
-        return false;
+WalkInOutcome BookingSheet::admitWalkIn(const Customer &customer, int partySize, const std::string &notes) {
+    WalkInOutcome outcome;
+    if (!canEverSeat(partySize)) {
+        outcome.turnedAway = true;
+        return outcome;
     }
-    auto tableId = findAvailableTableId(reservation->getPartySize(),
-                                        reservation->getDateTime(),
-                                        reservation->getDuration(),
-                                        reservation->getId());
-    if (!tableId) {
-        return false;
+    // Give parties already waiting the first go at anything that has freed up.
+    seatWaitingParties();
+    auto customerId = customers_->upsert(customer);
+    noteCustomer(customerId);
+    auto now = std::chrono::system_clock::now();
+    auto tableIds = findAvailableTableSet(partySize, now, std::chrono::minutes(kDefaultSeatingDurationMinutes));
+    if (!tableIds.empty()) {
+        outcome.reservation = &seatWalkIn(customerId, partySize, notes, now, tableIds);
+        return outcome;
     }
-    reservation->assignTable(*tableId);
-    return true;
+    RecordId id('Q', nextWaitlistNumber_++);
+    waitlist_.push_back(WaitlistEntry{id, customerId, partySize, toSheetMinutes(now), notes});
+    ++waitingPerClass_[waitClassOf(partySize)];
+    if (capture_) {
+        appendWaitlistLine(capture_->waitlist, waitlist_.back());
+    }
+    outcome.waitlistId = id;
+    return outcome;
 }
 
-bool BookingSheet::assignTable(const std::string &id, int tableId) {
-    auto reservation = findReservationById(id);
-    if (!reservation) {
-        return false;
-    }
-    const auto *table = getTableById(tableId);
-    if (!table || table->getCapacity() < reservation->getPartySize()) {
+const std::deque<WaitlistEntry> &BookingSheet::getWaitlist() const { return waitlist_; }
+
+bool BookingSheet::leaveWaitlist(RecordId id) {
+    auto it = std::find_if(waitlist_.begin(), waitlist_.end(), [&](const WaitlistEntry &entry) { return entry.id == id; });
+    if (it == waitlist_.end()) {
         return false;
     }
-    if (!isTableAvailable(tableId,
-                          reservation->getDateTime(),
-                          reservation->getDuration(),
-                          reservation->getId())) {
-        return false;
+    --waitingPerClass_[waitClassOf(it->partySize)];
+    if (capture_) {
+        capture_->waitlist += "q\t" + id.toString() + '\n';
     }
-    reservation->assignTable(tableId);
+    waitlist_.erase(it);
     return true;
 }
 
-bool BookingSheet::clearTableAssignment(const std::string &id) {
-    auto reservation = findReservationById(id);
-    if (!reservation) {
-        return false;
+void BookingSheet::seatWaitingParties() {
+    if (waitlist_.empty()) {
+        return;
     }
-    reservation->clearTable();
-    return true;
-}
-
-Order &BookingSheet::recordOrder(const std::string &reservationId) {
-    std::string id = "O" + std::to_string(nextOrderNumber_++);
-    orders_.emplace_back(id, reservationId);
-    return orders_.back();
-}
-
-Reservation *BookingSheet::findReservationById(const std::string &id) {
-    auto it = std::find_if(reservations_.begin(), reservations_.end(), [&](const Reservation &reservation) {
-        return reservation.getId() == id;
-    });
-    if (it == reservations_.end()) {
-        return nullptr;
+    auto now = std::chrono::system_clock::now();
+    auto duration = std::chrono::minutes(kDefaultSeatingDurationMinutes);
+    // If no table set seats a party of n, none seats a larger one, so later parties that size or
+    // bigger are skipped without searching.
+    int smallestUnseatable = std::numeric_limits<int>::max();
+    for (auto it = waitlist_.begin(); it != waitlist_.end();) {
+        if (it->partySize >= smallestUnseatable) {
+            ++it;
+            continue;
+        }
+        auto tableIds = findAvailableTableSet(it->partySize, now, duration);
+        if (tableIds.empty()) {
+            smallestUnseatable = it->partySize;
+            ++it;
+            continue;
+        }
+        seatWalkIn(it->customerId, it->partySize, it->notes, now, tableIds);
+        --waitingPerClass_[waitClassOf(it->partySize)];
+        if (capture_) {
+            capture_->waitlist += "q\t" + it->id.toString() + '\n';
+        }
+        it = waitlist_.erase(it);
     }
-    return &(*it);
 }
 
-const Reservation *BookingSheet::findReservationById(const std::string &id) const {
-    auto it = std::find_if(reservations_.begin(), reservations_.end(), [&](const Reservation &reservation) {
-        return reservation.getId() == id;
-    });
-    if (it == reservations_.end()) {
-        return nullptr;
-    }
-    return &(*it);
+bool BookingSheet::canEverSeat(int partySize) const {
+    // Every table free, including those out of service for now.
+    std::vector<char> free(tables_.size(), 1);
+    return !findTableSetPositions(tables_, tableNeighbours_, free, partySize).empty();
 }
 
-Order *BookingSheet::findOrderById(const std::string &id) {
-    auto it = std::find_if(orders_.begin(), orders_.end(), [&](const Order &order) { return order.getId() == id; });
-    if (it == orders_.end()) {
-        return nullptr;
-    }
-    return &(*it);
+size_t BookingSheet::waitClassOf(int partySize) const {
+    return static_cast<size_t>(std::lower_bound(capacityClasses_.begin(), capacityClasses_.end(), partySize) -
+                               capacityClasses_.begin());
 }
 
-bool BookingSheet::updateReservationDetails(const std::string &id,
-                                            const Customer &customer,
-                                            int partySize,
-                                            std::chrono::system_clock::time_point time,
-                                            std::chrono::minutes duration,
-                                            const std::string &notes,
-                                            std::optional<int> requestedTable,
-                                            bool tableSpecified) {
-    auto reservation = findReservationById(id);
-    if (!reservation) {
-        return false;
+void BookingSheet::refreshWaitTimelines() const {
+    auto now = toSheetMinutes(std::chrono::system_clock::now());
+    if (!waitTimelinesDirty_ && waitTimelinesBuiltAt_ == now) {
+        return;
     }
-
-    std::optional<int> newTable;
-    if (tableSpecified) {
-        if (requestedTable) {
-            const auto *table = getTableById(*requestedTable);
-            if (!table || table->getCapacity() < partySize ||
-                !isTableAvailable(*requestedTable, time, duration, reservation->getId())) {
-                return false;
-            }
-            newTable = requestedTable;
-        } else {
-            newTable = std::nullopt;
+    // When each table can next take a full seating: skip bookings that leave too short a gap.
+    std::vector<std::pair<int, SheetMinutes>> nextFree;
+    nextFree.reserve(tables_.size());
+    tableFreeAt_.assign(tables_.size(), std::numeric_limits<SheetMinutes>::max());
+    for (size_t position = 0; position < tables_.size(); ++position) {
+        if (tables_[position].getStatus() == TableStatus::OutOfService) {
+            continue;
         }
-    } else {
-        if (auto current = reservation->getTableId()) {
-            const auto *table = getTableById(*current);
-            if (table && table->getCapacity() >= partySize &&
-                isTableAvailable(*current, time, duration, reservation->getId())) {
-                newTable = *current;
+        SheetMinutes freeAt = now;
+        for (const auto &booking : tableSchedules_[position]) {
+            if (booking.end <= freeAt) {
+                continue;
             }
+            if (booking.start >= freeAt + kDefaultSeatingDurationMinutes) {
+                break;
+            }
+            freeAt = booking.end;
         }
-        if (!newTable) {
-            auto candidate = findAvailableTableId(partySize, time, duration, reservation->getId());
-            if (candidate) {
-                newTable = *candidate;
+        tableFreeAt_[position] = freeAt;
+        nextFree.emplace_back(tables_[position].getCapacity(), freeAt);
+    }
+    waitTimelines_.assign(capacityClasses_.size(), {});
+    for (size_t waitClass = 0; waitClass < capacityClasses_.size(); ++waitClass) {
+        auto &timeline = waitTimelines_[waitClass];
+        for (const auto &[capacity, freeAt] : nextFree) {
+            if (capacity >= capacityClasses_[waitClass]) {
+                timeline.push_back(freeAt);
             }
         }
+        std::sort(timeline.begin(), timeline.end());
     }
+    waitTimelinesBuiltAt_ = now;
+    waitTimelinesDirty_ = false;
+}
 
-    reservation->setCustomer(customer);
-    reservation->setPartySize(partySize);
-    reservation->setDateTime(time);
-    reservation->setDuration(duration);
-    reservation->setNotes(notes);
-
-    if (newTable) {
-        reservation->assignTable(*newTable);
-    } else {
-        reservation->clearTable();
+WaitEstimate BookingSheet::estimateFor(size_t waitClass, size_t partiesAhead, SheetMinutes now) const {
+    WaitEstimate estimate;
+    estimate.partiesAhead = partiesAhead;
+    if (waitClass >= waitTimelines_.size() || waitTimelines_[waitClass].empty()) {
+        return estimate;
     }
-
-    return true;
+    // The k-th party in line takes the k-th table to come free; once every table has been taken,
+    // the next round starts a full seating later.
+    const auto &timeline = waitTimelines_[waitClass];
+    auto rounds = static_cast<SheetMinutes>(partiesAhead / timeline.size());
+    auto seatAt = std::max(timeline[partiesAhead % timeline.size()], now) + rounds * kDefaultSeatingDurationMinutes;
+    estimate.wait = std::chrono::minutes(seatAt - now);
+    return estimate;
 }
 
-bool BookingSheet::cancelReservation(const std::string &id) {
+std::vector<WaitEstimate> BookingSheet::estimateJoinedWaits(const std::vector<int> &partySizes) const {
+    // Each party in turn takes the set of adjacent tables that all come free soonest, which are
+    // then busy for a full seating when the next party looks.
+    constexpr auto kNever = std::numeric_limits<SheetMinutes>::max();
+    auto freeAt = tableFreeAt_;
+    std::vector<size_t> order(tables_.size());
+    std::vector<char> free(tables_.size());
+    std::vector<WaitEstimate> estimates;
+    estimates.reserve(partySizes.size());
+    for (auto partySize : partySizes) {
+        WaitEstimate estimate;
+        estimate.partiesAhead = estimates.size();
+        for (size_t position = 0; position < order.size(); ++position) {
+            order[position] = position;
+        }
+        std::sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) { return freeAt[lhs] < freeAt[rhs]; });
+        std::fill(free.begin(), free.end(), 0);
+        for (size_t i = 0; i < order.size() && freeAt[order[i]] != kNever;) {
+            auto seatAt = freeAt[order[i]];
+            for (; i < order.size() && freeAt[order[i]] == seatAt; ++i) {
+                free[order[i]] = 1;
+            }
+            auto positions = findTableSetPositions(tables_, tableNeighbours_, free, partySize);
+            if (!positions.empty()) {
+                estimate.wait = std::chrono::minutes(seatAt - waitTimelinesBuiltAt_);
+                for (auto position : positions) {
+                    freeAt[position] = seatAt + kDefaultSeatingDurationMinutes;
+                }
+                break;
+            }
+        }
+        estimates.push_back(estimate);
+    }
+    return estimates;
+}
+
+WaitEstimate BookingSheet::estimateWait(int partySize) const {
+    refreshWaitTimelines();
+    auto waitClass = waitClassOf(partySize);
+    if (waitClass < capacityClasses_.size()) {
+        return estimateFor(waitClass, waitingPerClass_[waitClass], waitTimelinesBuiltAt_);
+    }
+    std::vector<int> joined;
+    for (const auto &entry : waitlist_) {
+        if (waitClassOf(entry.partySize) == waitClass) {
+            joined.push_back(entry.partySize);
+        }
+    }
+    joined.push_back(partySize);
+    return estimateJoinedWaits(joined).back();
+}
+
+std::vector<WaitEstimate> BookingSheet::estimateWaitlist() const {
+    refreshWaitTimelines();
+    auto joinedClass = capacityClasses_.size();
+    std::vector<int> joined;
+    for (const auto &entry : waitlist_) {
+        if (waitClassOf(entry.partySize) == joinedClass) {
+            joined.push_back(entry.partySize);
+        }
+    }
+    auto joinedEstimates = estimateJoinedWaits(joined);
+    std::vector<size_t> ahead(waitingPerClass_.size(), 0);
+    std::vector<WaitEstimate> estimates;
+    estimates.reserve(waitlist_.size());
+    for (const auto &entry : waitlist_) {
+        auto waitClass = waitClassOf(entry.partySize);
+        if (waitClass == joinedClass) {
+            estimates.push_back(joinedEstimates[ahead[waitClass]++]);
+        } else {
+            estimates.push_back(estimateFor(waitClass, ahead[waitClass]++, waitTimelinesBuiltAt_));
+        }
+    }
+    return estimates;
+}
+
+bool BookingSheet::autoAssignTable(RecordId id) {
+    auto reservation = findReservationById(id);
+    if (!reservation) {
+        return false;
+    }
+    auto tableIds = findAvailableTableSet(reservation->getPartySize(),
+                                          reservation->getDateTime(),
+                                          reservation->getDuration(),
+                                          reservation->getId());
+    if (tableIds.empty()) {
+        return false;
+    }
+    setTables(*reservation, tableIds);
+    return true;
+}
+
+bool BookingSheet::assignTable(RecordId id, int tableId) { return assignTables(id, {tableId}); }
+
+bool BookingSheet::assignTables(RecordId id, const std::vector<int> &tableIds) {
+    auto reservation = findReservationById(id);
+    if (!reservation || reservation->getStatus() == ReservationStatus::Cancelled) {
+        return false;
+    }
+    if (!canSeat(tableIds,
+                 reservation->getPartySize(),
+                 reservation->getStartMinutes(),
+                 reservation->getEndMinutes(),
+                 reservation->getId())) {
+        return false;
+    }
+    setTables(*reservation, tableIds);
+    seatWaitingParties();
+    return true;
+}
+
+bool BookingSheet::clearTableAssignment(RecordId id) {
+    auto reservation = findReservationById(id);
+    if (!reservation) {
+        return false;
+    }
+    setTables(*reservation, {});
+    seatWaitingParties();
+    return true;
+}
+
+TablePlanSnapshot BookingSheet::snapshotTablePlan() const {
+    TablePlanSnapshot snapshot;
+    snapshot.now = toSheetMinutes(std::chrono::system_clock::now());
+    snapshot.tables = tables_;
+    snapshot.neighbours = tableNeighbours_;
+    for (const auto &reservation : reservations_) {
+        auto status = reservation.getStatus();
+        if (status == ReservationStatus::Cancelled || status == ReservationStatus::Completed) {
+            continue;
+        }
+        TablePlanSnapshot::Party party;
+        party.reservationId = reservation.getId();
+        party.partySize = reservation.getPartySize();
+        party.start = reservation.getStartMinutes();
+        party.end = reservation.getEndMinutes();
+        party.tableIds.assign(reservation.getTableIds().begin(), reservation.getTableIds().end());
+        party.movable = status == ReservationStatus::Open && party.start > snapshot.now;
+        if (party.movable || !party.tableIds.empty()) {
+            snapshot.parties.push_back(std::move(party));
+        }
+    }
+    return snapshot;
+}
+
+std::vector<TableMove> BookingSheet::applyTableMoves(const std::vector<TableMove> &moves) {
+    auto now = toSheetMinutes(std::chrono::system_clock::now());
+    std::vector<std::pair<Reservation *, const TableMove *>> pending;
+    for (const auto &move : moves) {
+        auto reservation = findReservationById(move.reservationId);
+        if (!reservation || reservation->getStatus() != ReservationStatus::Open ||
+            reservation->getStartMinutes() <= now || reservation->getPartySize() != move.partySize ||
+            reservation->getStartMinutes() != move.start || reservation->getEndMinutes() != move.end) {
+            continue;
+        }
+        const auto &tableIds = reservation->getTableIds();
+        if (!std::equal(tableIds.begin(), tableIds.end(), move.fromTableIds.begin(), move.fromTableIds.end())) {
+            continue;
+        }
+        pending.emplace_back(reservation, &move);
+    }
+    std::vector<TableMove> applied;
+    if (pending.empty()) {
+        return applied;
+    }
+
+    // Lift every moving party off its tables, then pencil the targets in one by one.
+    for (const auto &[reservation, move] : pending) {
+        unindexReservation(*reservation);
+    }
+    size_t placed = 0;
+    for (; placed < pending.size(); ++placed) {
+        const auto &move = *pending[placed].second;
+        if (!canSeat(move.toTableIds, move.partySize, move.start, move.end, std::nullopt)) {
+            break;
+        }
+        for (int tableId : move.toTableIds) {
+            insertTableBooking(tableSchedules_[*findTablePosition(tableId)],
+                               TableBooking{move.start, move.end, move.reservationId});
+        }
+    }
+    for (size_t i = 0; i < placed; ++i) {
+        for (int tableId : pending[i].second->toTableIds) {
+            removeBooking(*findTablePosition(tableId), pending[i].first->getId());
+        }
+    }
+    bool batchFits = placed == pending.size();
+    for (const auto &[reservation, move] : pending) {
+        if (batchFits) {
+            noteReservation(reservation->getId());
+            reservation->edit().setTables(move->toTableIds);
+            applied.push_back(*move);
+        }
+        indexReservation(*reservation);
+    }
+    if (!batchFits) {
+        for (const auto &[reservation, move] : pending) {
+            if (canSeat(move->toTableIds, move->partySize, move->start, move->end, move->reservationId)) {
+                setTables(*reservation, move->toTableIds);
+                applied.push_back(*move);
+            }
+        }
+    }
+    if (!applied.empty()) {
+        seatWaitingParties();
+    }
+    return applied;
+}
+
+bool BookingSheet::updateReservationStatus(RecordId id, ReservationStatus status) {
     auto reservation = findReservationById(id);
     if (!reservation) {
         return false;
     }
-    reservation->cancel();
-    reservation->clearTable();
+    noteReservation(id);
+    unindexReservation(*reservation);
+    tallyReservation(*reservation, -1);
+    {
+        auto edit = reservation->edit();
+        edit.setStatus(status);
+        if (status == ReservationStatus::Cancelled) {
+            edit.clearTables();
+        } else if (status != ReservationStatus::Completed && !reservation->getTableIds().empty()) {
+            // Reopening a finished reservation: its tables may have been given away meanwhile.
+            std::vector<int> current(reservation->getTableIds().begin(), reservation->getTableIds().end());
+            if (!canSeat(current,
+                         reservation->getPartySize(),
+                         reservation->getStartMinutes(),
+                         reservation->getEndMinutes(),
+                         reservation->getId())) {
+                edit.clearTables();
+            }
+        }
+    }
+    tallyReservation(*reservation, 1);
+    indexReservation(*reservation);
+    seatWaitingParties();
+    return true;
+}
+
+Order &BookingSheet::recordOrder(RecordId reservationId) {
+    RecordId id('O', nextOrderNumber_++);
+    orders_.emplace_back(id, reservationId);
+    orderIndex_.emplace(id, orders_.size() - 1);
+    bills_[reservationId].orderCount += 1;
+    if (capture_) {
+        appendOrderLine(capture_->orders, orders_.back());
+    }
+    return orders_.back();
+}
+
+bool BookingSheet::addOrderItem(RecordId orderId, const MenuItem &item, int quantity) {
+    auto order = findOrderById(orderId);
+    if (!order || quantity <= 0) {
+        return false;
+    }
+    auto orderedAt = toSheetMinutes(std::chrono::system_clock::now());
+    appendOrderItem(*order, OrderItem(item.getId(), item.getPrice(), quantity, orderedAt), item.getName());
+    return true;
+}
+
+void BookingSheet::appendOrderItem(Order &order, const OrderItem &item, const std::string &dishName) {
+    order.addItem(item);
+    auto lineTotal = item.getLineTotal();
+    bills_[order.getReservationId()].total += lineTotal;
+    revenue_ += lineTotal;
+    if (const auto *reservation = findReservationById(order.getReservationId())) {
+        addToReportBucket(reservation->getStartMinutes(), 0, lineTotal);
+    }
+    popularity_.record(dishName, item.getQuantity(), item.getOrderedAt());
+    if (capture_) {
+        appendItemLine(capture_->orders, order.getId(), item);
+    }
+}
+
+ReservationBill BookingSheet::getReservationBill(RecordId reservationId) const {
+    auto it = bills_.find(reservationId);
+    if (it == bills_.end()) {
+        return {};
+    }
+    return it->second;
+}
+
+Money BookingSheet::getRevenue() const { return revenue_; }
+
+std::vector<DishCount> BookingSheet::getPopularDishes(size_t limit, std::chrono::minutes window) const {
+    return popularity_.top(limit, window, std::chrono::system_clock::now());
+}
+
+Reservation *BookingSheet::findReservationById(RecordId id) {
+    auto it = reservationIndex_.find(id);
+    if (it == reservationIndex_.end()) {
+        return nullptr;
+    }
+    return &reservations_[it->second];
+}
+
+const Reservation *BookingSheet::findReservationById(RecordId id) const {
+    auto it = reservationIndex_.find(id);
+    if (it == reservationIndex_.end()) {
+        return nullptr;
+    }
+    return &reservations_[it->second];
+}
+
+Order *BookingSheet::findOrderById(RecordId id) {
+    auto it = orderIndex_.find(id);
+    if (it == orderIndex_.end()) {
+        return nullptr;
+    }
+    return &orders_[it->second];
+}
+
+void BookingSheet::reindexReservations() {
+    reservationIndex_.clear();
+    for (size_t i = 0; i < reservations_.size(); ++i) {
+        reservationIndex_.emplace(reservations_[i].getId(), i);
+    }
+}
+
+std::optional<size_t> BookingSheet::findTablePosition(int tableId) const {
+    auto it = tablePositions_.find(tableId);
+    if (it == tablePositions_.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+bool isScheduleFree(const std::vector<TableBooking> &schedule,
+                    SheetMinutes start,
+                    SheetMinutes end,
+                    std::optional<RecordId> ignoreReservationId) {
+    // Bookings on one table never overlap each other, so ends are sorted too: walk back from the
+    // first booking starting at or after `end` until one finishes by `start`.
+    auto it = std::lower_bound(schedule.begin(), schedule.end(), end, [](const TableBooking &booking, SheetMinutes value) {
+        return booking.start < value;
+    });
+    while (it != schedule.begin()) {
+        --it;
+        if (it->end <= start) {
+            break;
+        }
+        if (!ignoreReservationId || it->reservationId != *ignoreReservationId) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void insertTableBooking(std::vector<TableBooking> &schedule, const TableBooking &booking) {
+    auto it = std::upper_bound(schedule.begin(), schedule.end(), booking, [](const TableBooking &lhs, const TableBooking &rhs) {
+        return lhs.start < rhs.start;
+    });
+    schedule.insert(it, booking);
+}
+
+bool BookingSheet::isSlotFree(size_t position,
+                              SheetMinutes start,
+                              SheetMinutes end,
+                              std::optional<RecordId> ignoreReservationId) const {
+    return isScheduleFree(tableSchedules_[position], start, end, ignoreReservationId);
+}
+
+bool BookingSheet::canSeat(const std::vector<int> &tableIds,
+                           int partySize,
+                           SheetMinutes start,
+                           SheetMinutes end,
+                           std::optional<RecordId> ignoreReservationId) const {
+    if (tableIds.empty()) {
+        return false;
+    }
+    std::vector<size_t> positions;
+    int capacity = 0;
+    for (int tableId : tableIds) {
+        auto position = findTablePosition(tableId);
+        if (!position || std::find(positions.begin(), positions.end(), *position) != positions.end()) {
+            return false;
+        }
+        const auto &table = tables_[*position];
+        if (table.getStatus() == TableStatus::OutOfService || !isSlotFree(*position, start, end, ignoreReservationId)) {
+            return false;
+        }
+        capacity += table.getCapacity();
+        positions.push_back(*position);
+    }
+    if (capacity < partySize) {
+        return false;
+    }
+    // Several tables must form one connected group on the floor graph.
+    std::vector<size_t> reached{positions.front()};
+    for (size_t i = 0; i < reached.size(); ++i) {
+        for (auto neighbour : tableNeighbours_[reached[i]]) {
+            if (std::find(positions.begin(), positions.end(), neighbour) != positions.end() &&
+                std::find(reached.begin(), reached.end(), neighbour) == reached.end()) {
+                reached.push_back(neighbour);
+            }
+        }
+    }
+    return reached.size() == positions.size();
+}
+
+void BookingSheet::indexReservation(const Reservation &reservation) {
+    // Completed parties have left, so their tables are free again from now on.
+    if (reservation.getStatus() == ReservationStatus::Cancelled ||
+        reservation.getStatus() == ReservationStatus::Completed) {
+        return;
+    }
+    waitTimelinesDirty_ = true;
+    TableBooking booking{reservation.getStartMinutes(), reservation.getEndMinutes(), reservation.getId()};
+    for (int tableId : reservation.getTableIds()) {
+        if (auto position = findTablePosition(tableId)) {
+            insertTableBooking(tableSchedules_[*position], booking);
+        }
+    }
+}
+
+void BookingSheet::unindexReservation(const Reservation &reservation) {
+    waitTimelinesDirty_ = true;
+    for (int tableId : reservation.getTableIds()) {
+        if (auto position = findTablePosition(tableId)) {
+            removeBooking(*position, reservation.getId());
+        }
+    }
+}
+
+void BookingSheet::removeBooking(size_t position, RecordId reservationId) {
+    auto &schedule = tableSchedules_[position];
+    schedule.erase(std::remove_if(schedule.begin(), schedule.end(), [&](const TableBooking &booking) {
+                       return booking.reservationId == reservationId;
+                   }),
+                   schedule.end());
+}
+
+void BookingSheet::setTables(Reservation &reservation, const std::vector<int> &tableIds) {
+    noteReservation(reservation.getId());
+    unindexReservation(reservation);
+    reservation.edit().setTables(tableIds);
+    indexReservation(reservation);
+}
+
+void BookingSheet::reindexOrders() {
+    orderIndex_.clear();
+    for (size_t i = 0; i < orders_.size(); ++i) {
+        orderIndex_.emplace(orders_[i].getId(), i);
+    }
+}
+
+bool BookingSheet::updateReservationDetails(RecordId id,
+                                            const Customer &customer,
+                                            int partySize,
+                                            std::chrono::system_clock::time_point time,
+                                            std::chrono::minutes duration,
+                                            const std::string &notes,
+                                            std::optional<int> requestedTable,
+                                            bool tableSpecified) {
+    auto reservation = findReservationById(id);
+    if (!reservation || duration.count() <= 0 || duration.count() > kMaxSeatingDurationMinutes) {
+        return false;
+    }
+
+    auto start = toSheetMinutes(time);
+    auto end = start + static_cast<SheetMinutes>(duration.count());
+    std::vector<int> newTables;
+    if (tableSpecified) {
+        if (requestedTable) {
+            newTables.push_back(*requestedTable);
+            if (!canSeat(newTables, partySize, start, end, reservation->getId())) {
+                return false;
+            }
+        }
+    } else {
+        std::vector<int> current(reservation->getTableIds().begin(), reservation->getTableIds().end());
+        if (canSeat(current, partySize, start, end, reservation->getId())) {
+            newTables = std::move(current);
+        } else {
+            newTables = findAvailableTableSet(partySize, time, duration, reservation->getId());
+        }
+    }
+
+    auto customerId = customers_->upsert(customer);
+    noteCustomer(customerId);
+    noteReservation(id);
+    if (customerId != reservation->getCustomerId()) {
+        customers_->removeReservation(reservation->getCustomerId(), reservation->getId());
+        customers_->addReservation(customerId, reservation->getId());
+    }
+    unindexReservation(*reservation);
+    tallyReservation(*reservation, -1);
+    reservation->edit()
+        .setCustomerId(customerId)
+        .setPartySize(partySize)
+        .setDateTime(time)
+        .setDuration(duration)
+        .setNotes(notes)
+        .setTables(newTables);
+    tallyReservation(*reservation, 1);
+    indexReservation(*reservation);
+    seatWaitingParties();
+
     return true;
 }
 
-bool BookingSheet::deleteReservation(const std::string &id) {
-    auto reservationIt = std::find_if(reservations_.begin(), reservations_.end(),
-                                      [&](const Reservation &reservation) { return reservation.getId() == id; });
-    if (reservationIt == reservations_.end()) {
+bool BookingSheet::cancelReservation(RecordId id) {
+    auto reservation = findReservationById(id);
+    if (!reservation) {
+        return false;
+    }
+    return updateReservationStatus(id, ReservationStatus::Cancelled);
+}
+
+bool BookingSheet::deleteReservation(RecordId id) {
+    if (!findReservationById(id)) {
         return false;
     }
+    noteReservation(id);
+    eraseReservation(id);
+    seatWaitingParties();
+    return true;
+}
+
+void BookingSheet::eraseReservation(RecordId id) {
+    auto indexIt = reservationIndex_.find(id);
+    auto reservationIt = reservations_.begin() + static_cast<std::ptrdiff_t>(indexIt->second);
+    customers_->removeReservation(reservationIt->getCustomerId(), id);
+    unindexReservation(*reservationIt);
+    tallyReservation(*reservationIt, -1);
     reservations_.erase(reservationIt);
+    auto bill = bills_.find(id);
+    if (bill != bills_.end()) {
+        revenue_ -= bill->second.total;
+        bills_.erase(bill);
+    }
     orders_.erase(std::remove_if(orders_.begin(),
                                  orders_.end(),
                                  [&](const Order &order) { return order.getReservationId() == id; }),
                   orders_.end());
-    return true;
+    reindexReservations();
+    reindexOrders();
 }
 
-void BookingSheet::updateTableStatuses() {
-    auto now = std::chrono::system_clock::now();
+void BookingSheet::updateTableStatuses() { updateTableStatuses(std::chrono::system_clock::now()); }
+
+void BookingSheet::updateTableStatuses(std::chrono::system_clock::time_point at) {
+    auto now = toSheetMinutes(at);
     for (auto &table : tables_) {
         if (table.getStatus() != TableStatus::OutOfService) {
             table.setStatus(TableStatus::Free);
         }
     }
     for (const auto &reservation : reservations_) {
-        if (!reservation.getTableId() || reservation.getStatus() == ReservationStatus::Cancelled) {
-            continue;
-        }
-        auto *table = getTableById(*reservation.getTableId());
-        if (!table) {
-            continue;
-        }
-        if (reservation.getStatus() == ReservationStatus::Completed) {
+        if (reservation.getStatus() == ReservationStatus::Cancelled ||
+            reservation.getStatus() == ReservationStatus::Completed) {
             continue;
         }
-        auto start = reservation.getDateTime();
-        auto end = reservation.getEndTime();
-        if (reservation.getStatus() == ReservationStatus::Seated || (now >= start && now < end)) {
-            table->setStatus(TableStatus::Occupied);
-        } else if (now < start) {
-            table->setStatus(TableStatus::Reserved);
+        auto start = reservation.getStartMinutes();
+        auto end = reservation.getEndMinutes();
+        for (int tableId : reservation.getTableIds()) {
+            auto *table = getTableById(tableId);
+            if (!table) {
+                continue;
+            }
+            if (reservation.getStatus() == ReservationStatus::Seated || (now >= start && now < end)) {
+                table->setStatus(TableStatus::Occupied);
+            } else if (now < start) {
+                table->setStatus(TableStatus::Reserved);
+            }
         }
     }
 }
@@ -532,122 +1716,859 @@ void BookingSheet::updateDisplay(const std::function<void(const Reservation &)>
     }
 }
 
-Report BookingSheet::generateReport() const {
-    int seatedGuests = 0;
-    std::vector<std::tuple<std::string, ReservationStatus>> breakdown;
-    for (const auto &reservation : reservations_) {
-        if (reservation.getStatus() == ReservationStatus::Seated ||
-            reservation.getStatus() == ReservationStatus::Completed) {
-            seatedGuests += reservation.getPartySize();
-        }
-        breakdown.emplace_back(reservation.getId(), reservation.getStatus());
+Report BookingSheet::generateReport(ReportPage breakdownPage) const {
+    std::vector<ReportBucket> series;
+    series.reserve(reportBuckets_.size());
+    for (const auto &[start, totals] : reportBuckets_) {
+        series.push_back(ReportBucket{fromSheetMinutes(start), totals.covers, totals.revenue});
+    }
+    auto offset = std::min(breakdownPage.offset, reservations_.size());
+    auto count = std::min(breakdownPage.limit, reservations_.size() - offset);
+    std::vector<std::tuple<RecordId, ReservationStatus>> breakdown;
+    breakdown.reserve(count);
+    for (auto it = reservations_.begin() + static_cast<std::ptrdiff_t>(offset); count > 0; ++it, --count) {
+        breakdown.emplace_back(it->getId(), it->getStatus());
     }
+    return Report(date_, reservationsByStatus_, seatedGuests_, revenue_, std::move(series), std::move(breakdown), offset);
+}
 
-    double revenue = 0.0;
-    for (const auto &order : orders_) {
-        revenue += order.calculateTotal();
+void BookingSheet::tallyReservation(const Reservation &reservation, int sign) {
+    auto status = reservation.getStatus();
+    reservationsByStatus_[static_cast<size_t>(status)] += sign;
+    int covers = 0;
+    if (status == ReservationStatus::Seated || status == ReservationStatus::Completed) {
+        covers = reservation.getPartySize() * sign;
+        seatedGuests_ += covers;
     }
-    return Report(date_, static_cast<int>(reservations_.size()), seatedGuests, revenue, breakdown);
+    Money revenue;
+    auto bill = bills_.find(reservation.getId());
+    if (bill != bills_.end()) {
+        revenue = bill->second.total * sign;
+    }
+    addToReportBucket(reservation.getStartMinutes(), covers, revenue);
 }
 
-Table *BookingSheet::getTableById(int id) {
-    auto it = std::find_if(tables_.begin(), tables_.end(), [&](const Table &table) { return table.getId() == id; });
-    if (it == tables_.end()) {
-        return nullptr;
+void BookingSheet::addToReportBucket(SheetMinutes start, int covers, Money revenue) {
+    if (covers == 0 && revenue == Money{}) {
+        return;
+    }
+    auto slot = start - ((start % kReportBucketMinutes) + kReportBucketMinutes) % kReportBucketMinutes;
+    auto it = reportBuckets_.try_emplace(slot).first;
+    it->second.covers += covers;
+    it->second.revenue += revenue;
+    if (it->second.covers == 0 && it->second.revenue == Money{}) {
+        reportBuckets_.erase(it);
     }
-    return &(*it);
 }
 
-const Table *BookingSheet::getTableById(int id) const {
-    auto it = std::find_if(tables_.begin(), tables_.end(), [&](const Table &table) { return table.getId() == id; });
-    if (it == tables_.end()) {
-        return nullptr;
+std::array<std::uint32_t, 4> BookingSheet::counters() const {
+    return {nextReservationNumber_, nextWalkInNumber_, nextOrderNumber_, nextWaitlistNumber_};
+}
+
+void BookingSheet::beginChangeCapture() {
+    capture_.emplace();
+    capture_->counters = counters();
+}
+
+void BookingSheet::noteCustomer(CustomerId id) {
+    if (capture_ && std::find(capture_->customers.begin(), capture_->customers.end(), id) == capture_->customers.end()) {
+        capture_->customers.push_back(id);
+    }
+}
+
+void BookingSheet::noteReservation(RecordId id) {
+    if (!capture_) {
+        return;
+    }
+    auto &touched = capture_->reservations;
+    if (std::none_of(touched.begin(), touched.end(), [&](const auto &entry) { return entry.first == id; })) {
+        touched.emplace_back(id, reservationIndex_.count(id) > 0);
+    }
+}
+
+std::string BookingSheet::takeChanges() {
+    if (!capture_) {
+        return {};
+    }
+    auto capture = std::move(*capture_);
+    capture_.reset();
+    std::string changes;
+    // New customers get the next ids in turn, so ascending order adds them in the same order here.
+    std::sort(capture.customers.begin(), capture.customers.end());
+    for (auto id : capture.customers) {
+        appendCustomerLine(changes, id, customers_->get(id));
+    }
+    changes += capture.waitlist;
+    for (const auto &[id, existed] : capture.reservations) {
+        if (const auto *reservation = findReservationById(id)) {
+            appendReservationLine(changes, *reservation);
+        } else if (existed) {
+            changes += "X\t" + id.toString() + '\n';
+        }
+    }
+    changes += capture.orders;
+    if (capture.counters != counters()) {
+        changes += 'N';
+        for (auto counter : counters()) {
+            appendNumber(changes, counter);
+        }
+        changes += '\n';
     }
-    return &(*it);
+    return changes;
+}
+
+bool BookingSheet::applyChanges(std::string_view changes, const std::vector<MenuItem> &menu) {
+    while (!changes.empty()) {
+        auto end = changes.find('\n');
+        if (end == std::string_view::npos || !applyChange(splitFields(changes.substr(0, end)), menu)) {
+            return false;
+        }
+        changes.remove_prefix(end + 1);
+    }
+    return true;
 }
 
-bool BookingSheet::isTableAvailable(int tableId,
-                                     std::chrono::system_clock::time_point time,
-                                     std::chrono::minutes duration,
-                                     const std::optional<std::string> &ignoreReservationId) const {
-    auto table = getTableById(tableId);
-    if (!table || table->getStatus() == TableStatus::OutOfService) {
+bool BookingSheet::applyChange(const std::vector<std::string> &fields, const std::vector<MenuItem> &menu) {
+    const auto &tag = fields[0];
+    if (tag == "C" && fields.size() == 6) {
+        CustomerId id = 0;
+        return parseField(fields[1], id) && customers_->restore(id, Customer{fields[2], fields[3], fields[4], fields[5]});
+    }
+    if (tag == "R" && fields.size() == 11) {
+        return applyReservation(fields);
+    }
+    if (tag == "X" && fields.size() == 2) {
+        auto id = RecordId::parse(fields[1]);
+        if (!id || !findReservationById(*id)) {
+            return false;
+        }
+        eraseReservation(*id);
+        return true;
+    }
+    if (tag == "Q" && fields.size() == 6) {
+        WaitlistEntry entry;
+        auto id = RecordId::parse(fields[1]);
+        if (!id || !parseField(fields[2], entry.customerId) || entry.customerId >= customers_->size() ||
+            !parseField(fields[3], entry.partySize) || !parseField(fields[4], entry.joinedAt)) {
+            return false;
+        }
+        entry.id = *id;
+        entry.notes = fields[5];
+        ++waitingPerClass_[waitClassOf(entry.partySize)];
+        waitlist_.push_back(std::move(entry));
+        return true;
+    }
+    if (tag == "q" && fields.size() == 2) {
+        auto id = RecordId::parse(fields[1]);
+        return id && leaveWaitlist(*id);
+    }
+    if (tag == "O" && fields.size() == 3) {
+        auto id = RecordId::parse(fields[1]);
+        auto reservationId = RecordId::parse(fields[2]);
+        if (!id || !reservationId || orderIndex_.count(*id) > 0) {
+            return false;
+        }
+        orders_.emplace_back(*id, *reservationId);
+        orderIndex_.emplace(*id, orders_.size() - 1);
+        bills_[*reservationId].orderCount += 1;
+        return true;
+    }
+    if (tag == "I" && fields.size() == 6) {
+        auto orderId = RecordId::parse(fields[1]);
+        auto *order = orderId ? findOrderById(*orderId) : nullptr;
+        MenuItemId menuItemId = 0;
+        std::int64_t priceCents = 0;
+        int quantity = 0;
+        SheetMinutes orderedAt = 0;
+        if (!order || !parseField(fields[2], menuItemId) || menuItemId >= menu.size() ||
+            !parseField(fields[3], priceCents) || !parseField(fields[4], quantity) || quantity <= 0 ||
+            !parseField(fields[5], orderedAt)) {
+            return false;
+        }
+        appendOrderItem(*order,
+                        OrderItem(menuItemId, Money::fromCents(priceCents), quantity, orderedAt),
+                        menu[menuItemId].getName());
+        return true;
+    }
+    if (tag == "N" && fields.size() == 5) {
+        return parseField(fields[1], nextReservationNumber_) && parseField(fields[2], nextWalkInNumber_) &&
+               parseField(fields[3], nextOrderNumber_) && parseField(fields[4], nextWaitlistNumber_);
+    }
+    return false;
+}
+
+bool BookingSheet::applyReservation(const std::vector<std::string> &fields) {
+    auto id = RecordId::parse(fields[1]);
+    CustomerId customerId = 0;
+    int partySize = 0;
+    SheetMinutes start = 0;
+    SheetMinutes duration = 0;
+    SheetMinutes lastModified = 0;
+    std::uint32_t version = 0;
+    size_t status = 0;
+    std::vector<int> tableIds;
+    if (!id || !parseField(fields[2], customerId) || customerId >= customers_->size() ||
+        !parseField(fields[3], partySize) || !parseField(fields[4], start) || !parseField(fields[5], duration) ||
+        !parseField(fields[6], lastModified) || !parseField(fields[7], version) || !parseField(fields[8], status) ||
+        status >= kReservationStatusCount || !parseTableIds(fields[9], tableIds)) {
         return false;
     }
-    auto newEnd = time + duration;
+    auto *reservation = findReservationById(*id);
+    if (!reservation) {
+        reservations_.emplace_back(*id, customerId, partySize, fromSheetMinutes(start), std::chrono::minutes(duration), fields[10]);
+        reservationIndex_.emplace(*id, reservations_.size() - 1);
+        customers_->addReservation(customerId, *id);
+        reservation = &reservations_.back();
+    } else {
+        unindexReservation(*reservation);
+        tallyReservation(*reservation, -1);
+        if (customerId != reservation->customerId_) {
+            customers_->removeReservation(reservation->customerId_, *id);
+            customers_->addReservation(customerId, *id);
+        }
+    }
+    reservation->customerId_ = customerId;
+    reservation->partySize_ = partySize;
+    reservation->start_ = start;
+    reservation->durationMinutes_ = duration;
+    reservation->lastModified_ = lastModified;
+    reservation->version_ = version;
+    reservation->status_ = static_cast<ReservationStatus>(status);
+    reservation->tableIds_.assign(tableIds.begin(), tableIds.end());
+    reservation->notes_.assign(fields[10]);
+    tallyReservation(*reservation, 1);
+    indexReservation(*reservation);
+    return true;
+}
+
+std::string BookingSheet::exportRecords() const {
+    return exportRecords([](const Reservation &) { return true; }, true);
+}
+
+std::string BookingSheet::exportRecords(const std::function<bool(const Reservation &)> &keep, bool withWaitlist) const {
+    auto kept = [&](RecordId id) {
+        const auto *reservation = findReservationById(id);
+        return reservation && keep(*reservation);
+    };
+    std::string records;
+    if (withWaitlist) {
+        for (const auto &entry : waitlist_) {
+            appendWaitlistLine(records, entry);
+        }
+    }
     for (const auto &reservation : reservations_) {
-        if (reservation.getStatus() == ReservationStatus::Cancelled || !reservation.getTableId()) {
-            continue;
+        if (keep(reservation)) {
+            appendReservationLine(records, reservation);
         }
-        if (ignoreReservationId && reservation.getId() == *ignoreReservationId) {
+    }
+    for (const auto &order : orders_) {
+        if (!kept(order.getReservationId())) {
             continue;
         }
-        if (*reservation.getTableId() != tableId) {
-            continue;
+        appendOrderLine(records, order);
+        for (const auto &item : order.getItems()) {
+            appendItemLine(records, order.getId(), item);
         }
-        auto existingStart = reservation.getDateTime();
-        auto existingEnd = reservation.getEndTime();
-        bool overlap = !(newEnd <= existingStart || time >= existingEnd);
-        if (overlap) {
-            return false;
+    }
+    records += 'N';
+    for (auto counter : counters()) {
+        appendNumber(records, counter);
+    }
+    records += '\n';
+    return records;
+}
+
+BookingSheet BookingSheet::emptyCopy(std::string date) const {
+    return emptyCopy(std::move(date), customers_);
+}
+
+BookingSheet BookingSheet::emptyCopy(std::string date, std::shared_ptr<CustomerDirectory> customers) const {
+    BookingSheet sheet(std::move(date));
+    sheet.customers_ = std::move(customers);
+    sheet.nextReservationNumber_ = nextReservationNumber_;
+    sheet.nextWalkInNumber_ = nextWalkInNumber_;
+    sheet.nextOrderNumber_ = nextOrderNumber_;
+    sheet.nextWaitlistNumber_ = nextWaitlistNumber_;
+    for (const auto &table : tables_) {
+        sheet.addTable(table);
+    }
+    for (size_t position = 0; position < tables_.size(); ++position) {
+        for (auto neighbour : tableNeighbours_[position]) {
+            sheet.joinTables(tables_[position].getId(), tables_[neighbour].getId());
         }
     }
-    return true;
+    return sheet;
+}
+
+BookingSheet BookingSheet::copyWhere(std::string date,
+                                     const std::function<bool(const Reservation &)> &keep,
+                                     const std::vector<MenuItem> &menu) const {
+    auto sheet = emptyCopy(std::move(date));
+    // Rebuilt from this sheet's own records, which always fit its floor and menu.
+    sheet.applyChanges(exportRecords(keep, false), menu);
+    return sheet;
+}
+
+Table *BookingSheet::getTableById(int id) {
+    auto position = findTablePosition(id);
+    return position ? &tables_[*position] : nullptr;
+}
+
+const Table *BookingSheet::getTableById(int id) const {
+    auto position = findTablePosition(id);
+    return position ? &tables_[*position] : nullptr;
 }
 
 Restaurant::Restaurant(std::string name, std::string address, BookingSheet bookingSheet)
-    : name_(std::move(name)), address_(std::move(address)), bookingSheet_(std::move(bookingSheet)) {}
+    : name_(std::move(name)),
+      address_(std::move(address)),
+      bookingSheet_(std::make_unique<BookingSheet>(std::move(bookingSheet))) {}
 
 const std::string &Restaurant::getName() const { return name_; }
 
 const std::string &Restaurant::getAddress() const { return address_; }
 
-BookingSheet &Restaurant::getBookingSheet() { return bookingSheet_; }
+BookingSheet &Restaurant::getBookingSheet() { return *bookingSheet_; }
 
-const BookingSheet &Restaurant::getBookingSheet() const { return bookingSheet_; }
+const BookingSheet &Restaurant::getBookingSheet() const { return *bookingSheet_; }
 
-void Restaurant::addMenuItem(const MenuItem &item) { menu_.push_back(item); }
+MenuItemId Restaurant::addMenuItem(const MenuItem &item) {
+    auto id = static_cast<MenuItemId>(menu_.size());
+    menu_.push_back(item);
+    menu_.back().id_ = id;
+    rebuildMenuIndex();
+    return id;
+}
 
 const std::vector<MenuItem> &Restaurant::getMenu() const { return menu_; }
 
-const MenuItem *Restaurant::findMenuItem(const std::string &name) const {
-    auto it = std::find_if(menu_.begin(), menu_.end(), [&](const MenuItem &item) { return item.getName() == name; });
-    if (it == menu_.end()) {
+const MenuItem *Restaurant::findMenuItem(std::string_view name) const {
+    auto it = menuIndex_.find(name);
+    if (it == menuIndex_.end()) {
+        return nullptr;
+    }
+    return &menu_[it->second];
+}
+
+const MenuItem *Restaurant::findMenuItem(MenuItemId id) const {
+    if (id >= menu_.size()) {
         return nullptr;
     }
-    return &(*it);
+    return &menu_[id];
+}
+
+void Restaurant::rebuildMenuIndex() {
+    // Growing menu_ may move the strings the views point at, so the index is rebuilt wholesale.
+    menuIndex_.clear();
+    menuIndex_.reserve(menu_.size());
+    for (const auto &item : menu_) {
+        menuIndex_.emplace(item.getName(), item.getId());
+    }
 }
 
 void Restaurant::addStaff(std::shared_ptr<Staff> staff) { staff_.push_back(std::move(staff)); }
 
 const std::vector<std::shared_ptr<Staff>> &Restaurant::getStaff() const { return staff_; }
 
-Report Restaurant::generateDailyReport() const { return bookingSheet_.generateReport(); }
+std::string Restaurant::issueStaffToken(const Staff &staff) {
+    static constexpr char kHexDigits[] = "0123456789abcdef";
+    std::random_device entropy;
+    std::string token;
+    do {
+        token.clear();
+        for (int word = 0; word < 4; ++word) {
+            auto bits = entropy();
+            for (int nibble = 0; nibble < 8; ++nibble) {
+                token += kHexDigits[bits & 0xF];
+                bits >>= 4;
+            }
+        }
+    } while (staffTokens_.count(token) != 0);
+    staffTokens_.emplace(token, &staff);
+    return token;
+}
+
+const Staff *Restaurant::findStaffByToken(const std::string &token) const {
+    auto it = staffTokens_.find(token);
+    return it == staffTokens_.end() ? nullptr : it->second;
+}
+
+Report Restaurant::generateDailyReport(ReportPage breakdownPage) const {
+    return bookingSheet_->generateReport(breakdownPage);
+}
+
+void Restaurant::beginChangeCapture() {
+    capturing_ = true;
+    capturedChanges_.clear();
+    bookingSheet_->beginChangeCapture();
+}
+
+std::string Restaurant::takeChanges() {
+    if (!capturing_) {
+        return {};
+    }
+    capturing_ = false;
+    auto changes = std::move(capturedChanges_);
+    capturedChanges_.clear();
+    return changes + bookingSheet_->takeChanges();
+}
+
+bool Restaurant::applyChanges(std::string_view changes) {
+    while (true) {
+        // Changes before a D line were made on the day it closes, the rest on the next one.
+        auto dayLine = changes.compare(0, 2, "D\t") == 0 ? 0 : changes.find("\nD\t");
+        if (dayLine == std::string_view::npos) {
+            return bookingSheet_->applyChanges(changes, menu_);
+        }
+        if (dayLine > 0) {
+            ++dayLine;
+        }
+        auto end = changes.find('\n', dayLine);
+        if (end == std::string_view::npos || !bookingSheet_->applyChanges(changes.substr(0, dayLine), menu_)) {
+            return false;
+        }
+        auto fields = splitFields(changes.substr(dayLine, end - dayLine));
+        SheetMinutes midnight = 0;
+        if (fields.size() != 3 || fields[1] <= bookingSheet_->getDate() || !parseField(fields[2], midnight)) {
+            return false;
+        }
+        closeDay(fields[1], midnight);
+        changes.remove_prefix(end + 1);
+    }
+}
+
+std::string Restaurant::exportState() const {
+    const auto &customers = bookingSheet_->getCustomers();
+    auto state = bookingSheet_->getDate() + '\n';
+    for (CustomerId id = 0; id < customers.size(); ++id) {
+        appendCustomerLine(state, id, customers.get(id));
+    }
+    for (const auto &sheet : archivedSheets_) {
+        auto records = sheet->exportRecords();
+        state += "A\t" + sheet->getDate() + '\t' + std::to_string(records.size()) + '\n' + records;
+    }
+    return state + bookingSheet_->exportRecords();
+}
+
+bool Restaurant::installState(std::string_view state) {
+    // The live date, the customers every day refers to, each archived sheet as
+    // "A\t<date>\t<length>", then the live records.
+    auto end = state.find('\n');
+    if (end == std::string_view::npos) {
+        return false;
+    }
+    auto customers = std::make_shared<CustomerDirectory>();
+    auto sheet = std::make_unique<BookingSheet>(bookingSheet_->emptyCopy(std::string(state.substr(0, end)), customers));
+    state.remove_prefix(end + 1);
+    size_t customerLines = 0;
+    while (state.compare(customerLines, 2, "C\t") == 0) {
+        end = state.find('\n', customerLines);
+        if (end == std::string_view::npos) {
+            return false;
+        }
+        customerLines = end + 1;
+    }
+    if (!sheet->applyChanges(state.substr(0, customerLines), menu_)) {
+        return false;
+    }
+    state.remove_prefix(customerLines);
+    std::deque<std::shared_ptr<const BookingSheet>> archives;
+    while (state.compare(0, 2, "A\t") == 0) {
+        auto end = state.find('\n');
+        auto fields = splitFields(state.substr(0, end));
+        size_t length = 0;
+        if (end == std::string_view::npos || fields.size() != 3 || !parseField(fields[2], length) ||
+            length > state.size() - end - 1) {
+            return false;
+        }
+        auto archive = bookingSheet_->emptyCopy(fields[1], customers);
+        if (!archive.applyChanges(state.substr(end + 1, length), menu_)) {
+            return false;
+        }
+        archives.push_back(std::make_shared<const BookingSheet>(std::move(archive)));
+        state.remove_prefix(end + 1 + length);
+    }
+    if (!sheet->applyChanges(state, menu_)) {
+        return false;
+    }
+    // The dish window reaches back up to a day, into orders the newest archived day holds.
+    if (!archives.empty()) {
+        DishPopularity popularity;
+        for (const auto *source : {archives.back().get(), static_cast<const BookingSheet *>(sheet.get())}) {
+            for (const auto &order : source->getOrders()) {
+                for (const auto &item : order.getItems()) {
+                    popularity.record(menu_[item.getMenuItemId()].getName(), item.getQuantity(), item.getOrderedAt());
+                }
+            }
+        }
+        sheet->popularity_ = std::move(popularity);
+    }
+    bookingSheet_ = std::move(sheet);
+    archivedSheets_ = std::move(archives);
+    retireArchivedSheets();
+    return true;
+}
+
+bool Restaurant::rollOver(const std::string &nextDate) {
+    auto midnight = parseDateTime(nextDate + " 00:00");
+    if (!midnight) {
+        return false;
+    }
+    auto date = formatDateTime(*midnight).substr(0, 10);
+    if (date <= bookingSheet_->getDate()) {
+        return false;
+    }
+    closeDay(std::move(date), toSheetMinutes(*midnight));
+    return true;
+}
+
+void Restaurant::closeDay(std::string nextDate, SheetMinutes midnight) {
+    if (capturing_) {
+        capturedChanges_ += bookingSheet_->takeChanges();
+        capturedChanges_ += "D\t" + nextDate + '\t' + std::to_string(midnight) + '\n';
+    }
+    // Both halves are rebuilt in arenas of their own, so the closed day's arena, with whatever
+    // deleted records it still held, is released here.
+    // Decided from the records and `midnight` alone, so a replica splits the day the same way.
+    auto finished = [midnight](const Reservation &reservation) {
+        if (reservation.getStartMinutes() >= midnight) {
+            return false;
+        }
+        auto status = reservation.getStatus();
+        return status == ReservationStatus::Completed || status == ReservationStatus::Cancelled ||
+               (status == ReservationStatus::Open && reservation.getEndMinutes() <= midnight);
+    };
+    const auto &live = *bookingSheet_;
+    auto next = std::make_unique<BookingSheet>(
+        live.copyWhere(std::move(nextDate), [&](const Reservation &reservation) { return !finished(reservation); }, menu_));
+    archivedSheets_.push_back(std::make_shared<const BookingSheet>(live.copyWhere(live.getDate(), finished, menu_)));
+    // Already holds the carried orders' lines, so it replaces the count the copy rebuilt.
+    next->popularity_ = std::move(bookingSheet_->popularity_);
+    retireArchivedSheets();
+    bookingSheet_ = std::move(next);
+    if (capturing_) {
+        bookingSheet_->beginChangeCapture();
+    }
+}
+
+bool Restaurant::archiveSheet(BookingSheet sheet) {
+    auto &live = *bookingSheet_;
+    if (sheet.customers_ != live.customers_) {
+        return false;
+    }
+    live.nextReservationNumber_ = std::max(live.nextReservationNumber_, sheet.nextReservationNumber_);
+    live.nextWalkInNumber_ = std::max(live.nextWalkInNumber_, sheet.nextWalkInNumber_);
+    live.nextOrderNumber_ = std::max(live.nextOrderNumber_, sheet.nextOrderNumber_);
+    live.nextWaitlistNumber_ = std::max(live.nextWaitlistNumber_, sheet.nextWaitlistNumber_);
+    archivedSheets_.push_back(std::make_shared<const BookingSheet>(std::move(sheet)));
+    retireArchivedSheets();
+    return true;
+}
+
+const std::deque<std::shared_ptr<const BookingSheet>> &Restaurant::getArchivedSheets() const { return archivedSheets_; }
+
+void Restaurant::setArchiveRetention(size_t days) {
+    archiveRetention_ = days;
+    retireArchivedSheets();
+}
+
+const BookingSheet *Restaurant::findSheetHolding(RecordId reservationId) const {
+    if (bookingSheet_->findReservationById(reservationId)) {
+        return bookingSheet_.get();
+    }
+    for (auto it = archivedSheets_.rbegin(); it != archivedSheets_.rend(); ++it) {
+        if ((*it)->findReservationById(reservationId)) {
+            return it->get();
+        }
+    }
+    return nullptr;
+}
+
+void Restaurant::retireArchivedSheets() {
+    while (archiveRetention_ > 0 && archivedSheets_.size() > archiveRetention_) {
+        // The customers' lists keep only reservations on a sheet the restaurant still holds.
+        const auto &retired = *archivedSheets_.front();
+        for (const auto &reservation : retired.getReservations()) {
+            retired.customers_->removeReservation(reservation.getCustomerId(), reservation.getId());
+        }
+        archivedSheets_.pop_front();
+    }
+}
+
+namespace {
+// 2000-01-01 00:00:00 UTC.
+constexpr std::chrono::system_clock::time_point kSheetEpoch{std::chrono::seconds(946684800)};
+}  // namespace
+
+SheetMinutes toSheetMinutes(std::chrono::system_clock::time_point timePoint) {
+    return static_cast<SheetMinutes>(std::chrono::floor<std::chrono::minutes>(timePoint - kSheetEpoch).count());
+}
+
+std::chrono::system_clock::time_point fromSheetMinutes(SheetMinutes minutes) {
+    return kSheetEpoch + std::chrono::minutes(minutes);
+}
+
+namespace {
+constexpr std::int64_t kSecondsPerDay = 86400;
+
+// Whether an instant, in seconds since 1970, fits both SheetMinutes and system_clock with a week
+// to spare, so seatings, slot searches and day windows around it cannot overflow either.
+bool isRepresentableTime(std::int64_t utcSeconds) {
+    constexpr std::int64_t kHeadroomSeconds = 7 * kSecondsPerDay;
+    constexpr auto kSheetLimit = static_cast<std::int64_t>(std::numeric_limits<SheetMinutes>::max()) * 60 -
+                                 kHeadroomSeconds;
+    constexpr auto kClockLimit =
+        std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::duration::max()).count() -
+        kHeadroomSeconds;
+    auto sinceSheetEpoch = utcSeconds - std::chrono::duration_cast<std::chrono::seconds>(kSheetEpoch.time_since_epoch()).count();
+    return utcSeconds >= -kClockLimit && utcSeconds <= kClockLimit && sinceSheetEpoch >= -kSheetLimit &&
+           sinceSheetEpoch <= kSheetLimit;
+}
+
+// Proleptic Gregorian calendar arithmetic on days since 1970-01-01 (H. Hinnant's algorithms).
+std::int64_t daysFromCivil(std::int64_t year, unsigned month, unsigned day) {
+    year -= month <= 2;
+    const std::int64_t era = (year >= 0 ? year : year - 399) / 400;
+    const auto yearOfEra = static_cast<unsigned>(year - era * 400);
+    const unsigned dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    const unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + static_cast<std::int64_t>(dayOfEra) - 719468;
+}
+
+struct CivilDate {
+    std::int64_t year;
+    unsigned month;
+    unsigned day;
+};
+
+CivilDate civilFromDays(std::int64_t days) {
+    days += 719468;
+    const std::int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const auto dayOfEra = static_cast<unsigned>(days - era * 146097);
+    const unsigned yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    const unsigned dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    const unsigned shifted = (5 * dayOfYear + 2) / 153;
+    const unsigned day = dayOfYear - (153 * shifted + 2) / 5 + 1;
+    const unsigned month = shifted < 10 ? shifted + 3 : shifted - 9;
+    return {static_cast<std::int64_t>(yearOfEra) + era * 400 + (month <= 2), month, day};
+}
+
+std::int64_t floorDiv(std::int64_t value, std::int64_t divisor) {
+    auto quotient = value / divisor;
+    return (value % divisor != 0 && (value < 0) != (divisor < 0)) ? quotient - 1 : quotient;
+}
+
+// Local UTC offset in seconds at `utcSeconds`, straight from the C library.
+std::int64_t queryUtcOffset(std::int64_t utcSeconds) {
+    auto t = static_cast<std::time_t>(utcSeconds);
+    std::tm local{};
+#ifdef _WIN32
+    localtime_s(&local, &t);
+#else
+    localtime_r(&t, &local);
+#endif
+    auto localSeconds = daysFromCivil(local.tm_year + 1900, static_cast<unsigned>(local.tm_mon + 1),
+                                      static_cast<unsigned>(local.tm_mday)) *
+                            kSecondsPerDay +
+                        local.tm_hour * 3600 + local.tm_min * 60 + local.tm_sec;
+    return localSeconds - utcSeconds;
+}
+
+// Per-UTC-day cache of the local offset. A day holds at most one DST transition, so each entry is
+// the offset before and after it plus the instant it happens; days without one have equal offsets.
+// Lookups take a shared lock, and the C library is only consulted once per day seen.
+class UtcOffsetTable {
+public:
+    std::int64_t offsetAt(std::int64_t utcSeconds) {
+        auto day = floorDiv(utcSeconds, kSecondsPerDay);
+        auto entry = lookup(day);
+        return utcSeconds < entry.transitionAt ? entry.before : entry.after;
+    }
+
+private:
+    struct DayOffsets {
+        std::int64_t before;
+        std::int64_t after;
+        std::int64_t transitionAt;
+    };
+
+    DayOffsets lookup(std::int64_t day) {
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex_);
+            auto it = days_.find(day);
+            if (it != days_.end()) {
+                return it->second;
+            }
+        }
+        auto entry = compute(day);
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        days_.emplace(day, entry);
+        return entry;
+    }
+
+    static DayOffsets compute(std::int64_t day) {
+        auto dayStart = day * kSecondsPerDay;
+        auto dayEnd = dayStart + kSecondsPerDay;
+        DayOffsets entry{queryUtcOffset(dayStart), queryUtcOffset(dayEnd - 1), dayEnd};
+        if (entry.before != entry.after) {
+            // Binary search for the first second running on the new offset.
+            auto low = dayStart;
+            auto high = dayEnd - 1;
+            while (low + 1 < high) {
+                auto middle = low + (high - low) / 2;
+                if (queryUtcOffset(middle) == entry.before) {
+                    low = middle;
+                } else {
+                    high = middle;
+                }
+            }
+            entry.transitionAt = high;
+        }
+        return entry;
+    }
+
+    std::shared_mutex mutex_;
+    std::unordered_map<std::int64_t, DayOffsets> days_;
+};
+
+UtcOffsetTable &utcOffsets() {
+    static UtcOffsetTable table;
+    return table;
+}
 
-std::optional<std::chrono::system_clock::time_point> parseDateTime(const std::string &input) {
-    std::tm tm = {};
-    std::istringstream iss(input);
-    iss >> std::get_time(&tm, "%Y-%m-%d %H:%M");
-    if (iss.fail()) {
+// Converts local wall-clock seconds to UTC. Times repeated when clocks fall back resolve to the
+// earlier instant; times skipped when clocks spring forward are moved past the gap.
+std::int64_t localToUtc(std::int64_t localSeconds) {
+    auto &offsets = utcOffsets();
+    auto offsetBefore = offsets.offsetAt(localSeconds - kSecondsPerDay / 2);
+    auto offsetAfter = offsets.offsetAt(localSeconds + kSecondsPerDay / 2);
+    auto candidateBefore = localSeconds - offsetBefore;
+    auto candidateAfter = localSeconds - offsetAfter;
+    bool beforeValid = offsets.offsetAt(candidateBefore) == offsetBefore;
+    bool afterValid = offsets.offsetAt(candidateAfter) == offsetAfter;
+    if (beforeValid && afterValid) {
+        return std::min(candidateBefore, candidateAfter);
+    }
+    if (afterValid) {
+        return candidateAfter;
+    }
+    return candidateBefore;
+}
+
+// Reads between minDigits and maxDigits decimal digits starting at pos.
+bool readNumber(std::string_view text, size_t &pos, size_t minDigits, size_t maxDigits, unsigned &value) {
+    size_t digits = 0;
+    value = 0;
+    while (pos < text.size() && digits < maxDigits && text[pos] >= '0' && text[pos] <= '9') {
+        value = value * 10 + static_cast<unsigned>(text[pos] - '0');
+        ++pos;
+        ++digits;
+    }
+    return digits >= minDigits;
+}
+
+bool expect(std::string_view text, size_t &pos, char expected) {
+    if (pos >= text.size() || text[pos] != expected) {
+        return false;
+    }
+    ++pos;
+    return true;
+}
+
+unsigned daysInMonth(std::int64_t year, unsigned month) {
+    static constexpr unsigned kDays[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    return month == 2 && leap ? 29 : kDays[month - 1];
+}
+
+void writeDigits(char *out, unsigned value, int width) {
+    for (int i = width - 1; i >= 0; --i) {
+        out[i] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    }
+}
+}  // namespace
+
+std::optional<std::chrono::system_clock::time_point> parseDateTime(std::string_view input) {
+    while (!input.empty() && (input.front() == ' ' || input.front() == '\t')) {
+        input.remove_prefix(1);
+    }
+    while (!input.empty() && (input.back() == ' ' || input.back() == '\t')) {
+        input.remove_suffix(1);
+    }
+    size_t pos = 0;
+    unsigned year = 0;
+    unsigned month = 0;
+    unsigned day = 0;
+    unsigned hour = 0;
+    unsigned minute = 0;
+    if (!readNumber(input, pos, 4, 4, year) || !expect(input, pos, '-') || !readNumber(input, pos, 1, 2, month) ||
+        !expect(input, pos, '-') || !readNumber(input, pos, 1, 2, day) || !expect(input, pos, ' ') ||
+        !readNumber(input, pos, 1, 2, hour) || !expect(input, pos, ':') || !readNumber(input, pos, 1, 2, minute) ||
+        pos != input.size()) {
         return std::nullopt;
     }
-    auto tp = std::chrono::system_clock::from_time_t(std::mktime(&tm));
-    return tp;
+    if (month < 1 || month > 12 || day < 1 || day > daysInMonth(year, month) || hour > 23 || minute > 59) {
+        return std::nullopt;
+    }
+    auto localSeconds = daysFromCivil(year, month, day) * kSecondsPerDay + hour * 3600 + minute * 60;
+    auto utcSeconds = localToUtc(localSeconds);
+    if (!isRepresentableTime(utcSeconds)) {
+        return std::nullopt;
+    }
+    return std::chrono::system_clock::time_point(std::chrono::seconds(utcSeconds));
 }
 
-std::string formatDateTime(const std::chrono::system_clock::time_point &timePoint) {
-    std::time_t t = std::chrono::system_clock::to_time_t(timePoint);
-    std::tm tm = *std::localtime(&t);
-    std::ostringstream oss;
-    oss << std::put_time(&tm, "%Y-%m-%d %H:%M");
-    return oss.str();
+size_t formatDateTime(std::chrono::system_clock::time_point timePoint, char *buffer) {
+    auto utcSeconds = std::chrono::floor<std::chrono::seconds>(timePoint.time_since_epoch()).count();
+    auto localSeconds = utcSeconds + utcOffsets().offsetAt(utcSeconds);
+    auto days = floorDiv(localSeconds, kSecondsPerDay);
+    auto secondOfDay = static_cast<unsigned>(localSeconds - days * kSecondsPerDay);
+    auto date = civilFromDays(days);
+    writeDigits(buffer, static_cast<unsigned>(date.year), 4);
+    buffer[4] = '-';
+    writeDigits(buffer + 5, date.month, 2);
+    buffer[7] = '-';
+    writeDigits(buffer + 8, date.day, 2);
+    buffer[10] = ' ';
+    writeDigits(buffer + 11, secondOfDay / 3600, 2);
+    buffer[13] = ':';
+    writeDigits(buffer + 14, secondOfDay / 60 % 60, 2);
+    return kDateTimeTextLength;
 }
 
-std::string formatCurrency(double value) {
-    std::ostringstream oss;
-    oss << std::fixed << std::setprecision(2) << "$" << value;
-    return oss.str();
+std::string formatDateTime(std::chrono::system_clock::time_point timePoint) {
+    char buffer[kDateTimeTextLength];
+    return std::string(buffer, formatDateTime(timePoint, buffer));
+}
+
+LocalDateTime toLocalDateTime(std::chrono::system_clock::time_point timePoint) {
+    auto utcSeconds = std::chrono::floor<std::chrono::seconds>(timePoint.time_since_epoch()).count();
+    auto localSeconds = utcSeconds + utcOffsets().offsetAt(utcSeconds);
+    auto days = floorDiv(localSeconds, kSecondsPerDay);
+    auto date = civilFromDays(days);
+    LocalDateTime local;
+    local.year = date.year;
+    local.month = date.month;
+    local.day = date.day;
+    // 1970-01-01 was a Thursday.
+    auto fromSunday = days + 4;
+    local.weekday = static_cast<unsigned>(fromSunday - floorDiv(fromSunday, 7) * 7);
+    local.minuteOfDay = static_cast<unsigned>((localSeconds - days * kSecondsPerDay) / 60);
+    return local;
 }
 
+std::string Money::toString() const {
+    auto magnitude = cents_ < 0 ? -cents_ : cents_;
+    std::string text = cents_ < 0 ? "-" : "";
+    text += std::to_string(magnitude / 100);
+    text += '.';
+    text += static_cast<char>('0' + (magnitude % 100) / 10);
+    text += static_cast<char>('0' + magnitude % 10);
+    return text;
+}
+
+std::string formatCurrency(Money value) { return "$" + value.toString(); }
+
 }  // namespace booking
 
@@ -1,11 +1,22 @@
 #pragma once
 
+#include "Popularity.hpp"
+
+#include <array>
 #include <chrono>
+#include <cstdint>
+#include <deque>
 #include <functional>
+#include <initializer_list>
+#include <iosfwd>
+#include <map>
 #include <memory>
+#include <memory_resource>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <tuple>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -25,26 +36,68 @@ enum class ReservationStatus {
     Cancelled
 };
 
-class Permission {
+constexpr size_t kReservationStatusCount = 4;
+
+// Permissions are a closed, compile-time set so a role can hold them as a single bit mask.
+enum class Permission : std::uint8_t {
+    CreateReservation,
+    UpdateReservation,
+    RecordOrders,
+    ManageStaff,
+    ViewReports,
+    // Guest contact details and booking history.
+    ViewCustomers,
+    // Following the mutation log as a replica.
+    StreamReplication,
+    // Archiving the live day and opening the next one.
+    CloseDay,
+    Count
+};
+
+constexpr size_t kPermissionCount = static_cast<size_t>(Permission::Count);
+
+// Indexed by Permission; the names used in logs and the API.
+constexpr std::array<std::string_view, kPermissionCount> kPermissionNames = {
+    "CreateReservation", "UpdateReservation", "RecordOrders", "ManageStaff", "ViewReports", "ViewCustomers",
+    "StreamReplication", "CloseDay"};
+
+constexpr std::string_view permissionName(Permission permission) {
+    return kPermissionNames[static_cast<size_t>(permission)];
+}
+
+std::optional<Permission> parsePermission(std::string_view name);
+
+class PermissionSet {
 public:
-    explicit Permission(std::string name);
-    const std::string &getName() const;
+    constexpr PermissionSet() = default;
+    constexpr PermissionSet(std::initializer_list<Permission> permissions) {
+        for (auto permission : permissions) {
+            mask_ |= bit(permission);
+        }
+    }
+
+    constexpr bool contains(Permission permission) const { return (mask_ & bit(permission)) != 0; }
+    constexpr std::uint64_t getMask() const { return mask_; }
 
 private:
-    std::string name_;
+    static constexpr std::uint64_t bit(Permission permission) {
+        return std::uint64_t{1} << static_cast<unsigned>(permission);
+    }
+
+    std::uint64_t mask_ = 0;
 };
 
 class Role {
 public:
-    Role(std::string name, std::vector<Permission> permissions = {});
+    Role(std::string name, PermissionSet permissions = {});
 
     const std::string &getName() const;
-    const std::vector<Permission> &getPermissions() const;
-    bool hasPermission(const std::string &permission) const;
+    PermissionSet getPermissions() const;
+    bool hasPermission(Permission permission) const { return permissions_.contains(permission); }
 
 private:
     std::string name_;
-    std::vector<Permission> permissions_;
+    PermissionSet permissions_;
 };
 
 class Staff {
@@ -72,63 +125,234 @@ public:
     Manager(std::string name, std::string contact);
 };
 
+// Reservation, walk-in and order id packed into 32 bits: the prefix letter ('R', 'W', 'O') in the
+// top byte and the sequence number in the low 24 bits. Text such as "R1000" only exists at the API
+// boundary, produced by format() and read back by parse().
+class RecordId {
+public:
+    static constexpr size_t kMaxTextLength = 9;
+
+    constexpr RecordId() = default;
+    constexpr RecordId(char prefix, std::uint32_t number)
+        : value_((static_cast<std::uint32_t>(static_cast<unsigned char>(prefix)) << 24) | (number & kNumberMask)) {}
+
+    constexpr char getPrefix() const { return static_cast<char>(value_ >> 24); }
+    constexpr std::uint32_t getNumber() const { return value_ & kNumberMask; }
+    constexpr std::uint32_t getValue() const { return value_; }
+    constexpr bool isValid() const { return value_ != 0; }
+
+    // Writes the text form into `buffer` (kMaxTextLength bytes, not terminated) and returns its length.
+    size_t format(char *buffer) const;
+    std::string toString() const;
+    // Accepts a prefix letter followed by decimal digits; never throws.
+    static std::optional<RecordId> parse(std::string_view text);
+
+    friend constexpr bool operator==(RecordId lhs, RecordId rhs) { return lhs.value_ == rhs.value_; }
+    friend constexpr bool operator!=(RecordId lhs, RecordId rhs) { return lhs.value_ != rhs.value_; }
+    friend constexpr bool operator<(RecordId lhs, RecordId rhs) { return lhs.value_ < rhs.value_; }
+
+private:
+    static constexpr std::uint32_t kNumberMask = 0x00FFFFFF;
+
+    std::uint32_t value_ = 0;
+};
+
+std::ostream &operator<<(std::ostream &os, RecordId id);
+
+struct RecordIdHash {
+    size_t operator()(RecordId id) const noexcept { return std::hash<std::uint32_t>{}(id.getValue()); }
+};
+
+// Fixed-point amount in integer cents, so totals add up exactly.
+class Money {
+public:
+    constexpr Money() = default;
+
+    static constexpr Money fromCents(std::int64_t cents) { return Money(cents); }
+
+    constexpr std::int64_t getCents() const { return cents_; }
+    // Plain decimal text such as "24.50", suitable for JSON numbers.
+    std::string toString() const;
+
+    constexpr Money &operator+=(Money other) {
+        cents_ += other.cents_;
+        return *this;
+    }
+    constexpr Money &operator-=(Money other) {
+        cents_ -= other.cents_;
+        return *this;
+    }
+    friend constexpr Money operator+(Money lhs, Money rhs) { return lhs += rhs; }
+    friend constexpr Money operator-(Money lhs, Money rhs) { return lhs -= rhs; }
+    friend constexpr Money operator*(Money lhs, int factor) { return Money(lhs.cents_ * factor); }
+    friend constexpr bool operator==(Money lhs, Money rhs) { return lhs.cents_ == rhs.cents_; }
+    friend constexpr bool operator!=(Money lhs, Money rhs) { return lhs.cents_ != rhs.cents_; }
+    friend constexpr bool operator<(Money lhs, Money rhs) { return lhs.cents_ < rhs.cents_; }
+
+private:
+    constexpr explicit Money(std::int64_t cents) : cents_(cents) {}
+
+    std::int64_t cents_ = 0;
+};
+
+// Reservation times are kept as whole minutes since a fixed sheet epoch (2000-01-01 00:00 UTC).
+// 32 bits of minutes run out in the year 6083 (and 2083 years before the epoch); parseDateTime
+// rejects anything outside that range, so every accepted time converts exactly. These two
+// functions are the only conversions.
+using SheetMinutes = std::int32_t;
+SheetMinutes toSheetMinutes(std::chrono::system_clock::time_point timePoint);
+std::chrono::system_clock::time_point fromSheetMinutes(SheetMinutes minutes);
+
+using MenuItemId = std::uint32_t;
+constexpr MenuItemId kUnassignedMenuItemId = static_cast<MenuItemId>(-1);
+
 class MenuItem {
 public:
-    MenuItem(std::string name, std::string category, double price);
+    MenuItem(std::string name, std::string category, Money price);
 
+    MenuItemId getId() const;
     const std::string &getName() const;
     const std::string &getCategory() const;
-    double getPrice() const;
+    Money getPrice() const;
 
 private:
+    friend class Restaurant;
+
+    MenuItemId id_ = kUnassignedMenuItemId;
     std::string name_;
     std::string category_;
-    double price_{};
+    Money price_;
 };
 
+// One order line; the dish is referenced by id so lines never copy menu strings.
 class OrderItem {
 public:
-    OrderItem(MenuItem item, int quantity);
+    OrderItem(MenuItemId menuItemId, Money priceAtOrderTime, int quantity, SheetMinutes orderedAt);
 
-    const MenuItem &getItem() const;
+    MenuItemId getMenuItemId() const;
+    Money getPriceAtOrderTime() const;
     int getQuantity() const;
-    double getLineTotal() const;
+    Money getLineTotal() const;
+    std::chrono::system_clock::time_point getOrderedAt() const;
 
 private:
-    MenuItem item_;
+    MenuItemId menuItemId_;
     int quantity_{};
+    SheetMinutes orderedAt_;
+    Money priceAtOrderTime_;
 };
 
+// Day records (Order, Customer, Reservation) are allocator-aware so a BookingSheet can place
+// them and their strings in its per-day arena.
+using RecordAllocator = std::pmr::polymorphic_allocator<char>;
+
 class Order {
 public:
-    Order(std::string id, std::string reservationId);
+    using allocator_type = RecordAllocator;
+
+    Order(RecordId id, RecordId reservationId, const allocator_type &allocator = {});
+    Order(const Order &other, const allocator_type &allocator = {});
+    Order(Order &&other) noexcept = default;
+    Order(Order &&other, const allocator_type &allocator);
+    Order &operator=(const Order &other) = default;
+    Order &operator=(Order &&other) = default;
 
-    const std::string &getId() const;
-    const std::string &getReservationId() const;
-    void addItem(const MenuItem &item, int quantity);
-    const std::vector<OrderItem> &getItems() const;
-    double calculateTotal() const;
+    RecordId getId() const;
+    RecordId getReservationId() const;
+    const std::pmr::vector<OrderItem> &getItems() const;
+    // Running total maintained as lines are added.
+    Money getTotal() const;
 
 private:
-    std::string id_;
-    std::string reservationId_;
-    std::vector<OrderItem> items_;
+    friend class BookingSheet;
+
+    // Lines are added through BookingSheet so the sheet's bill aggregates stay in step.
+    void addItem(const OrderItem &item);
+
+    RecordId id_;
+    RecordId reservationId_;
+    std::pmr::vector<OrderItem> items_;
+    Money total_;
+};
+
+// Running bill for one reservation across all of its orders.
+struct ReservationBill {
+    int orderCount = 0;
+    Money total;
 };
 
 class Customer {
 public:
-    Customer(std::string name, std::string phone, std::string email = {}, std::string preference = {});
+    using allocator_type = RecordAllocator;
+
+    Customer(std::string_view name,
+             std::string_view phone,
+             std::string_view email = {},
+             std::string_view preference = {},
+             const allocator_type &allocator = {});
+    Customer(const Customer &other, const allocator_type &allocator = {});
+    Customer(Customer &&other) noexcept = default;
+    Customer(Customer &&other, const allocator_type &allocator);
+    Customer &operator=(const Customer &other) = default;
+    Customer &operator=(Customer &&other) = default;
+
+    std::string_view getName() const;
+    std::string_view getPhone() const;
+    std::string_view getEmail() const;
+    std::string_view getPreference() const;
 
-    const std::string &getName() const;
-    const std::string &getPhone() const;
-    const std::string &getEmail() const;
-    const std::string &getPreference() const;
+private:
+    std::pmr::string name_;
+    std::pmr::string phone_;
+    std::pmr::string email_;
+    std::pmr::string preference_;
+};
+
+using CustomerId = std::uint32_t;
+
+// Guests deduplicated by normalized phone number, each with an index of their reservations.
+class CustomerDirectory {
+public:
+    using allocator_type = RecordAllocator;
+
+    explicit CustomerDirectory(const allocator_type &allocator = {});
+    // byPhone_ views into phoneKeys_, which a copy would not carry along.
+    CustomerDirectory(const CustomerDirectory &) = delete;
+    CustomerDirectory &operator=(const CustomerDirectory &) = delete;
+    CustomerDirectory(CustomerDirectory &&) = default;
+
+    // Returns the id registered for the customer's phone, creating the entry on first sight. An
+    // existing entry keeps its name; when the names agree it takes the new email/preference if
+    // they are non-empty. A phone without digits is never matched: each such booking gets a
+    // customer of its own that findByPhone does not return.
+    CustomerId upsert(const Customer &customer);
+    // Stores `customer` under `id` as another directory decided it, replacing the entry or adding
+    // it when `id` is the next one. False when `id` is further on, or the phone belongs to
+    // another entry.
+    bool restore(CustomerId id, const Customer &customer);
+    const Customer &get(CustomerId id) const;
+    std::optional<CustomerId> findByPhone(std::string_view phone) const;
+    size_t size() const;
+
+    // Adding an id the customer already lists is a no-op, so sheets rebuilt from one another can
+    // replay their reservations into a directory they share.
+    void addReservation(CustomerId id, RecordId reservationId);
+    void removeReservation(CustomerId id, RecordId reservationId);
+    const std::pmr::vector<RecordId> &getReservationIds(CustomerId id) const;
+
+    // Keeps only the digits, so "138-0000 1111" and "13800001111" are the same guest. Empty when
+    // the phone has no digits.
+    static std::string normalizePhone(std::string_view phone);
 
 private:
-    std::string name_;
-    std::string phone_;
-    std::string email_;
-    std::string preference_;
+    CustomerId append(const Customer &customer, const std::string &key);
+
+    std::pmr::deque<Customer> customers_;
+    // Normalized phone per customer (empty when unindexed); a deque so the views held by byPhone_
+    // stay valid.
+    std::pmr::deque<std::pmr::string> phoneKeys_;
+    std::pmr::deque<std::pmr::vector<RecordId>> reservationIds_;
+    std::pmr::unordered_map<std::string_view, CustomerId> byPhone_;
 };
 
 class Table {
@@ -148,108 +372,321 @@ private:
     TableStatus status_ = TableStatus::Free;
 };
 
+// The longest seating (and slot search step) the sheet accepts. Keeping durations to a day keeps
+// start + duration and the slot sweep's bounds well inside SheetMinutes.
+constexpr int kMaxSeatingDurationMinutes = 24 * 60;
+
+class ReservationEdit;
+
 class Reservation {
 public:
-    Reservation(std::string id,
-                Customer customer,
+    using allocator_type = RecordAllocator;
+    // Tables pushed together for the party; the first is the one reported as getTableId().
+    using TableIdList = std::pmr::vector<int>;
+
+    Reservation(RecordId id,
+                CustomerId customerId,
                 int partySize,
                 std::chrono::system_clock::time_point time,
                 std::chrono::minutes duration,
-                std::string notes = {});
-
-    const std::string &getId() const;
-    const Customer &getCustomer() const;
+                std::string_view notes = {},
+                const allocator_type &allocator = {});
+    Reservation(const Reservation &other, const allocator_type &allocator = {});
+    Reservation(Reservation &&other) noexcept = default;
+    Reservation(Reservation &&other, const allocator_type &allocator);
+    Reservation &operator=(const Reservation &other) = default;
+    Reservation &operator=(Reservation &&other) = default;
+
+    RecordId getId() const;
+    CustomerId getCustomerId() const;
     int getPartySize() const;
     ReservationStatus getStatus() const;
     std::chrono::system_clock::time_point getDateTime() const;
     std::chrono::minutes getDuration() const;
-    const std::string &getNotes() const;
+    std::string_view getNotes() const;
     std::optional<int> getTableId() const;
+    const TableIdList &getTableIds() const;
+    bool usesTable(int tableId) const;
     std::chrono::system_clock::time_point getLastModified() const;
-
-    void assignTable(int tableId);
-    void clearTable();
-    void updateStatus(ReservationStatus status);
-    void setCustomer(Customer customer);
-    void setPartySize(int partySize);
-    void setDateTime(std::chrono::system_clock::time_point time);
-    void setDuration(std::chrono::minutes duration);
-    void setNotes(const std::string &notes);
-    void markSeated();
-    void markCompleted();
-    void cancel();
+    // Goes up by one with every edit, table assignment included; clients compare it to detect
+    // lost updates.
+    std::uint32_t getVersion() const;
     std::chrono::system_clock::time_point getEndTime() const;
+    SheetMinutes getStartMinutes() const;
+    SheetMinutes getEndMinutes() const;
 
 private:
-    std::string id_;
-    Customer customer_;
+    // All changes go through BookingSheet, which keeps its table availability index in step.
+    friend class BookingSheet;
+    friend class ReservationEdit;
+
+    // Starts a multi-field update; see ReservationEdit.
+    ReservationEdit edit();
+
+    RecordId id_;
+    CustomerId customerId_;
     int partySize_;
-    std::chrono::system_clock::time_point time_;
-    std::chrono::minutes duration_;
+    SheetMinutes start_;
+    SheetMinutes durationMinutes_;
+    SheetMinutes lastModified_;
     ReservationStatus status_ = ReservationStatus::Open;
-    std::optional<int> tableId_;
-    std::string notes_;
-    std::chrono::system_clock::time_point lastModified_;
+    std::uint32_t version_ = 1;
+    TableIdList tableIds_;
+    std::pmr::string notes_;
+};
+
+// Groups changes to one reservation into a single logical update: lastModified is stamped and the
+// version bumped once, when the edit goes out of scope, and only if something was changed.
+class ReservationEdit {
+public:
+    ReservationEdit(const ReservationEdit &) = delete;
+    ReservationEdit &operator=(const ReservationEdit &) = delete;
+    ~ReservationEdit();
+
+    ReservationEdit &setCustomerId(CustomerId customerId);
+    ReservationEdit &setPartySize(int partySize);
+    ReservationEdit &setDateTime(std::chrono::system_clock::time_point time);
+    ReservationEdit &setDuration(std::chrono::minutes duration);
+    ReservationEdit &setNotes(std::string_view notes);
+    ReservationEdit &setStatus(ReservationStatus status);
+    ReservationEdit &setTables(const std::vector<int> &tableIds);
+    ReservationEdit &clearTables();
+
+private:
+    friend class Reservation;
+    explicit ReservationEdit(Reservation &reservation);
+
+    Reservation &reservation_;
+    bool changed_ = false;
+};
+
+// Guests seated and revenue billed for the reservations starting in one 15-minute slot.
+struct ReportBucket {
+    std::chrono::system_clock::time_point start;
+    int covers = 0;
+    Money revenue;
+};
+
+// Slice of the per-reservation breakdown to include in a report; the default leaves it out.
+struct ReportPage {
+    size_t offset = 0;
+    size_t limit = 0;
 };
 
 class Report {
 public:
+    using StatusCounts = std::array<int, kReservationStatusCount>;
+
     Report(std::string date,
-           int totalReservations,
+           StatusCounts reservationsByStatus,
            int seatedGuests,
-           double revenue,
-           std::vector<std::tuple<std::string, ReservationStatus>> reservationBreakdown);
+           Money revenue,
+           std::vector<ReportBucket> series,
+           std::vector<std::tuple<RecordId, ReservationStatus>> reservationBreakdown,
+           size_t breakdownOffset);
 
     const std::string &getDate() const;
     int getTotalReservations() const;
+    int getReservationCount(ReservationStatus status) const;
     int getSeatedGuests() const;
-    double getRevenue() const;
-    const std::vector<std::tuple<std::string, ReservationStatus>> &getReservationBreakdown() const;
+    Money getRevenue() const;
+    // Only slots with guests or revenue, in time order.
+    const std::vector<ReportBucket> &getSeries() const;
+    const std::vector<std::tuple<RecordId, ReservationStatus>> &getReservationBreakdown() const;
+    // Position of the breakdown's first entry among all reservations.
+    size_t getBreakdownOffset() const;
     std::string summary() const;
 
 private:
     std::string date_;
-    int totalReservations_{};
+    StatusCounts reservationsByStatus_{};
     int seatedGuests_{};
-    double revenue_{};
-    std::vector<std::tuple<std::string, ReservationStatus>> reservationBreakdown_;
+    Money revenue_;
+    std::vector<ReportBucket> series_;
+    std::vector<std::tuple<RecordId, ReservationStatus>> reservationBreakdown_;
+    size_t breakdownOffset_ = 0;
+};
+
+// A walk-in party queued for a table, in arrival order.
+struct WaitlistEntry {
+    RecordId id;
+    CustomerId customerId = 0;
+    int partySize = 0;
+    SheetMinutes joinedAt = 0;
+    std::string notes;
+};
+
+// Result of admitting a walk-in: seated straight away, queued on the waitlist, or turned away
+// when no set of tables on the floor could ever seat the party.
+struct WalkInOutcome {
+    Reservation *reservation = nullptr;
+    std::optional<RecordId> waitlistId;
+    bool turnedAway = false;
+};
+
+struct WaitEstimate {
+    // Queued parties ahead that need the same size of table, or, for a party no single table
+    // holds, that also need tables pushed together.
+    size_t partiesAhead = 0;
+    // Empty when no set of tables in service can seat the party.
+    std::optional<std::chrono::minutes> wait;
+};
+
+// A start time at which a party can be seated, with the tables it would get.
+struct AvailableSlot {
+    std::chrono::system_clock::time_point time;
+    std::vector<int> tableIds;
+};
+
+// One booked interval on a table; a table's schedule is kept sorted by start.
+struct TableBooking {
+    SheetMinutes start;
+    SheetMinutes end;
+    RecordId reservationId;
+};
+
+// Building blocks of the sheet's availability index, shared with the table optimizer, which
+// plans on copies of the schedules away from the sheet.
+bool isScheduleFree(const std::vector<TableBooking> &schedule,
+                    SheetMinutes start,
+                    SheetMinutes end,
+                    std::optional<RecordId> ignoreReservationId = std::nullopt);
+void insertTableBooking(std::vector<TableBooking> &schedule, const TableBooking &booking);
+// Positions of the cheapest connected set of free tables that seats the party, ranked as in
+// BookingSheet::findAvailableTableSet; empty when nothing fits.
+std::vector<size_t> findTableSetPositions(const std::vector<Table> &tables,
+                                          const std::vector<std::vector<size_t>> &neighbours,
+                                          const std::vector<char> &free,
+                                          int partySize);
+
+// Copy of the floor and its bookings, taken under the sheet's lock so the table optimizer can
+// plan without holding it.
+struct TablePlanSnapshot {
+    struct Party {
+        RecordId reservationId;
+        int partySize = 0;
+        SheetMinutes start = 0;
+        SheetMinutes end = 0;
+        std::vector<int> tableIds;
+        // Open and not due yet, so the party may still be given other tables.
+        bool movable = false;
+    };
+
+    SheetMinutes now = 0;
+    std::vector<Table> tables;
+    std::vector<std::vector<size_t>> neighbours;
+    std::vector<Party> parties;
+};
+
+// Gives one reservation other tables. Also records what the plan assumed about the reservation,
+// so a move that later edits have outdated is recognised and skipped.
+struct TableMove {
+    RecordId reservationId;
+    int partySize = 0;
+    SheetMinutes start = 0;
+    SheetMinutes end = 0;
+    std::vector<int> fromTableIds;
+    std::vector<int> toTableIds;
 };
 
+// One service day. Every reservation, order and their strings live in the sheet's monotonic
+// arena, so a day's data is laid out contiguously and is released in one shot when the sheet
+// is retired (destroyed). Memory of deleted records is only reclaimed at that point: for the live
+// day when Restaurant::rollOver rebuilds its records in new sheets, for an archived day once the
+// restaurant's archive retention lets it go.
 class BookingSheet {
 public:
+    friend class Restaurant;
+
+    using ReservationList = std::pmr::deque<Reservation>;
+    using OrderList = std::pmr::deque<Order>;
+
     explicit BookingSheet(std::string date);
+    BookingSheet(BookingSheet &&other) noexcept = default;
+    // Assigning would free this sheet's arena while its records still point into it.
+    BookingSheet &operator=(BookingSheet &&other) = delete;
 
     const std::string &getDate() const;
     std::vector<Table> &getTables();
     const std::vector<Table> &getTables() const;
-    const std::vector<Reservation> &getReservations() const;
-    const std::vector<Order> &getOrders() const;
+    const ReservationList &getReservations() const;
+    const OrderList &getOrders() const;
+    const CustomerDirectory &getCustomers() const;
+    const Customer &getCustomer(const Reservation &reservation) const;
 
     void addTable(const Table &table);
+    // Records that two tables stand next to each other and can be pushed together for one party.
+    bool joinTables(int firstTableId, int secondTableId);
+    std::vector<int> getAdjacentTableIds(int tableId) const;
     std::optional<int> findAvailableTableId(int partySize,
                                             std::chrono::system_clock::time_point time,
                                             std::chrono::minutes duration,
-                                            const std::optional<std::string> &ignoreReservationId = std::nullopt) const;
+                                            std::optional<RecordId> ignoreReservationId = std::nullopt) const;
     std::vector<int> findAllAvailableTableIds(int partySize,
                                               std::chrono::system_clock::time_point time,
                                               std::chrono::minutes duration,
-                                              const std::optional<std::string> &ignoreReservationId = std::nullopt) const;
+                                              std::optional<RecordId> ignoreReservationId = std::nullopt) const;
+    // Cheapest set of adjacent tables (a single table included) that are jointly free and seat
+    // the party: fewest empty seats first, then fewest tables. Empty when nothing fits.
+    std::vector<int> findAvailableTableSet(int partySize,
+                                           std::chrono::system_clock::time_point time,
+                                           std::chrono::minutes duration,
+                                           std::optional<RecordId> ignoreReservationId = std::nullopt) const;
+
+    // Earliest start times in [from, to] at which the party can be seated for `duration`, at most
+    // `limit` of them, on a `step` grid (a shorter opening between grid points is reported at its
+    // own start). Sweeps the free gaps in the table schedules instead of probing each time. Empty
+    // when `duration` or `step` is not in [1, kMaxSeatingDurationMinutes].
+    std::vector<AvailableSlot> findAvailableSlots(int partySize,
+                                                  std::chrono::system_clock::time_point from,
+                                                  std::chrono::system_clock::time_point to,
+                                                  std::chrono::minutes duration,
+                                                  size_t limit,
+                                                  std::chrono::minutes step = std::chrono::minutes(15)) const;
 
     Reservation &createReservation(const Customer &customer,
                                    int partySize,
                                    std::chrono::system_clock::time_point time,
                                    std::chrono::minutes duration,
                                    const std::string &notes = {});
-    Reservation &recordWalkIn(const Customer &customer, int partySize, const std::string &notes = {});
-    bool autoAssignTable(const std::string &id);
-    bool assignTable(const std::string &id, int tableId);
-    bool clearTableAssignment(const std::string &id);
-    Order &recordOrder(const std::string &reservationId);
-    Reservation *findReservationById(const std::string &id);
-    const Reservation *findReservationById(const std::string &id) const;
-    Order *findOrderById(const std::string &id);
-    bool deleteReservation(const std::string &id);
-    bool updateReservationDetails(const std::string &id,
+    // Seats a walk-in party if tables are free now, otherwise queues it. Queued parties are seated
+    // automatically, oldest first, whenever a change on the sheet frees tables; a party that does
+    // not fit yet lets smaller parties behind it go ahead. A party too large for any set of
+    // adjacent tables on the floor is turned away rather than queued for good.
+    WalkInOutcome admitWalkIn(const Customer &customer, int partySize, const std::string &notes = {});
+    const std::deque<WaitlistEntry> &getWaitlist() const;
+    bool leaveWaitlist(RecordId id);
+    // Seats queued parties at the tables free now, as changes on the sheet do. Tables also come
+    // free as seatings run out, with nothing changing, so call this periodically as well.
+    void seatWaitingParties();
+    // Wait for a party joining the back of the queue now.
+    WaitEstimate estimateWait(int partySize) const;
+    // Estimates for every queued party, in queue order.
+    std::vector<WaitEstimate> estimateWaitlist() const;
+    bool autoAssignTable(RecordId id);
+    bool assignTable(RecordId id, int tableId);
+    bool assignTables(RecordId id, const std::vector<int> &tableIds);
+    bool clearTableAssignment(RecordId id);
+    TablePlanSnapshot snapshotTablePlan() const;
+    // Applies the moves still valid on the current sheet and returns them. The batch is tried as a
+    // whole first, so parties can trade tables; if anything booked since the snapshot is in the
+    // way, each move is applied on its own where it still fits.
+    std::vector<TableMove> applyTableMoves(const std::vector<TableMove> &moves);
+    // Cancelling also releases the reservation's tables.
+    bool updateReservationStatus(RecordId id, ReservationStatus status);
+    Order &recordOrder(RecordId reservationId);
+    bool addOrderItem(RecordId orderId, const MenuItem &item, int quantity);
+    ReservationBill getReservationBill(RecordId reservationId) const;
+    Money getRevenue() const;
+    // Most ordered dishes over the last `window`, fed by addOrderItem as lines come in. The
+    // tracker passes to the next day's sheet at Restaurant::rollOver, so the window runs on
+    // across midnight.
+    std::vector<DishCount> getPopularDishes(size_t limit, std::chrono::minutes window) const;
+    Reservation *findReservationById(RecordId id);
+    const Reservation *findReservationById(RecordId id) const;
+    Order *findOrderById(RecordId id);
+    bool deleteReservation(RecordId id);
+    bool updateReservationDetails(RecordId id,
                                   const Customer &customer,
                                   int partySize,
                                   std::chrono::system_clock::time_point time,
@@ -257,64 +694,253 @@ public:
                                   const std::string &notes,
                                   std::optional<int> requestedTable,
                                   bool tableSpecified);
-    bool cancelReservation(const std::string &id);
+    bool cancelReservation(RecordId id);
     void updateTableStatuses();
+    // The same, as of `now` instead of the wall clock.
+    void updateTableStatuses(std::chrono::system_clock::time_point now);
     void updateDisplay(const std::function<void(const Reservation &)> &callback) const;
-    Report generateReport() const;
+    // Totals and the time series are kept up to date on every change, so only the requested
+    // breakdown page costs more than O(1) beyond copying the series.
+    Report generateReport(ReportPage breakdownPage = {}) const;
+
+    // Replication. From beginChangeCapture on, the sheet notes every record its calls change;
+    // takeChanges stops noting and returns the current state of those records as text, empty when
+    // nothing changed. applyChanges writes such text into a copy of the sheet as is: it reads no
+    // clock and makes no decisions of its own, so the copy ends up exactly like the original. It
+    // returns false, possibly half way through, when the text does not fit this sheet. Order lines
+    // name dishes by id in `menu`, which must be the menu the original was run with.
+    void beginChangeCapture();
+    std::string takeChanges();
+    bool applyChanges(std::string_view changes, const std::vector<MenuItem> &menu);
+    // Every record on the sheet, as changes that rebuild it on an emptyCopy. Customers are not
+    // among them: they live in the directory the sheet shares, which Restaurant::exportState
+    // writes out once for all its days.
+    std::string exportRecords() const;
+    // A sheet for `date` with this sheet's tables, adjacency, id counters and customer directory,
+    // and no records. Reservations booked on it join their customers' lists in the shared
+    // directory, and take ids this sheet has not handed out yet.
+    BookingSheet emptyCopy(std::string date) const;
+    // An emptyCopy holding the reservations `keep` selects, with their orders and bills. The
+    // waitlist is left behind.
+    BookingSheet copyWhere(std::string date,
+                           const std::function<bool(const Reservation &)> &keep,
+                           const std::vector<MenuItem> &menu) const;
 
 private:
+    // What has changed since beginChangeCapture.
+    struct ChangeCapture {
+        std::vector<CustomerId> customers;
+        // In the order first touched, each with whether it existed before the capture began.
+        std::vector<std::pair<RecordId, bool>> reservations;
+        // Waitlist and order lines are never edited once written, so they are kept as text.
+        std::string waitlist;
+        std::string orders;
+        std::array<std::uint32_t, 4> counters{};
+    };
+
+    std::array<std::uint32_t, 4> counters() const;
+    // emptyCopy onto `customers` instead of this sheet's directory.
+    BookingSheet emptyCopy(std::string date, std::shared_ptr<CustomerDirectory> customers) const;
+    // exportRecords limited to the reservations `keep` selects and their orders.
+    std::string exportRecords(const std::function<bool(const Reservation &)> &keep, bool withWaitlist) const;
     Table *getTableById(int id);
     const Table *getTableById(int id) const;
-    bool isTableAvailable(int tableId,
-                          std::chrono::system_clock::time_point time,
-                          std::chrono::minutes duration,
-                          const std::optional<std::string> &ignoreReservationId = std::nullopt) const;
-    Reservation &createReservationRecord(std::string id,
-                                         const Customer &customer,
+    std::optional<size_t> findTablePosition(int tableId) const;
+    bool isSlotFree(size_t position, SheetMinutes start, SheetMinutes end, std::optional<RecordId> ignoreReservationId) const;
+    bool canSeat(const std::vector<int> &tableIds,
+                 int partySize,
+                 SheetMinutes start,
+                 SheetMinutes end,
+                 std::optional<RecordId> ignoreReservationId) const;
+    void indexReservation(const Reservation &reservation);
+    void unindexReservation(const Reservation &reservation);
+    void removeBooking(size_t position, RecordId reservationId);
+    // Adds (+1) or withdraws (-1) one reservation's share of the report totals. Called around every
+    // change to a reservation's status, party size or time, and on creation and deletion.
+    void tallyReservation(const Reservation &reservation, int sign);
+    void addToReportBucket(SheetMinutes start, int covers, Money revenue);
+    void setTables(Reservation &reservation, const std::vector<int> &tableIds);
+    Reservation &createReservationRecord(RecordId id,
+                                         CustomerId customerId,
                                          int partySize,
                                          std::chrono::system_clock::time_point time,
                                          std::chrono::minutes duration,
-                                         const std::string &notes);
-    std::string formatNumberedId(char prefix, int number) const;
+                                         const std::string &notes,
+                                         const std::vector<int> &tableIds);
+    Reservation &seatWalkIn(CustomerId customerId,
+                            int partySize,
+                            const std::string &notes,
+                            std::chrono::system_clock::time_point now,
+                            const std::vector<int> &tableIds);
+    // deleteReservation without seating waiting parties in the freed tables.
+    void eraseReservation(RecordId id);
+    void appendOrderItem(Order &order, const OrderItem &item, const std::string &dishName);
+    void noteCustomer(CustomerId id);
+    void noteReservation(RecordId id);
+    bool applyChange(const std::vector<std::string> &fields, const std::vector<MenuItem> &menu);
+    bool applyReservation(const std::vector<std::string> &fields);
+    // Index into capacityClasses_; capacityClasses_.size() for parties no single table holds.
+    size_t waitClassOf(int partySize) const;
+    void refreshWaitTimelines() const;
+    WaitEstimate estimateFor(size_t waitClass, size_t partiesAhead, SheetMinutes now) const;
+    // Estimates for parties no single table holds, given in queue order.
+    std::vector<WaitEstimate> estimateJoinedWaits(const std::vector<int> &partySizes) const;
+    bool canEverSeat(int partySize) const;
+    void reindexReservations();
+    void reindexOrders();
 
     std::string date_;
     std::vector<Table> tables_;
-    std::vector<Reservation> reservations_;
-    std::vector<Order> orders_;
-    int nextReservationNumber_ = 1000;
-    int nextWalkInNumber_ = 5000;
-    int nextOrderNumber_ = 1;
+    // Availability index and floor graph, both by position in tables_. A schedule holds every
+    // active (not cancelled or completed) reservation at that table, so overlap checks are a
+    // binary search.
+    std::unordered_map<int, size_t> tablePositions_;
+    std::vector<std::vector<TableBooking>> tableSchedules_;
+    std::vector<std::vector<size_t>> tableNeighbours_;
+    std::deque<WaitlistEntry> waitlist_;
+    // Distinct table capacities, ascending; a party's wait class is the smallest that holds it.
+    std::vector<int> capacityClasses_;
+    std::vector<size_t> waitingPerClass_ = std::vector<size_t>(1, 0);
+    // Per wait class, the sorted times at which each table of at least that capacity can next
+    // take a full seating. Derived from the schedules; rebuilt lazily when they change or the
+    // clock moves on. The sheet is externally synchronised, so the cache needs no lock.
+    mutable std::vector<std::vector<SheetMinutes>> waitTimelines_;
+    // The same per table, by position; the maximum for tables out of service.
+    mutable std::vector<SheetMinutes> tableFreeAt_;
+    mutable SheetMinutes waitTimelinesBuiltAt_ = 0;
+    mutable bool waitTimelinesDirty_ = true;
+    // Declared before the record lists so it outlives them; held by pointer so moves keep it in place.
+    std::unique_ptr<std::pmr::monotonic_buffer_resource> arena_;
+    ReservationList reservations_;
+    OrderList orders_;
+    // Shared with the restaurant's other days: emptyCopy hands it on, so customer ids and each
+    // customer's reservation list span the live and archived sheets. Kept out of the arena,
+    // which goes with this sheet.
+    std::shared_ptr<CustomerDirectory> customers_;
+    // Positions in reservations_/orders_; rebuilt after the rare deletions that shift records.
+    std::unordered_map<RecordId, size_t, RecordIdHash> reservationIndex_;
+    std::unordered_map<RecordId, size_t, RecordIdHash> orderIndex_;
+    std::unordered_map<RecordId, ReservationBill, RecordIdHash> bills_;
+    Money revenue_;
+    struct BucketTotals {
+        int covers = 0;
+        Money revenue;
+    };
+    // Report aggregates; see tallyReservation. Buckets are keyed by slot start and dropped once
+    // they fall back to zero.
+    Report::StatusCounts reservationsByStatus_{};
+    int seatedGuests_ = 0;
+    std::map<SheetMinutes, BucketTotals> reportBuckets_;
+    DishPopularity popularity_;
+    std::uint32_t nextReservationNumber_ = 1000;
+    std::uint32_t nextWalkInNumber_ = 5000;
+    std::uint32_t nextOrderNumber_ = 1;
+    std::uint32_t nextWaitlistNumber_ = 1;
+    // Set between beginChangeCapture and takeChanges.
+    std::optional<ChangeCapture> capture_;
 };
 
 class Restaurant {
 public:
     Restaurant(std::string name, std::string address, BookingSheet bookingSheet);
+    // The menu index holds views into this object's own menu, so copies are not allowed.
+    Restaurant(const Restaurant &) = delete;
+    Restaurant &operator=(const Restaurant &) = delete;
+    Restaurant(Restaurant &&) = default;
 
     const std::string &getName() const;
     const std::string &getAddress() const;
     BookingSheet &getBookingSheet();
     const BookingSheet &getBookingSheet() const;
 
-    void addMenuItem(const MenuItem &item);
+    // Assigns the item its id; ids are positions in getMenu() and stay stable.
+    MenuItemId addMenuItem(const MenuItem &item);
     const std::vector<MenuItem> &getMenu() const;
-    const MenuItem *findMenuItem(const std::string &name) const;
+    const MenuItem *findMenuItem(std::string_view name) const;
+    const MenuItem *findMenuItem(MenuItemId id) const;
 
     void addStaff(std::shared_ptr<Staff> staff);
     const std::vector<std::shared_ptr<Staff>> &getStaff() const;
-
-    Report generateDailyReport() const;
+    // Generates a random access token for one of this restaurant's staff; a member may hold several.
+    std::string issueStaffToken(const Staff &staff);
+    const Staff *findStaffByToken(const std::string &token) const;
+
+    Report generateDailyReport(ReportPage breakdownPage = {}) const;
+
+    // Change capture on the live sheet; see BookingSheet::beginChangeCapture. A rollover in
+    // between is part of the changes, so applyChanges closes the day at the same point.
+    void beginChangeCapture();
+    std::string takeChanges();
+    bool applyChanges(std::string_view changes);
+    // The customer directory the days share, then the archived sheets and the live sheet with
+    // their dates and records. installState replaces them all with ones rebuilt from such text on
+    // this restaurant's floor, and leaves them alone when the text does not fit.
+    std::string exportState() const;
+    bool installState(std::string_view state);
+
+    // Closes the live day and opens `nextDate` ("YYYY-MM-DD"). Reservations that started before
+    // its midnight and are done with, completed, cancelled, or open with their seating over by
+    // then, are archived with their orders. Seated parties and everything still to come move to
+    // the new sheet with their orders and bills. Both keep every customer and the id counters,
+    // and the waitlist is dropped. False when `nextDate` is not a date after the live one.
+    bool rollOver(const std::string &nextDate);
+
+    // Closed days kept for analytics, oldest first. Archived sheets are never modified, and
+    // analytics scans share them, so a scan running without the restaurant's lock keeps its days.
+    // The customer directory is shared by every day and is not theirs to read: its reservation
+    // lists change with the live sheet. archiveSheet takes a sheet made by emptyCopy of the live
+    // one, so its guests are in the directory, and moves the live counters past the ids it used;
+    // false, and nothing archived, for any other sheet.
+    bool archiveSheet(BookingSheet sheet);
+    const std::deque<std::shared_ptr<const BookingSheet>> &getArchivedSheets() const;
+    // Keeps at most `days` archived sheets, retiring the oldest as days are archived; each is
+    // freed, arena and all, once no analytics scan still holds it. 0, the default, keeps all.
+    void setArchiveRetention(size_t days);
+    // The live or retained archived sheet that holds the reservation, or null.
+    const BookingSheet *findSheetHolding(RecordId reservationId) const;
 
 private:
     std::string name_;
     std::string address_;
-    BookingSheet bookingSheet_;
+    // Held by pointer so installState and rollOver can swap in a new sheet.
+    std::unique_ptr<BookingSheet> bookingSheet_;
+    std::deque<std::shared_ptr<const BookingSheet>> archivedSheets_;
+    size_t archiveRetention_ = 0;
+    // Set between beginChangeCapture and takeChanges; holds what the sheets closed by rollOver
+    // in between changed, each followed by its D line.
+    bool capturing_ = false;
+    std::string capturedChanges_;
+    void rebuildMenuIndex();
+    void closeDay(std::string nextDate, SheetMinutes midnight);
+    void retireArchivedSheets();
+
     std::vector<MenuItem> menu_;
+    // Views into menu_ names, rebuilt whenever the menu changes.
+    std::unordered_map<std::string_view, MenuItemId> menuIndex_;
     std::vector<std::shared_ptr<Staff>> staff_;
+    std::unordered_map<std::string, const Staff *> staffTokens_;
 };
 
-std::optional<std::chrono::system_clock::time_point> parseDateTime(const std::string &input);
-std::string formatDateTime(const std::chrono::system_clock::time_point &timePoint);
-std::string formatCurrency(double value);
+// Local "YYYY-MM-DD HH:MM" text. Both directions are thread-safe and use a cached per-day UTC
+// offset table, so they only reach the C library's time zone code once per calendar day.
+constexpr size_t kDateTimeTextLength = 16;
+// Empty for malformed text, and for times SheetMinutes or system_clock cannot hold with a week
+// to spare; with a nanosecond clock the latter limits input to about 1678 through 2262.
+std::optional<std::chrono::system_clock::time_point> parseDateTime(std::string_view input);
+// Writes exactly kDateTimeTextLength characters (no terminator) and returns that count.
+size_t formatDateTime(std::chrono::system_clock::time_point timePoint, char *buffer);
+std::string formatDateTime(std::chrono::system_clock::time_point timePoint);
+// Local calendar fields of an instant, from the same offset table.
+struct LocalDateTime {
+    std::int64_t year = 0;
+    unsigned month = 0;
+    unsigned day = 0;
+    // 0 is Sunday.
+    unsigned weekday = 0;
+    unsigned minuteOfDay = 0;
+};
+LocalDateTime toLocalDateTime(std::chrono::system_clock::time_point timePoint);
+std::string formatCurrency(Money value);
 
 }  // namespace booking
 
@@ -1,5 +1,9 @@
 #include "SeedData.hpp"
 
+#include <chrono>
+#include <random>
+#include <string>
+
 namespace booking {
 
 void seedRestaurant(Restaurant &restaurant) {
@@ -9,17 +13,59 @@ void seedRestaurant(Restaurant &restaurant) {
     sheet.addTable(Table{3, 4, "Center"});
     sheet.addTable(Table{4, 4, "Center"});
     sheet.addTable(Table{5, 6, "Patio"});
+    sheet.addTable(Table{6, 6, "Patio"});
+    sheet.joinTables(1, 2);
+    sheet.joinTables(3, 4);
+    sheet.joinTables(5, 6);
 
-    restaurant.addMenuItem(MenuItem{"Seared Salmon", "Entree", 24.5});
-    restaurant.addMenuItem(MenuItem{"Garden Salad", "Starter", 8.5});
-    restaurant.addMenuItem(MenuItem{"Ribeye Steak", "Entree", 36.0});
-    restaurant.addMenuItem(MenuItem{"Tiramisu", "Dessert", 7.5});
-    restaurant.addMenuItem(MenuItem{"Fresh Lemonade", "Drink", 4.5});
+    restaurant.addMenuItem(MenuItem{"Seared Salmon", "Entree", Money::fromCents(2450)});
+    restaurant.addMenuItem(MenuItem{"Garden Salad", "Starter", Money::fromCents(850)});
+    restaurant.addMenuItem(MenuItem{"Ribeye Steak", "Entree", Money::fromCents(3600)});
+    restaurant.addMenuItem(MenuItem{"Tiramisu", "Dessert", Money::fromCents(750)});
+    restaurant.addMenuItem(MenuItem{"Fresh Lemonade", "Drink", Money::fromCents(450)});
 
     restaurant.addStaff(std::make_shared<FrontDeskStaff>("Alice", "alice@example.com"));
     restaurant.addStaff(std::make_shared<FrontDeskStaff>("Bob", "bob@example.com"));
     restaurant.addStaff(std::make_shared<Manager>("Grace", "grace@example.com"));
 }
 
-}  // namespace booking
+void seedHistory(Restaurant &restaurant, int days) {
+    const auto &live = restaurant.getBookingSheet();
+    auto liveNoon = parseDateTime(live.getDate() + " 12:00");
+    const auto &menu = restaurant.getMenu();
+    if (!liveNoon || menu.empty()) {
+        return;
+    }
+    std::mt19937 random(20240520);
+    for (int daysBack = days; daysBack >= 1; --daysBack) {
+        // Noon never falls in a DST gap, so stepping whole days from it always lands on the right date.
+        auto date = formatDateTime(*liveNoon - std::chrono::hours(24 * daysBack)).substr(0, 10);
+        // On the live floor and directory, with ids after every one handed out so far.
+        auto sheet = live.emptyCopy(date);
+        auto opening = *parseDateTime(date + " 11:00");
+        auto bookings = 12 + static_cast<int>(random() % 24);
+        for (int i = 0; i < bookings; ++i) {
+            auto time = opening + std::chrono::minutes(15 * (random() % 42));
+            auto partySize = 1 + static_cast<int>(random() % 8);
+            auto duration = std::chrono::minutes(60 + 15 * (random() % 7));
+            Customer customer{"Guest " + std::to_string(random() % 400), "1380000" + std::to_string(1000 + random() % 400)};
+            auto &reservation = sheet.createReservation(customer, partySize, time, duration);
+            auto outcome = random() % 100;
+            if (outcome < 8 || reservation.getTableIds().empty()) {
+                sheet.updateReservationStatus(reservation.getId(), ReservationStatus::Cancelled);
+                continue;
+            }
+            if (outcome < 14) {
+                continue;  // No-show: left Open.
+            }
+            sheet.updateReservationStatus(reservation.getId(), ReservationStatus::Completed);
+            auto &order = sheet.recordOrder(reservation.getId());
+            for (int line = 0; line < partySize; ++line) {
+                sheet.addOrderItem(order.getId(), menu[random() % menu.size()], 1 + static_cast<int>(random() % 2));
+            }
+        }
+        restaurant.archiveSheet(std::move(sheet));
+    }
+}
 
+}  // namespace booking
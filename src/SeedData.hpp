@@ -5,6 +5,9 @@
 namespace booking {
 
 void seedRestaurant(Restaurant &restaurant);
+// Archives `days` closed days of generated bookings and orders ahead of the live sheet's date,
+// using the live sheet's floor plan and the menu. Deterministic, for demos and analytics.
+void seedHistory(Restaurant &restaurant, int days);
 
 }  // namespace booking
 
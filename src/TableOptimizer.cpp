@@ -0,0 +1,289 @@
+#include "TableOptimizer.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+
+namespace booking {
+
+namespace {
+// Openings are probed as full seatings of this length, every kProbeStepMinutes around the movable
+// parties (moves change nothing elsewhere), over at most a day.
+constexpr SheetMinutes kProbeSeatingMinutes = 120;
+constexpr SheetMinutes kProbeStepMinutes = 30;
+constexpr SheetMinutes kProbeHorizonMinutes = 24 * 60;
+
+using Schedules = std::vector<std::vector<TableBooking>>;
+using Party = TablePlanSnapshot::Party;
+
+struct Proposal {
+    std::vector<TableMove> moves;
+    Schedules schedules;
+    int seatedGuests = 0;
+    int emptySeats = 0;
+    bool valid = true;
+};
+
+class Planner {
+public:
+    explicit Planner(const TablePlanSnapshot &snapshot) : snapshot_(snapshot) {
+        for (size_t position = 0; position < snapshot_.tables.size(); ++position) {
+            positions_.emplace(snapshot_.tables[position].getId(), position);
+        }
+        // The sheet's own mix of party sizes stands in for the parties still to come.
+        auto first = std::numeric_limits<SheetMinutes>::max();
+        for (const auto &party : snapshot_.parties) {
+            ++partySizeMix_[party.partySize];
+            if (party.movable) {
+                first = std::min(first, party.start - kProbeSeatingMinutes);
+                probeEnd_ = std::max(probeEnd_, party.end);
+            }
+        }
+        first = std::max(first, snapshot_.now);
+        probeStart_ = (first + kProbeStepMinutes - 1) / kProbeStepMinutes * kProbeStepMinutes;
+        probeEnd_ = std::min(probeEnd_, probeStart_ + kProbeHorizonMinutes);
+    }
+
+    std::vector<size_t> positionsOf(const std::vector<int> &tableIds) const {
+        std::vector<size_t> positions;
+        for (int tableId : tableIds) {
+            auto it = positions_.find(tableId);
+            if (it != positions_.end()) {
+                positions.push_back(it->second);
+            }
+        }
+        return positions;
+    }
+
+    int capacityOf(const std::vector<size_t> &positions) const {
+        int capacity = 0;
+        for (auto position : positions) {
+            capacity += snapshot_.tables[position].getCapacity();
+        }
+        return capacity;
+    }
+
+    std::vector<char> freeTables(const Schedules &schedules, SheetMinutes start, SheetMinutes end) const {
+        std::vector<char> free(snapshot_.tables.size(), 0);
+        for (size_t position = 0; position < free.size(); ++position) {
+            free[position] = snapshot_.tables[position].getStatus() != TableStatus::OutOfService &&
+                             isScheduleFree(schedules[position], start, end);
+        }
+        return free;
+    }
+
+    static void book(Schedules &schedules, const std::vector<size_t> &positions, const Party &party) {
+        for (auto position : positions) {
+            insertTableBooking(schedules[position], TableBooking{party.start, party.end, party.reservationId});
+        }
+    }
+
+    int countOpenings(const Schedules &schedules) const {
+        int openings = 0;
+        for (auto start = probeStart_; start < probeEnd_; start += kProbeStepMinutes) {
+            auto free = freeTables(schedules, start, start + kProbeSeatingMinutes);
+            for (const auto &[partySize, weight] : partySizeMix_) {
+                if (!findTableSetPositions(snapshot_.tables, snapshot_.neighbours, free, partySize).empty()) {
+                    openings += weight;
+                }
+            }
+        }
+        return openings;
+    }
+
+    // Places the movable parties in the given order onto what the fixed ones leave free.
+    Proposal propose(const Schedules &fixed, const std::vector<const Party *> &order) const {
+        Proposal proposal{{}, fixed, 0, 0, true};
+        for (const auto *party : order) {
+            auto free = freeTables(proposal.schedules, party->start, party->end);
+            auto best = findTableSetPositions(snapshot_.tables, snapshot_.neighbours, free, party->partySize);
+            // Staying put is preferred over an equally tight move.
+            auto current = positionsOf(party->tableIds);
+            bool currentFree = !current.empty() && std::all_of(current.begin(), current.end(), [&](size_t position) {
+                return free[position] != 0;
+            });
+            if (currentFree && capacityOf(current) >= party->partySize) {
+                int currentWaste = capacityOf(current) - party->partySize;
+                int bestWaste = best.empty() ? 0 : capacityOf(best) - party->partySize;
+                if (best.empty() || currentWaste < bestWaste ||
+                    (currentWaste == bestWaste && current.size() <= best.size())) {
+                    best = current;
+                }
+            }
+            if (best.empty()) {
+                if (!party->tableIds.empty()) {
+                    proposal.valid = false;
+                    return proposal;
+                }
+                continue;
+            }
+            book(proposal.schedules, best, *party);
+            proposal.seatedGuests += party->partySize;
+            proposal.emptySeats += capacityOf(best) - party->partySize;
+
+            std::vector<int> target;
+            for (auto position : best) {
+                target.push_back(snapshot_.tables[position].getId());
+            }
+            std::sort(target.begin(), target.end());
+            auto from = party->tableIds;
+            std::sort(from.begin(), from.end());
+            if (target != from) {
+                proposal.moves.push_back(
+                    TableMove{party->reservationId, party->partySize, party->start, party->end, party->tableIds, target});
+            }
+        }
+        return proposal;
+    }
+
+private:
+    const TablePlanSnapshot &snapshot_;
+    std::unordered_map<int, size_t> positions_;
+    std::map<int, int> partySizeMix_;
+    SheetMinutes probeStart_ = 0;
+    SheetMinutes probeEnd_ = 0;
+};
+}  // namespace
+
+TablePlan planTableMoves(const TablePlanSnapshot &snapshot) {
+    Planner planner(snapshot);
+    Schedules fixed(snapshot.tables.size());
+    Schedules current(snapshot.tables.size());
+    std::vector<const Party *> movable;
+    TablePlan plan;
+    for (const auto &party : snapshot.parties) {
+        auto positions = planner.positionsOf(party.tableIds);
+        Planner::book(current, positions, party);
+        if (party.movable) {
+            movable.push_back(&party);
+            if (!positions.empty()) {
+                plan.seatedGuestsBefore += party.partySize;
+                plan.emptySeatsBefore += planner.capacityOf(positions) - party.partySize;
+            }
+        } else {
+            Planner::book(fixed, positions, party);
+        }
+    }
+    plan.openingsBefore = planner.countOpenings(current);
+    plan.seatedGuestsAfter = plan.seatedGuestsBefore;
+    plan.openingsAfter = plan.openingsBefore;
+    plan.emptySeatsAfter = plan.emptySeatsBefore;
+    if (movable.empty()) {
+        return plan;
+    }
+
+    // Two greedy orders: hardest parties first, and in arrival order, which keeps early tables
+    // free of long gaps. The better of the two wins if it beats the current assignment.
+    auto largestFirst = movable;
+    std::sort(largestFirst.begin(), largestFirst.end(), [](const Party *lhs, const Party *rhs) {
+        if (lhs->partySize != rhs->partySize) {
+            return lhs->partySize > rhs->partySize;
+        }
+        if (lhs->end - lhs->start != rhs->end - rhs->start) {
+            return lhs->end - lhs->start > rhs->end - rhs->start;
+        }
+        if (lhs->start != rhs->start) {
+            return lhs->start < rhs->start;
+        }
+        return lhs->reservationId < rhs->reservationId;
+    });
+    auto earliestFirst = movable;
+    std::sort(earliestFirst.begin(), earliestFirst.end(), [](const Party *lhs, const Party *rhs) {
+        if (lhs->start != rhs->start) {
+            return lhs->start < rhs->start;
+        }
+        if (lhs->partySize != rhs->partySize) {
+            return lhs->partySize > rhs->partySize;
+        }
+        return lhs->reservationId < rhs->reservationId;
+    });
+
+    for (const auto *order : {&largestFirst, &earliestFirst}) {
+        auto proposal = planner.propose(fixed, *order);
+        if (!proposal.valid || proposal.moves.empty()) {
+            continue;
+        }
+        auto openings = planner.countOpenings(proposal.schedules);
+        if (std::make_tuple(proposal.seatedGuests, openings, -proposal.emptySeats) >
+            std::make_tuple(plan.seatedGuestsAfter, plan.openingsAfter, -plan.emptySeatsAfter)) {
+            plan.moves = std::move(proposal.moves);
+            plan.seatedGuestsAfter = proposal.seatedGuests;
+            plan.openingsAfter = openings;
+            plan.emptySeatsAfter = proposal.emptySeats;
+        }
+    }
+    return plan;
+}
+
+TableOptimizer::TableOptimizer(SnapshotFunction snapshot, CommitFunction commit)
+    : snapshot_(std::move(snapshot)), commit_(std::move(commit)) {}
+
+TableOptimizer::~TableOptimizer() { stopAutomatic(); }
+
+TableOptimizationReport TableOptimizer::runOnce() {
+    std::lock_guard<std::mutex> run(runMutex_);
+    TableOptimizationReport report;
+    report.plan = planTableMoves(snapshot_());
+    if (!report.plan.moves.empty()) {
+        report.applied = commit_(report.plan.moves);
+    }
+    report.finishedAt = std::chrono::system_clock::now();
+    std::lock_guard<std::mutex> lock(stateMutex_);
+    lastReport_ = report;
+    return report;
+}
+
+void TableOptimizer::startAutomatic(std::chrono::seconds interval) {
+    std::lock_guard<std::mutex> control(controlMutex_);
+    {
+        std::lock_guard<std::mutex> lock(stateMutex_);
+        interval_ = std::max(interval, std::chrono::seconds(1));
+        ++generation_;
+    }
+    wakeUp_.notify_all();
+    if (!thread_.joinable()) {
+        thread_ = std::thread(&TableOptimizer::runAutomatic, this);
+    }
+}
+
+void TableOptimizer::stopAutomatic() {
+    std::lock_guard<std::mutex> control(controlMutex_);
+    {
+        std::lock_guard<std::mutex> lock(stateMutex_);
+        interval_.reset();
+        ++generation_;
+    }
+    wakeUp_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+std::optional<std::chrono::seconds> TableOptimizer::getAutomaticInterval() const {
+    std::lock_guard<std::mutex> lock(stateMutex_);
+    return interval_;
+}
+
+std::optional<TableOptimizationReport> TableOptimizer::getLastReport() const {
+    std::lock_guard<std::mutex> lock(stateMutex_);
+    return lastReport_;
+}
+
+void TableOptimizer::runAutomatic() {
+    std::unique_lock<std::mutex> lock(stateMutex_);
+    while (interval_) {
+        auto generation = generation_;
+        // Re-timing or stopping bumps the generation and restarts the wait.
+        if (wakeUp_.wait_for(lock, *interval_, [&] { return generation_ != generation; })) {
+            continue;
+        }
+        lock.unlock();
+        runOnce();
+        lock.lock();
+    }
+}
+
+}  // namespace booking
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "ReservationSystem.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace booking {
+
+// Outcome of re-packing a snapshot. Openings count, in half-hour steps around the movable
+// parties, the seatings still possible for the party sizes the sheet usually sees, weighted by how
+// often each size is booked. A plan is only proposed when it seats more guests, else leaves more
+// openings, else leaves fewer empty seats at the tables the movable parties hold.
+struct TablePlan {
+    std::vector<TableMove> moves;
+    int seatedGuestsBefore = 0;
+    int seatedGuestsAfter = 0;
+    int openingsBefore = 0;
+    int openingsAfter = 0;
+    int emptySeatsBefore = 0;
+    int emptySeatsAfter = 0;
+};
+
+// Re-packs the Open reservations that are not due yet onto the tightest table sets left by the
+// fixed ones. Parties without tables are placed where possible; a party that has tables is never
+// left without.
+TablePlan planTableMoves(const TablePlanSnapshot &snapshot);
+
+struct TableOptimizationReport {
+    std::chrono::system_clock::time_point finishedAt;
+    TablePlan plan;
+    std::vector<TableMove> applied;
+};
+
+// Runs the planner between a snapshot and a commit step supplied by the caller, which take and
+// release the caller's lock; planning itself runs unlocked. Runs are serialised, whether started
+// by hand or by the automatic timer thread.
+class TableOptimizer {
+public:
+    using SnapshotFunction = std::function<TablePlanSnapshot()>;
+    using CommitFunction = std::function<std::vector<TableMove>(const std::vector<TableMove> &)>;
+
+    TableOptimizer(SnapshotFunction snapshot, CommitFunction commit);
+    TableOptimizer(const TableOptimizer &) = delete;
+    TableOptimizer &operator=(const TableOptimizer &) = delete;
+    ~TableOptimizer();
+
+    TableOptimizationReport runOnce();
+    // Starts (or re-times) a background thread that runs the optimizer every `interval`.
+    void startAutomatic(std::chrono::seconds interval);
+    void stopAutomatic();
+    std::optional<std::chrono::seconds> getAutomaticInterval() const;
+    std::optional<TableOptimizationReport> getLastReport() const;
+
+private:
+    void runAutomatic();
+
+    SnapshotFunction snapshot_;
+    CommitFunction commit_;
+    std::mutex runMutex_;
+    // Serialises starting and stopping the automatic thread.
+    std::mutex controlMutex_;
+    mutable std::mutex stateMutex_;
+    std::condition_variable wakeUp_;
+    std::optional<std::chrono::seconds> interval_;
+    std::uint64_t generation_ = 0;
+    std::optional<TableOptimizationReport> lastReport_;
+    std::thread thread_;
+};
+
+}  // namespace booking
@@ -1,27 +1,18 @@
 #include "WebServer.hpp"
 
-#ifdef _WIN32
-#ifndef _WIN32_WINNT
-#define _WIN32_WINNT 0x0600
-#endif
-#ifndef WIN32_LEAN_AND_MEAN
-#define WIN32_LEAN_AND_MEAN
-#endif
-#include <winsock2.h>
-#include <ws2tcpip.h>
-#ifdef _MSC_VER
-#pragma comment(lib, "ws2_32.lib")
-#endif
-#else
-#include <arpa/inet.h>
-#include <netinet/in.h>
-#include <sys/socket.h>
-#include <unistd.h>
-#endif
+#include "Analytics.hpp"
+#include "ConnectionReactor.hpp"
+#include "Idempotency.hpp"
+#include "JsonSerialization.hpp"
+#include "Metrics.hpp"
+#include "Replication.hpp"
+#include "TableOptimizer.hpp"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
-#include <cerrno>
+#include <condition_variable>
 #include <cctype>
 #include <csignal>
 #include <cstdlib>
@@ -29,6 +20,8 @@
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <memory>
 #include <mutex>
 #include <optional>
 #include <sstream>
@@ -42,49 +35,10 @@
 namespace booking {
 namespace {
 
-#ifdef _WIN32
-using SocketHandle = SOCKET;
-constexpr SocketHandle INVALID_SOCKET_HANDLE = INVALID_SOCKET;
-
-void closeSocket(SocketHandle socket) { closesocket(socket); }
-
-class SocketEnvironment {
-public:
-    SocketEnvironment() {
-        WSADATA data;
-        if (WSAStartup(MAKEWORD(2, 2), &data) != 0) {
-            throw std::runtime_error("Failed to initialize Winsock");
-        }
-    }
-
-    SocketEnvironment(const SocketEnvironment &) = delete;
-    SocketEnvironment &operator=(const SocketEnvironment &) = delete;
-
-    ~SocketEnvironment() { WSACleanup(); }
-};
-#else
-using SocketHandle = int;
-constexpr SocketHandle INVALID_SOCKET_HANDLE = -1;
-
-void closeSocket(SocketHandle socket) { close(socket); }
-
-class SocketEnvironment {
-public:
-    SocketEnvironment() = default;
-    SocketEnvironment(const SocketEnvironment &) = delete;
-    SocketEnvironment &operator=(const SocketEnvironment &) = delete;
-};
-#endif
-
-#ifdef _WIN32
-using SendSize = int;
-#else
-using SendSize = ssize_t;
-#endif
-
 struct HttpRequest {
     std::string method;
     std::string path;
+    std::string query;
     std::unordered_map<std::string, std::string> headers;
     std::string body;
 };
@@ -106,8 +60,26 @@ std::string statusMessage(int status) {
             return "No Content";
         case 400:
             return "Bad Request";
+        case 401:
+            return "Unauthorized";
+        case 403:
+            return "Forbidden";
         case 404:
             return "Not Found";
+        case 405:
+            return "Method Not Allowed";
+        case 408:
+            return "Request Timeout";
+        case 409:
+            return "Conflict";
+        case 412:
+            return "Precondition Failed";
+        case 429:
+            return "Too Many Requests";
+        case 422:
+            return "Unprocessable Entity";
+        case 503:
+            return "Service Unavailable";
         case 500:
         default:
             return "Internal Server Error";
@@ -164,6 +136,11 @@ bool parseRequestLine(const std::string &line, HttpRequest &request) {
     if (!(iss >> request.method >> request.path)) {
         return false;
     }
+    auto queryPos = request.path.find('?');
+    if (queryPos != std::string::npos) {
+        request.query = request.path.substr(queryPos + 1);
+        request.path.erase(queryPos);
+    }
     return true;
 }
 
@@ -196,27 +173,9 @@ bool parseHeaders(std::istringstream &stream, HttpRequest &request) {
     return true;
 }
 
-bool readHttpRequest(SocketHandle clientFd, HttpRequest &request) {
-    std::string buffer;
-    buffer.reserve(4096);
-    char temp[4096];
-    int received = 0;
-
-    while (buffer.find("\r\n\r\n") == std::string::npos) {
-        received = recv(clientFd, temp, sizeof(temp), 0);
-        if (received <= 0) {
-            return false;
-        }
-        buffer.append(temp, static_cast<size_t>(received));
-        if (buffer.size() > 1'000'000) {
-            return false;
-        }
-    }
-
-    auto headerEnd = buffer.find("\r\n\r\n");
-    std::string headerPart = buffer.substr(0, headerEnd);
-    std::string bodyPart = buffer.substr(headerEnd + 4);
+constexpr size_t kMaxRequestBytes = 1'000'000;
 
+bool parseRequestHead(const std::string &headerPart, HttpRequest &request) {
     std::istringstream headerStream(headerPart);
     std::string requestLine;
     if (!std::getline(headerStream, requestLine)) {
@@ -228,29 +187,44 @@ bool readHttpRequest(SocketHandle clientFd, HttpRequest &request) {
     if (!parseRequestLine(requestLine, request)) {
         return false;
     }
-    parseHeaders(headerStream, request);
+    return parseHeaders(headerStream, request);
+}
 
-    size_t contentLength = 0;
+size_t declaredContentLength(const HttpRequest &request) {
     if (auto header = getHeader(request, "Content-Length")) {
         try {
-            contentLength = static_cast<size_t>(std::stoul(*header));
+            return static_cast<size_t>(std::stoul(*header));
         } catch (...) {
-            contentLength = 0;
+            return 0;
         }
     }
+    return 0;
+}
 
-    while (bodyPart.size() < contentLength) {
-        received = recv(clientFd, temp, sizeof(temp), 0);
-        if (received <= 0) {
-            return false;
-        }
-        bodyPart.append(temp, static_cast<size_t>(received));
-        if (bodyPart.size() > 1'000'000) {
-            return false;
-        }
+// Content-Length framing for the connection reactor; see ConnectionReactor::FrameRequest.
+size_t frameHttpRequest(const std::string &buffer) {
+    auto headerEnd = buffer.find("\r\n\r\n");
+    if (headerEnd == std::string::npos) {
+        return buffer.size() > kMaxRequestBytes ? std::string::npos : 0;
     }
+    HttpRequest head;
+    if (!parseRequestHead(buffer.substr(0, headerEnd), head)) {
+        return std::string::npos;
+    }
+    auto contentLength = declaredContentLength(head);
+    if (contentLength > kMaxRequestBytes) {
+        return std::string::npos;
+    }
+    return headerEnd + 4 + contentLength;
+}
 
-    request.body = bodyPart.substr(0, contentLength);
+// Parses a request the reactor has already framed.
+bool parseHttpRequest(const std::string &bytes, HttpRequest &request) {
+    auto headerEnd = bytes.find("\r\n\r\n");
+    if (headerEnd == std::string::npos || !parseRequestHead(bytes.substr(0, headerEnd), request)) {
+        return false;
+    }
+    request.body = bytes.substr(headerEnd + 4, declaredContentLength(request));
     return true;
 }
 
@@ -315,65 +289,8 @@ std::vector<std::string> getAllFields(const FormValues &data, const std::string
     return it->second;
 }
 
-std::string escapeJson(const std::string &value) {
-    std::ostringstream oss;
-    for (char ch : value) {
-        switch (ch) {
-            case '\\':
-                oss << "\\\\";
-                break;
-            case '"':
-                oss << "\\\"";
-                break;
-            case '\n':
-                oss << "\\n";
-                break;
-            case '\r':
-                oss << "\\r";
-                break;
-            case '\t':
-                oss << "\\t";
-                break;
-            default:
-                if (static_cast<unsigned char>(ch) < 0x20) {
-                    oss << "\\u" << std::hex << std::uppercase << std::setw(4) << std::setfill('0')
-                        << static_cast<int>(static_cast<unsigned char>(ch)) << std::nouppercase << std::dec;
-                } else {
-                    oss << ch;
-                }
-                break;
-        }
-    }
-    return oss.str();
-}
-
-std::string tableStatusToString(TableStatus status) {
-    switch (status) {
-        case TableStatus::Free:
-            return "Free";
-        case TableStatus::Reserved:
-            return "Reserved";
-        case TableStatus::Occupied:
-            return "Occupied";
-        case TableStatus::OutOfService:
-            return "OutOfService";
-    }
-    return "Unknown";
-}
-
-std::string reservationStatusToString(ReservationStatus status) {
-    switch (status) {
-        case ReservationStatus::Open:
-            return "Open";
-        case ReservationStatus::Seated:
-            return "Seated";
-        case ReservationStatus::Completed:
-            return "Completed";
-        case ReservationStatus::Cancelled:
-            return "Cancelled";
-    }
-    return "Unknown";
-}
+// Unknown or malformed ids map to the invalid id, which every lookup reports as not found.
+RecordId parseRecordId(std::string_view text) { return RecordId::parse(text).value_or(RecordId{}); }
 
 std::optional<ReservationStatus> parseReservationStatus(const std::string &value) {
     if (value == "Open") {
@@ -391,198 +308,6 @@ std::optional<ReservationStatus> parseReservationStatus(const std::string &value
     return std::nullopt;
 }
 
-std::string tablesToJson(const Restaurant &restaurant) {
-    std::ostringstream oss;
-    oss << '[';
-    const auto &sheet = restaurant.getBookingSheet();
-    const auto &tables = sheet.getTables();
-    const auto &reservations = sheet.getReservations();
-    const auto &orders = sheet.getOrders();
-    for (size_t i = 0; i < tables.size(); ++i) {
-        const auto &table = tables[i];
-        if (i > 0) {
-            oss << ',';
-        }
-        oss << '{'
-            << "\"id\":" << table.getId() << ','
-            << "\"capacity\":" << table.getCapacity() << ','
-            << "\"location\":\"" << escapeJson(table.getLocation()) << "\",";
-        oss << "\"status\":\"" << tableStatusToString(table.getStatus()) << "\",";
-        oss << "\"reservations\":[";
-        bool firstReservation = true;
-        for (const auto &reservation : reservations) {
-            if (!reservation.getTableId() || *reservation.getTableId() != table.getId()) {
-                continue;
-            }
-            if (reservation.getStatus() == ReservationStatus::Cancelled) {
-                continue;
-            }
-            if (!firstReservation) {
-                oss << ',';
-            }
-            firstReservation = false;
-            oss << '{'
-                << "\"id\":\"" << escapeJson(reservation.getId()) << "\",";
-            oss << "\"customer\":\"" << escapeJson(reservation.getCustomer().getName()) << "\",";
-            oss << "\"partySize\":" << reservation.getPartySize() << ',';
-            oss << "\"status\":\"" << reservationStatusToString(reservation.getStatus()) << "\",";
-            oss << "\"orders\":[";
-            bool firstOrder = true;
-            for (const auto &order : orders) {
-                if (order.getReservationId() != reservation.getId()) {
-                    continue;
-                }
-                if (!firstOrder) {
-                    oss << ',';
-                }
-                firstOrder = false;
-                oss << "\"" << escapeJson(order.getId()) << "\"";
-            }
-            oss << ']';
-            oss << '}';
-        }
-        oss << ']';
-        oss << '}';
-    }
-    oss << ']';
-    return oss.str();
-}
-
-std::string reservationToJson(const Reservation &reservation) {
-    std::ostringstream oss;
-    oss << '{';
-    oss << "\"id\":\"" << escapeJson(reservation.getId()) << "\",";
-    oss << "\"customer\":\"" << escapeJson(reservation.getCustomer().getName()) << "\",";
-    oss << "\"phone\":\"" << escapeJson(reservation.getCustomer().getPhone()) << "\",";
-    oss << "\"email\":\"" << escapeJson(reservation.getCustomer().getEmail()) << "\",";
-    oss << "\"preference\":\"" << escapeJson(reservation.getCustomer().getPreference()) << "\",";
-    oss << "\"partySize\":" << reservation.getPartySize() << ',';
-    oss << "\"time\":\"" << escapeJson(formatDateTime(reservation.getDateTime())) << "\",";
-    oss << "\"endTime\":\"" << escapeJson(formatDateTime(reservation.getEndTime())) << "\",";
-    oss << "\"durationMinutes\":" << reservation.getDuration().count() << ',';
-    oss << "\"status\":\"" << reservationStatusToString(reservation.getStatus()) << "\",";
-    oss << "\"notes\":\"" << escapeJson(reservation.getNotes()) << "\",";
-    oss << "\"tableId\":";
-    if (reservation.getTableId()) {
-        oss << *reservation.getTableId();
-    } else {
-        oss << "null";
-    }
-    oss << ',';
-    oss << "\"lastModified\":\"" << escapeJson(formatDateTime(reservation.getLastModified())) << "\"";
-    oss << '}';
-    return oss.str();
-}
-
-std::string reservationsToJson(const Restaurant &restaurant) {
-    std::ostringstream oss;
-    oss << '[';
-    const auto &reservations = restaurant.getBookingSheet().getReservations();
-    for (size_t i = 0; i < reservations.size(); ++i) {
-        if (i > 0) {
-            oss << ',';
-        }
-        oss << reservationToJson(reservations[i]);
-    }
-    oss << ']';
-    return oss.str();
-}
-
-std::string ordersToJson(const Restaurant &restaurant) {
-    std::ostringstream oss;
-    oss << '[';
-    const auto &orders = restaurant.getBookingSheet().getOrders();
-    for (size_t i = 0; i < orders.size(); ++i) {
-        const auto &order = orders[i];
-        if (i > 0) {
-            oss << ',';
-        }
-        oss << '{';
-        oss << "\"id\":\"" << escapeJson(order.getId()) << "\",";
-        oss << "\"reservationId\":\"" << escapeJson(order.getReservationId()) << "\",";
-        oss << "\"total\":" << order.calculateTotal() << ',';
-        oss << "\"items\":[";
-        const auto &items = order.getItems();
-        for (size_t j = 0; j < items.size(); ++j) {
-            const auto &item = items[j];
-            if (j > 0) {
-                oss << ',';
-            }
-            oss << '{';
-            oss << "\"name\":\"" << escapeJson(item.getItem().getName()) << "\",";
-            oss << "\"category\":\"" << escapeJson(item.getItem().getCategory()) << "\",";
-            oss << "\"price\":" << item.getItem().getPrice() << ',';
-            oss << "\"quantity\":" << item.getQuantity() << ',';
-            oss << "\"lineTotal\":" << item.getLineTotal();
-            oss << '}';
-        }
-        oss << ']';
-        oss << '}';
-    }
-    oss << ']';
-    return oss.str();
-}
-
-std::string menuToJson(const Restaurant &restaurant) {
-    std::ostringstream oss;
-    oss << '[';
-    const auto &menu = restaurant.getMenu();
-    for (size_t i = 0; i < menu.size(); ++i) {
-        const auto &item = menu[i];
-        if (i > 0) {
-            oss << ',';
-        }
-        oss << '{';
-        oss << "\"name\":\"" << escapeJson(item.getName()) << "\",";
-        oss << "\"category\":\"" << escapeJson(item.getCategory()) << "\",";
-        oss << "\"price\":" << item.getPrice();
-        oss << '}';
-    }
-    oss << ']';
-    return oss.str();
-}
-
-std::string staffToJson(const Restaurant &restaurant) {
-    std::ostringstream oss;
-    oss << '[';
-    const auto &staff = restaurant.getStaff();
-    for (size_t i = 0; i < staff.size(); ++i) {
-        const auto &member = staff[i];
-        if (i > 0) {
-            oss << ',';
-        }
-        oss << '{';
-        oss << "\"name\":\"" << escapeJson(member->getName()) << "\",";
-        oss << "\"role\":\"" << escapeJson(member->getRole().getName()) << "\",";
-        oss << "\"contact\":\"" << escapeJson(member->getContact()) << "\"";
-        oss << '}';
-    }
-    oss << ']';
-    return oss.str();
-}
-
-std::string reportToJson(const Report &report) {
-    std::ostringstream oss;
-    oss << '{';
-    oss << "\"date\":\"" << escapeJson(report.getDate()) << "\",";
-    oss << "\"totalReservations\":" << report.getTotalReservations() << ',';
-    oss << "\"seatedGuests\":" << report.getSeatedGuests() << ',';
-    oss << "\"revenue\":" << report.getRevenue() << ',';
-    oss << "\"breakdown\":[";
-    const auto &breakdown = report.getReservationBreakdown();
-    for (size_t i = 0; i < breakdown.size(); ++i) {
-        if (i > 0) {
-            oss << ',';
-        }
-        oss << '{';
-        oss << "\"reservationId\":\"" << escapeJson(std::get<0>(breakdown[i])) << "\",";
-        oss << "\"status\":\"" << reservationStatusToString(std::get<1>(breakdown[i])) << "\"";
-        oss << '}';
-    }
-    oss << "]}";
-    return oss.str();
-}
-
 bool hasHeader(const HttpResponse &response, const std::string &key) {
     for (const auto &header : response.headers) {
         if (headerEquals(header.first, key)) {
@@ -600,9 +325,10 @@ void ensureHeader(HttpResponse &response, const std::string &key, const std::str
 
 void applyCorsHeaders(HttpResponse &response, bool includeMethods) {
     ensureHeader(response, "Access-Control-Allow-Origin", "*");
+    ensureHeader(response, "Access-Control-Expose-Headers", "ETag");
     if (includeMethods) {
         ensureHeader(response, "Access-Control-Allow-Methods", "GET,POST,PUT,DELETE,OPTIONS");
-        ensureHeader(response, "Access-Control-Allow-Headers", "Content-Type");
+        ensureHeader(response, "Access-Control-Allow-Headers", "Content-Type, X-Staff-Token, Idempotency-Key, If-Match");
         ensureHeader(response, "Access-Control-Max-Age", "86400");
     }
 }
@@ -685,11 +411,9 @@ HttpResponse buildPreflightResponse() {
     return response;
 }
 
-HttpResponse handleApiRequest(const HttpRequest &request,
-                              Restaurant &restaurant,
-                              std::mutex &mutex) {
+// Routes one API request against the restaurant; the caller must hold the restaurant mutex.
+HttpResponse routeApiRequest(const HttpRequest &request, Restaurant &restaurant) {
     HttpResponse response;
-    std::lock_guard<std::mutex> lock(mutex);
 
     auto &sheet = restaurant.getBookingSheet();
     sheet.updateTableStatuses();
@@ -712,12 +436,41 @@ HttpResponse handleApiRequest(const HttpRequest &request,
     };
 
     if (request.method == "GET" && isReservationIdPath(request.path)) {
-        auto id = request.path.substr(reservationIdPrefix.size());
+        auto id = parseRecordId(std::string_view(request.path).substr(reservationIdPrefix.size()));
         auto reservation = sheet.findReservationById(id);
         if (!reservation) {
             return {404, "text/plain; charset=utf-8", "Reservation not found"};
         }
-        response.body = reservationToJson(*reservation);
+        response.body = reservationToJson(sheet, *reservation);
+        return response;
+    }
+
+    const std::string billSuffix = "/bill";
+    if (request.method == "GET" && startsWith(request.path, reservationIdPrefix) &&
+        request.path.size() > reservationIdPrefix.size() + billSuffix.size() && endsWith(request.path, billSuffix)) {
+        auto id = parseRecordId(std::string_view(request.path)
+                                    .substr(reservationIdPrefix.size(),
+                                            request.path.size() - reservationIdPrefix.size() - billSuffix.size()));
+        if (!sheet.findReservationById(id)) {
+            return {404, "text/plain; charset=utf-8", "Reservation not found"};
+        }
+        auto bill = sheet.getReservationBill(id);
+        std::ostringstream body;
+        body << "{\"reservationId\":\"" << id << "\",\"orderCount\":" << bill.orderCount
+             << ",\"total\":" << bill.total.toString() << "}";
+        response.body = body.str();
+        return response;
+    }
+
+    const std::string customerPrefix = "/api/customers/";
+    if (request.method == "GET" && startsWith(request.path, customerPrefix) &&
+        request.path.size() > customerPrefix.size()) {
+        auto phone = urlDecode(request.path.substr(customerPrefix.size()));
+        auto customerId = sheet.getCustomers().findByPhone(phone);
+        if (!customerId) {
+            return {404, "text/plain; charset=utf-8", "Customer not found"};
+        }
+        response.body = customerHistoryToJson(restaurant, *customerId);
         return response;
     }
 
@@ -731,14 +484,41 @@ HttpResponse handleApiRequest(const HttpRequest &request,
         return response;
     }
 
+    if (request.method == "GET" && request.path == "/api/menu/popular") {
+        auto query = parseFormEncoded(request.query);
+        auto window = toInt(getFirstField(query, "window").value_or("60"));
+        auto limit = toInt(getFirstField(query, "limit").value_or("10"));
+        if (!window || *window <= 0 || *window > 24 * 60) {
+            return {400, "text/plain; charset=utf-8", "Invalid window"};
+        }
+        if (!limit || *limit <= 0 || *limit > 100) {
+            return {400, "text/plain; charset=utf-8", "Invalid limit"};
+        }
+        auto minutes = std::chrono::minutes(*window);
+        response.body = popularDishesToJson(sheet.getPopularDishes(static_cast<size_t>(*limit), minutes), minutes);
+        return response;
+    }
+
     if (request.method == "GET" && request.path == "/api/staff") {
         response.body = staffToJson(restaurant);
         return response;
     }
 
     if (request.method == "GET" && request.path == "/api/report") {
-        auto report = restaurant.generateDailyReport();
-        response.body = reportToJson(report);
+        // The per-reservation breakdown is only listed on request, a page at a time.
+        auto query = parseFormEncoded(request.query);
+        ReportPage page;
+        auto limitField = getFirstField(query, "limit");
+        if (limitField) {
+            auto limit = toInt(*limitField);
+            auto offset = toInt(getFirstField(query, "offset").value_or("0"));
+            if (!limit || *limit <= 0 || *limit > 500 || !offset || *offset < 0) {
+                return {400, "text/plain; charset=utf-8", "Invalid breakdown page"};
+            }
+            page.offset = static_cast<size_t>(*offset);
+            page.limit = static_cast<size_t>(*limit);
+        }
+        response.body = reportToJson(restaurant.generateDailyReport(page), limitField.has_value());
         return response;
     }
 
@@ -766,11 +546,11 @@ HttpResponse handleApiRequest(const HttpRequest &request,
                                                     std::chrono::minutes(120),
                                                     getFirstField(data, "notes").value_or(""));
         response.status = 201;
-        response.body = "{\"success\":true,\"id\":\"" + escapeJson(reservation.getId()) + "\"}";
+        response.body = "{\"success\":true,\"id\":\"" + reservation.getId().toString() + "\"}";
         return response;
     }
 
-    if (request.method == "POST" && request.path == "/api/walkins") {
+    if (request.method == "POST" && (request.path == "/api/walkins" || request.path == "/api/waitlist")) {
         auto data = parseFormEncoded(request.body);
         if (!hasField(data, "name") || !hasField(data, "phone") || !hasField(data, "partySize")) {
             return {400, "text/plain; charset=utf-8", "Missing required fields"};
@@ -780,9 +560,92 @@ HttpResponse handleApiRequest(const HttpRequest &request,
             return {400, "text/plain; charset=utf-8", "Invalid party size"};
         }
         Customer customer{*getFirstField(data, "name"), *getFirstField(data, "phone")};
-        auto &reservation = sheet.recordWalkIn(customer, *partySizeOpt, getFirstField(data, "notes").value_or(""));
+        auto outcome = sheet.admitWalkIn(customer, *partySizeOpt, getFirstField(data, "notes").value_or(""));
+        if (outcome.turnedAway) {
+            return {422, "text/plain; charset=utf-8", "No combination of tables can seat this party"};
+        }
         response.status = 201;
-        response.body = "{\"success\":true,\"id\":\"" + escapeJson(reservation.getId()) + "\"}";
+        response.body = walkInOutcomeToJson(sheet, outcome);
+        return response;
+    }
+
+    if (request.method == "GET" && request.path == "/api/availability") {
+        auto query = parseFormEncoded(request.query);
+        auto partySize = toInt(getFirstField(query, "partySize").value_or(""));
+        if (!partySize || *partySize <= 0) {
+            return {400, "text/plain; charset=utf-8", "Invalid party size"};
+        }
+        auto from = parseDateTime(getFirstField(query, "from").value_or(""));
+        if (!from) {
+            return {400, "text/plain; charset=utf-8", "Invalid from time"};
+        }
+        auto to = *from + std::chrono::hours(24);
+        if (auto toField = getFirstField(query, "to")) {
+            auto parsed = parseDateTime(*toField);
+            if (!parsed || *parsed < *from) {
+                return {400, "text/plain; charset=utf-8", "Invalid to time"};
+            }
+            to = *parsed;
+        }
+        auto limit = toInt(getFirstField(query, "limit").value_or("5"));
+        auto duration = toInt(getFirstField(query, "durationMinutes").value_or("120"));
+        auto step = toInt(getFirstField(query, "stepMinutes").value_or("15"));
+        if (!limit || *limit <= 0 || *limit > 100) {
+            return {400, "text/plain; charset=utf-8", "Invalid limit"};
+        }
+        if (!duration || *duration <= 0 || *duration > kMaxSeatingDurationMinutes || !step || *step <= 0 ||
+            *step > kMaxSeatingDurationMinutes) {
+            return {400, "text/plain; charset=utf-8", "Invalid duration"};
+        }
+        auto slots = sheet.findAvailableSlots(*partySize,
+                                              *from,
+                                              to,
+                                              std::chrono::minutes(*duration),
+                                              static_cast<size_t>(*limit),
+                                              std::chrono::minutes(*step));
+        std::ostringstream oss;
+        oss << '[';
+        char timeText[kDateTimeTextLength];
+        for (size_t i = 0; i < slots.size(); ++i) {
+            if (i > 0) {
+                oss << ',';
+            }
+            oss << "{\"time\":\"";
+            oss.write(timeText, static_cast<std::streamsize>(formatDateTime(slots[i].time, timeText)));
+            oss << "\",\"tableIds\":";
+            writeTableIdArray(oss, slots[i].tableIds);
+            oss << '}';
+        }
+        oss << ']';
+        response.body = oss.str();
+        return response;
+    }
+
+    const std::string waitlistPrefix = "/api/waitlist/";
+    if (request.method == "GET" && request.path == "/api/waitlist") {
+        auto query = parseFormEncoded(request.query);
+        if (auto partySizeField = getFirstField(query, "partySize")) {
+            auto partySize = toInt(*partySizeField);
+            if (!partySize || *partySize <= 0) {
+                return {400, "text/plain; charset=utf-8", "Invalid party size"};
+            }
+            std::ostringstream oss;
+            oss << "{\"partySize\":" << *partySize << ',';
+            writeWaitEstimate(oss, sheet.estimateWait(*partySize));
+            oss << '}';
+            response.body = oss.str();
+            return response;
+        }
+        response.body = waitlistToJson(sheet);
+        return response;
+    }
+
+    if (request.method == "DELETE" && startsWith(request.path, waitlistPrefix)) {
+        auto id = parseRecordId(std::string_view(request.path).substr(waitlistPrefix.size()));
+        if (!sheet.leaveWaitlist(id)) {
+            return {404, "text/plain; charset=utf-8", "Waitlist entry not found"};
+        }
+        response.body = "{\"success\":true}";
         return response;
     }
 
@@ -791,7 +654,7 @@ HttpResponse handleApiRequest(const HttpRequest &request,
         if (!hasField(data, "reservationId")) {
             return {400, "text/plain; charset=utf-8", "Missing reservationId"};
         }
-        auto reservationId = *getFirstField(data, "reservationId");
+        auto reservationId = parseRecordId(*getFirstField(data, "reservationId"));
         auto reservation = sheet.findReservationById(reservationId);
         if (!reservation) {
             return {404, "text/plain; charset=utf-8", "Reservation not found"};
@@ -822,18 +685,18 @@ HttpResponse handleApiRequest(const HttpRequest &request,
 
         auto &order = sheet.recordOrder(reservationId);
         for (const auto &[item, quantity] : parsedItems) {
-            order.addItem(*item, quantity);
+            sheet.addOrderItem(order.getId(), *item, quantity);
         }
         response.status = 201;
         std::ostringstream body;
-        body << "{\"success\":true,\"id\":\"" << escapeJson(order.getId()) << "\",\"total\":"
-             << order.calculateTotal() << "}";
+        body << "{\"success\":true,\"id\":\"" << order.getId() << "\",\"total\":"
+             << order.getTotal().toString() << "}";
         response.body = body.str();
         return response;
     }
 
     if ((request.method == "PUT" || request.method == "DELETE") && isReservationIdPath(request.path)) {
-        auto id = request.path.substr(reservationIdPrefix.size());
+        auto id = parseRecordId(std::string_view(request.path).substr(reservationIdPrefix.size()));
         if (request.method == "DELETE") {
             if (!sheet.deleteReservation(id)) {
                 return {404, "text/plain; charset=utf-8", "Reservation not found"};
@@ -859,7 +722,7 @@ HttpResponse handleApiRequest(const HttpRequest &request,
         }
 
         auto durationMinutes = toInt(getFirstField(data, "durationMinutes").value_or("120"));
-        if (!durationMinutes || *durationMinutes <= 0) {
+        if (!durationMinutes || *durationMinutes <= 0 || *durationMinutes > kMaxSeatingDurationMinutes) {
             return {400, "text/plain; charset=utf-8", "Invalid duration"};
         }
 
@@ -899,7 +762,7 @@ HttpResponse handleApiRequest(const HttpRequest &request,
         }
 
         reservation = sheet.findReservationById(id);
-        response.body = reservationToJson(*reservation);
+        response.body = reservationToJson(sheet, *reservation);
         return response;
     }
 
@@ -908,7 +771,9 @@ HttpResponse handleApiRequest(const HttpRequest &request,
     if (request.method == "POST" && startsWith(request.path, statusPrefix) &&
         request.path.size() > statusPrefix.size() + statusSuffix.size() &&
         endsWith(request.path, statusSuffix)) {
-        auto id = request.path.substr(statusPrefix.size(), request.path.size() - statusPrefix.size() - statusSuffix.size());
+        auto id = parseRecordId(std::string_view(request.path)
+                                    .substr(statusPrefix.size(),
+                                            request.path.size() - statusPrefix.size() - statusSuffix.size()));
         auto data = parseFormEncoded(request.body);
         if (!hasField(data, "status")) {
             return {400, "text/plain; charset=utf-8", "Missing status"};
@@ -917,25 +782,9 @@ HttpResponse handleApiRequest(const HttpRequest &request,
         if (!status) {
             return {400, "text/plain; charset=utf-8", "Invalid status"};
         }
-        auto reservation = sheet.findReservationById(id);
-        if (!reservation) {
+        if (!sheet.updateReservationStatus(id, *status)) {
             return {404, "text/plain; charset=utf-8", "Reservation not found"};
         }
-        switch (*status) {
-            case ReservationStatus::Seated:
-                reservation->markSeated();
-                break;
-            case ReservationStatus::Completed:
-                reservation->markCompleted();
-                break;
-            case ReservationStatus::Cancelled:
-                reservation->cancel();
-                reservation->clearTable();
-                break;
-            case ReservationStatus::Open:
-                reservation->updateStatus(ReservationStatus::Open);
-                break;
-        }
         response.body = "{\"success\":true}";
         return response;
     }
@@ -943,7 +792,9 @@ HttpResponse handleApiRequest(const HttpRequest &request,
     const std::string tableSuffix = "/table";
     if (request.method == "POST" && startsWith(request.path, statusPrefix) &&
         request.path.size() > statusPrefix.size() + tableSuffix.size() && endsWith(request.path, tableSuffix)) {
-        auto id = request.path.substr(statusPrefix.size(), request.path.size() - statusPrefix.size() - tableSuffix.size());
+        auto id = parseRecordId(std::string_view(request.path)
+                                    .substr(statusPrefix.size(),
+                                            request.path.size() - statusPrefix.size() - tableSuffix.size()));
         auto reservation = sheet.findReservationById(id);
         if (!reservation) {
             return {404, "text/plain; charset=utf-8", "Reservation not found"};
@@ -959,15 +810,20 @@ HttpResponse handleApiRequest(const HttpRequest &request,
                 return {409, "text/plain; charset=utf-8", "No suitable table available"};
             }
         } else {
-            auto tableField = getFirstField(data, "tableId");
-            if (!tableField || tableField->empty()) {
+            // Repeat tableId to push several adjacent tables together.
+            auto tableFields = getAllFields(data, "tableId");
+            if (tableFields.empty() || tableFields.front().empty()) {
                 return {400, "text/plain; charset=utf-8", "Missing tableId"};
             }
-            auto parsed = toInt(*tableField);
-            if (!parsed || *parsed <= 0) {
-                return {400, "text/plain; charset=utf-8", "Invalid tableId"};
+            std::vector<int> tableIds;
+            for (const auto &field : tableFields) {
+                auto parsed = toInt(field);
+                if (!parsed || *parsed <= 0) {
+                    return {400, "text/plain; charset=utf-8", "Invalid tableId"};
+                }
+                tableIds.push_back(*parsed);
             }
-            if (!sheet.assignTable(id, *parsed)) {
+            if (!sheet.assignTables(id, tableIds)) {
                 return {409, "text/plain; charset=utf-8", "Table not available"};
             }
         }
@@ -975,153 +831,1252 @@ HttpResponse handleApiRequest(const HttpRequest &request,
         if (!reservation) {
             return {404, "text/plain; charset=utf-8", "Reservation not found"};
         }
-        response.body = reservationToJson(*reservation);
+        response.body = reservationToJson(sheet, *reservation);
         return response;
     }
 
-    return {404, "text/plain; charset=utf-8", "Not Found"};
-}
-
-int portableSend(SocketHandle socket, const char *data, size_t length) {
-    size_t totalSent = 0;
-    while (totalSent < length) {
-#ifdef _WIN32
-        SendSize chunk = send(socket, data + totalSent, static_cast<int>(length - totalSent), 0);
-#else
-        SendSize chunk = send(socket, data + totalSent, length - totalSent, 0);
-#endif
-        if (chunk <= 0) {
-            return -1;
+    if (request.method == "POST" && request.path == "/api/day/close") {
+        // Opens the day after the live one unless a later date is given.
+        auto data = parseFormEncoded(request.body);
+        auto nextDate = getFirstField(data, "date");
+        if (!nextDate) {
+            auto noon = parseDateTime(sheet.getDate() + " 12:00");
+            if (!noon) {
+                return {409, "text/plain; charset=utf-8", "The live day has no valid date"};
+            }
+            nextDate = formatDateTime(*noon + std::chrono::hours(24)).substr(0, 10);
+        }
+        if (!restaurant.rollOver(*nextDate)) {
+            return {400, "text/plain; charset=utf-8", "Invalid date: must be a day after the live one"};
         }
-        totalSent += static_cast<size_t>(chunk);
+        // `sheet` was closed; the new live sheet has the normalized date.
+        response.body = "{\"success\":true,\"date\":\"" + escapeJson(restaurant.getBookingSheet().getDate()) + "\"}";
+        return response;
     }
-    return static_cast<int>(totalSent);
+
+    return {404, "text/plain; charset=utf-8", "Not Found"};
 }
 
-void handleClient(SocketHandle clientFd,
-                  Restaurant &restaurant,
-                  std::mutex &mutex,
-                  const std::string &staticRoot) {
-    HttpRequest request;
-    if (!readHttpRequest(clientFd, request)) {
-        closeSocket(clientFd);
-        return;
+// The reservation a request reads or writes through /api/reservations/{id}, /status or /table.
+std::optional<RecordId> targetReservationId(const HttpRequest &request) {
+    const std::string prefix = "/api/reservations/";
+    if (!startsWith(request.path, prefix)) {
+        return std::nullopt;
     }
-
-    bool isApiRequest = startsWith(request.path, "/api/");
-
-    HttpResponse response;
-    if (request.method == "OPTIONS" && isApiRequest) {
-        response = buildPreflightResponse();
-    } else if (isApiRequest) {
-        response = handleApiRequest(request, restaurant, mutex);
-        applyCorsHeaders(response, true);
-    } else {
-        response = serveStaticFile(staticRoot, request.path);
-        applyCorsHeaders(response, false);
+    auto rest = std::string_view(request.path).substr(prefix.size());
+    auto slash = rest.find('/');
+    auto suffix = slash == std::string_view::npos ? std::string_view{} : rest.substr(slash);
+    bool single = suffix.empty() && (request.method == "GET" || request.method == "PUT" || request.method == "DELETE");
+    bool action = request.method == "POST" && (suffix == "/status" || suffix == "/table");
+    if (!single && !action) {
+        return std::nullopt;
     }
-
-    auto text = buildResponse(response);
-    portableSend(clientFd, text.c_str(), text.size());
-    closeSocket(clientFd);
+    return RecordId::parse(rest.substr(0, slash));
 }
 
-}  // namespace
-
-SocketHandle createListeningSocket(int port) {
-    SocketHandle serverFd = INVALID_SOCKET_HANDLE;
-
-#ifdef AF_INET6
-    serverFd = socket(AF_INET6, SOCK_STREAM, 0);
-    if (serverFd != INVALID_SOCKET_HANDLE) {
-#ifdef _WIN32
-        char reuse = 1;
-        setsockopt(serverFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
-        char dualStack = 0;
-        setsockopt(serverFd, IPPROTO_IPV6, IPV6_V6ONLY, &dualStack, sizeof(dualStack));
-#else
-        int reuse = 1;
-        setsockopt(serverFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
-        int dualStack = 0;
-        setsockopt(serverFd, IPPROTO_IPV6, IPV6_V6ONLY, &dualStack, sizeof(dualStack));
-#endif
-
-        sockaddr_in6 address{};
-        address.sin6_family = AF_INET6;
-        address.sin6_addr = in6addr_any;
-        address.sin6_port = htons(static_cast<uint16_t>(port));
+std::string formatEtag(const Reservation &reservation) { return '"' + std::to_string(reservation.getVersion()) + '"'; }
 
-        if (bind(serverFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0) {
-            if (listen(serverFd, 10) == 0) {
-                return serverFd;
-            }
+// Strong comparison per RFC 9110: "*" matches any existing reservation, weak tags never match.
+bool ifMatchAccepts(const std::string &header, const Reservation *reservation) {
+    if (!reservation) {
+        return false;
+    }
+    auto current = formatEtag(*reservation);
+    std::istringstream tags(header);
+    std::string tag;
+    while (std::getline(tags, tag, ',')) {
+        auto first = tag.find_first_not_of(" \t");
+        auto last = tag.find_last_not_of(" \t");
+        if (first == std::string::npos) {
+            continue;
+        }
+        tag = tag.substr(first, last - first + 1);
+        if (tag == "*" || tag == current) {
+            return true;
         }
-        closeSocket(serverFd);
-        serverFd = INVALID_SOCKET_HANDLE;
     }
-#endif
+    return false;
+}
 
-    serverFd = socket(AF_INET, SOCK_STREAM, 0);
-    if (serverFd == INVALID_SOCKET_HANDLE) {
-        throw std::runtime_error("Failed to create socket");
+// Adds optimistic concurrency to the single-reservation routes: reads carry the version as an
+// ETag, and writes sent with If-Match only go ahead if it still matches. The check and the write
+// run under the same restaurant mutex, so nothing can slip in between.
+HttpResponse dispatchApiRequest(const HttpRequest &request, Restaurant &restaurant) {
+    auto id = targetReservationId(request);
+    if (!id) {
+        return routeApiRequest(request, restaurant);
+    }
+    const auto &sheet = restaurant.getBookingSheet();
+    if (request.method != "GET") {
+        if (auto ifMatch = getHeader(request, "If-Match")) {
+            const auto *reservation = sheet.findReservationById(*id);
+            if (!ifMatchAccepts(*ifMatch, reservation)) {
+                HttpResponse failed{412, "text/plain; charset=utf-8", "Reservation has been modified"};
+                if (reservation) {
+                    failed.headers.emplace_back("ETag", formatEtag(*reservation));
+                }
+                return failed;
+            }
+        }
+    }
+    auto response = routeApiRequest(request, restaurant);
+    if (response.status < 300) {
+        if (const auto *reservation = sheet.findReservationById(*id)) {
+            response.headers.emplace_back("ETag", formatEtag(*reservation));
+        }
     }
+    return response;
+}
 
-#ifdef _WIN32
-    char opt = 1;
-    setsockopt(serverFd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-#else
-    int opt = 1;
-    setsockopt(serverFd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-#endif
+constexpr size_t kIdempotencyKeyCapacity = 10000;
+constexpr auto kIdempotencyKeyTtl = std::chrono::hours(24);
+constexpr size_t kMaxIdempotencyKeyLength = 255;
+
+// One hosted restaurant. Each has its own lock, so requests for different restaurants never
+// wait on each other.
+struct Tenant {
+    std::string id;
+    Restaurant &restaurant;
+    std::mutex mutex;
+    // Primary only; replicas receive its moves through the mutation log.
+    std::unique_ptr<TableOptimizer> optimizer;
+    // Writes sent with an Idempotency-Key header, keyed per restaurant.
+    IdempotencyTable<HttpResponse> idempotency{kIdempotencyKeyCapacity, kIdempotencyKeyTtl};
+    // Sheet sizes for /metrics, stored under the mutex after each write so a scrape takes no lock.
+    std::atomic<size_t> reservationCount{0};
+    std::atomic<size_t> orderCount{0};
+    std::atomic<size_t> tableCount{0};
+};
+
+// Call with the tenant's mutex held, after anything that may have changed the sheet.
+void publishSheetSizes(Tenant &tenant) {
+    const auto &sheet = tenant.restaurant.getBookingSheet();
+    tenant.reservationCount.store(sheet.getReservations().size(), std::memory_order_relaxed);
+    tenant.orderCount.store(sheet.getOrders().size(), std::memory_order_relaxed);
+    tenant.tableCount.store(sheet.getTables().size(), std::memory_order_relaxed);
+}
+
+// Status codes the server sends, each counted separately; anything else is counted as "other".
+constexpr int kCountedStatuses[] = {200, 201, 204, 400, 401, 403, 404, 405, 408, 409, 412, 422, 429, 500, 503};
+constexpr size_t kStatusSlots = std::size(kCountedStatuses) + 1;
+
+size_t statusSlot(int status) {
+    auto it = std::find(std::begin(kCountedStatuses), std::end(kCountedStatuses), status);
+    return static_cast<size_t>(it - std::begin(kCountedStatuses));
+}
+
+struct MetricRoute {
+    const char *method;
+    const char *route;
+};
+
+// The label sets requests are counted under. Ids in paths are replaced so the series stay few.
+constexpr MetricRoute kMetricRoutes[] = {
+    {"GET", "/api/restaurants"},
+    {"GET", "/api/tables"},
+    {"GET", "/api/reservations"},
+    {"POST", "/api/reservations"},
+    {"GET", "/api/reservations/{id}"},
+    {"PUT", "/api/reservations/{id}"},
+    {"DELETE", "/api/reservations/{id}"},
+    {"GET", "/api/reservations/{id}/bill"},
+    {"POST", "/api/reservations/{id}/status"},
+    {"POST", "/api/reservations/{id}/table"},
+    {"GET", "/api/customers/{phone}"},
+    {"GET", "/api/orders"},
+    {"POST", "/api/orders"},
+    {"GET", "/api/menu"},
+    {"GET", "/api/menu/popular"},
+    {"GET", "/api/staff"},
+    {"GET", "/api/report"},
+    {"POST", "/api/walkins"},
+    {"GET", "/api/waitlist"},
+    {"POST", "/api/waitlist"},
+    {"DELETE", "/api/waitlist/{id}"},
+    {"GET", "/api/availability"},
+    {"GET", "/api/replication"},
+    {"GET", "/api/optimize"},
+    {"POST", "/api/optimize"},
+    {"GET", "/api/analytics/summary"},
+    {"GET", "/api/analytics/occupancy"},
+    {"POST", "/api/day/close"},
+    {"OPTIONS", "/api/*"},
+    {"GET", "/metrics"},
+    {"GET", "static"},
+    {"other", "other"},
+    // Connections the reactor answered itself, before a whole request arrived.
+    {"none", "unread"},
+};
+constexpr size_t kMetricRouteCount = std::size(kMetricRoutes);
+constexpr size_t kOtherRoute = kMetricRouteCount - 2;
+constexpr size_t kUnreadRoute = kMetricRouteCount - 1;
+
+struct RouteMetrics {
+    ShardedCounters<kStatusSlots> responses;
+    // Time spent in handleApiRequest.
+    DurationHistogram apiLatency;
+};
+
+constexpr size_t kBytesReceived = 0;
+constexpr size_t kBytesSent = 1;
+
+// Served at /metrics. Everything here is updated without taking a lock.
+struct ServerMetrics {
+    std::array<RouteMetrics, kMetricRouteCount> routes;
+    // From accepting the connection to sending the response.
+    DurationHistogram requestLatency;
+    // Waiting for and holding restaurant mutexes, all restaurants together.
+    DurationHistogram lockWait;
+    DurationHistogram lockHold;
+    ShardedCounters<2> bytes;
+    std::atomic<size_t> workerThreads{0};
+};
+
+// Locks a restaurant mutex for the scope, timing the wait for it and the hold.
+class TimedLock {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    TimedLock(std::mutex &mutex, ServerMetrics &metrics) : mutex_(mutex), metrics_(metrics) {
+        auto requested = Clock::now();
+        mutex_.lock();
+        acquired_ = Clock::now();
+        metrics_.lockWait.observe(acquired_ - requested);
+    }
+    TimedLock(const TimedLock &) = delete;
+    TimedLock &operator=(const TimedLock &) = delete;
+    ~TimedLock() {
+        auto held = Clock::now() - acquired_;
+        mutex_.unlock();
+        metrics_.lockHold.observe(held);
+    }
+
+private:
+    std::mutex &mutex_;
+    ServerMetrics &metrics_;
+    Clock::time_point acquired_;
+};
+
+struct ServerContext {
+    // Fixed before the server starts accepting, so lookups need no lock.
+    std::unordered_map<std::string, std::unique_ptr<Tenant>> tenants;
+    std::vector<Tenant *> tenantOrder;
+    std::string staticRoot;
+    ReplicationHub replication;
+    std::unique_ptr<ReplicaClient> replica;
+    bool enforcePermissions = false;
+    // Shared by all restaurants; the pool runs one scan at a time.
+    std::unique_ptr<AnalyticsEngine> analytics;
+    std::unique_ptr<AdmissionController> admission;
+    // Connection threads alive; past maxConnections the reactor answers 503 itself.
+    std::atomic<size_t> openConnections{0};
+    size_t maxConnections = 0;
+    ConnectionLimits connectionLimits;
+    std::unique_ptr<ConnectionReactor> reactor;
+    // Signalled as connection threads finish, for the drain at shutdown.
+    std::mutex drainMutex;
+    std::condition_variable drained;
+    ServerMetrics metrics;
+};
+
+// Set from the signal handler, and by the hand-off thread once a successor has the socket.
+std::atomic<bool> shutdownRequested{false};
+
+void requestShutdown(int) { shutdownRequested = true; }
+
+constexpr const char *kTenantPathPrefix = "/api/r/";
+
+// Resolves "/api/r/{id}/..." to that restaurant and rewrites the path to the plain "/api/..."
+// route; unprefixed routes go to the first restaurant. Null for an unknown id.
+Tenant *resolveTenant(ServerContext &context, std::string &path) {
+    if (!startsWith(path, kTenantPathPrefix)) {
+        return context.tenantOrder.front();
+    }
+    auto idStart = std::string(kTenantPathPrefix).size();
+    auto idEnd = path.find('/', idStart);
+    auto it = context.tenants.find(path.substr(idStart, idEnd == std::string::npos ? std::string::npos : idEnd - idStart));
+    if (it == context.tenants.end()) {
+        return nullptr;
+    }
+    path = "/api" + (idEnd == std::string::npos ? std::string("/") : path.substr(idEnd));
+    return it->second.get();
+}
+
+std::string restaurantsToJson(const ServerContext &context) {
+    std::ostringstream oss;
+    oss << '[';
+    for (size_t i = 0; i < context.tenantOrder.size(); ++i) {
+        const auto &tenant = *context.tenantOrder[i];
+        if (i > 0) {
+            oss << ',';
+        }
+        oss << "{\"id\":\"" << escapeJson(tenant.id) << "\",";
+        oss << "\"name\":\"" << escapeJson(tenant.restaurant.getName()) << "\",";
+        oss << "\"address\":\"" << escapeJson(tenant.restaurant.getAddress()) << "\"}";
+    }
+    oss << ']';
+    return oss.str();
+}
+
+bool isMutatingMethod(const std::string &method) {
+    return method == "POST" || method == "PUT" || method == "DELETE";
+}
+
+// Logs what the restaurant changed since beginChangeCapture, if anything. Called with its mutex
+// still held, so each restaurant's records are in the log in the order the changes were made.
+void logChanges(ServerContext &context, Tenant &tenant) {
+    auto changes = tenant.restaurant.takeChanges();
+    if (!changes.empty()) {
+        context.replication.getLog().append(tenant.id, std::move(changes));
+        publishSheetSizes(tenant);
+    }
+}
+
+// Takes every restaurant's mutex, in a fixed order; while they are held nothing changes any
+// restaurant or appends to the log.
+std::vector<std::unique_lock<std::mutex>> lockAllTenants(ServerContext &context) {
+    std::vector<std::unique_lock<std::mutex>> locks;
+    for (auto *tenant : context.tenantOrder) {
+        locks.emplace_back(tenant->mutex);
+    }
+    return locks;
+}
+
+// Called with lockAllTenants held, so the states all match one position in the log: records are
+// appended while their restaurant's mutex is held.
+StateSnapshot snapshotLockedState(ServerContext &context) {
+    StateSnapshot snapshot;
+    snapshot.sequence = context.replication.getLog().lastSequence();
+    for (auto *tenant : context.tenantOrder) {
+        snapshot.restaurants.emplace_back(tenant->id, tenant->restaurant.exportState());
+    }
+    return snapshot;
+}
+
+StateSnapshot snapshotState(ServerContext &context) {
+    auto locks = lockAllTenants(context);
+    return snapshotLockedState(context);
+}
+
+// Replaces every restaurant's state with the primary's. Throws when the primary serves other
+// restaurants, or a state does not fit the floor or menu configured here.
+void installSnapshot(ServerContext &context, const StateSnapshot &snapshot) {
+    if (snapshot.restaurants.size() != context.tenants.size()) {
+        throw std::runtime_error("The primary serves " + std::to_string(snapshot.restaurants.size()) +
+                                 " restaurants, this replica " + std::to_string(context.tenants.size()));
+    }
+    for (const auto &[id, state] : snapshot.restaurants) {
+        auto it = context.tenants.find(id);
+        if (it == context.tenants.end()) {
+            throw std::runtime_error("The primary's restaurant " + id + " is not served here");
+        }
+        auto &tenant = *it->second;
+        TimedLock lock(tenant.mutex, context.metrics);
+        if (!tenant.restaurant.installState(state)) {
+            throw std::runtime_error("The primary's state of restaurant " + id + " does not fit its floor or menu here");
+        }
+        publishSheetSizes(tenant);
+    }
+}
+
+std::string replicationStatusToJson(const ServerContext &context) {
+    std::ostringstream oss;
+    if (context.replica) {
+        const auto &replica = *context.replica;
+        auto applied = replica.getAppliedSequence();
+        auto primaryLast = replica.getPrimarySequence();
+        oss << '{';
+        oss << "\"role\":\"replica\",";
+        oss << "\"primary\":\"" << escapeJson(replica.getHost()) << ':' << replica.getPort() << "\",";
+        oss << "\"connected\":" << (replica.isConnected() ? "true" : "false") << ',';
+        oss << "\"diverged\":" << (replica.hasDiverged() ? "true" : "false") << ',';
+        oss << "\"epoch\":\"" << replica.getEpoch() << "\",";
+        oss << "\"resyncs\":" << replica.getResyncCount() << ',';
+        oss << "\"appliedSequence\":" << applied << ',';
+        oss << "\"primarySequence\":" << primaryLast << ',';
+        oss << "\"lagEntries\":" << (primaryLast > applied ? primaryLast - applied : 0);
+        oss << '}';
+        return oss.str();
+    }
+    oss << '{';
+    oss << "\"role\":\"primary\",";
+    oss << "\"epoch\":\"" << context.replication.getEpoch() << "\",";
+    oss << "\"lastSequence\":" << context.replication.getLog().lastSequence() << ',';
+    oss << "\"replicas\":[";
+    auto statuses = context.replication.getReplicaStatuses();
+    for (size_t i = 0; i < statuses.size(); ++i) {
+        if (i > 0) {
+            oss << ',';
+        }
+        oss << '{';
+        oss << "\"peer\":\"" << escapeJson(statuses[i].peer) << "\",";
+        oss << "\"ackedSequence\":" << statuses[i].ackedSequence << ',';
+        oss << "\"lagEntries\":" << statuses[i].lagEntries << ',';
+        oss << "\"lagMilliseconds\":" << statuses[i].lag.count();
+        oss << '}';
+    }
+    oss << "]}";
+    return oss.str();
+}
+
+std::string optimizerStatusToJson(const TableOptimizer &optimizer, bool includeLastRun) {
+    std::ostringstream oss;
+    oss << '{';
+    auto interval = optimizer.getAutomaticInterval();
+    oss << "\"automatic\":" << (interval ? "true" : "false") << ',';
+    oss << "\"intervalSeconds\":";
+    if (interval) {
+        oss << interval->count();
+    } else {
+        oss << "null";
+    }
+    if (!includeLastRun) {
+        oss << '}';
+        return oss.str();
+    }
+    oss << ",\"lastRun\":";
+    auto report = optimizer.getLastReport();
+    if (!report) {
+        oss << "null}";
+        return oss.str();
+    }
+    const auto &plan = report->plan;
+    char timeText[kDateTimeTextLength];
+    oss << "{\"finishedAt\":\"";
+    oss.write(timeText, static_cast<std::streamsize>(formatDateTime(report->finishedAt, timeText)));
+    oss << "\",";
+    oss << "\"plannedMoves\":" << plan.moves.size() << ',';
+    oss << "\"appliedMoves\":" << report->applied.size() << ',';
+    oss << "\"seatedGuestsBefore\":" << plan.seatedGuestsBefore << ',';
+    oss << "\"seatedGuestsAfter\":" << plan.seatedGuestsAfter << ',';
+    oss << "\"openingsBefore\":" << plan.openingsBefore << ',';
+    oss << "\"openingsAfter\":" << plan.openingsAfter << ',';
+    oss << "\"emptySeatsBefore\":" << plan.emptySeatsBefore << ',';
+    oss << "\"emptySeatsAfter\":" << plan.emptySeatsAfter << ',';
+    oss << "\"moves\":[";
+    for (size_t i = 0; i < report->applied.size(); ++i) {
+        const auto &move = report->applied[i];
+        if (i > 0) {
+            oss << ',';
+        }
+        oss << "{\"reservationId\":\"" << move.reservationId << "\",\"fromTableIds\":";
+        writeTableIdArray(oss, move.fromTableIds);
+        oss << ",\"toTableIds\":";
+        writeTableIdArray(oss, move.toTableIds);
+        oss << '}';
+    }
+    oss << "]}}";
+    return oss.str();
+}
+
+// Takes the snapshot and commits the moves under the restaurant mutex; the optimizer plans in
+// between without it. A commit is logged as a single record, so a replica takes the whole batch
+// at once.
+std::unique_ptr<TableOptimizer> createTableOptimizer(ServerContext &context, Tenant &tenant) {
+    return std::make_unique<TableOptimizer>(
+        [&context, &tenant] {
+            TimedLock lock(tenant.mutex, context.metrics);
+            return tenant.restaurant.getBookingSheet().snapshotTablePlan();
+        },
+        [&context, &tenant](const std::vector<TableMove> &moves) {
+            TimedLock lock(tenant.mutex, context.metrics);
+            tenant.restaurant.beginChangeCapture();
+            auto applied = tenant.restaurant.getBookingSheet().applyTableMoves(moves);
+            logChanges(context, tenant);
+            return applied;
+        });
+}
+
+// POST runs the optimizer once (mode=run, the default) or switches the automatic mode with
+// mode=auto&intervalSeconds=N / mode=off. GET reports the mode and the last run.
+HttpResponse handleOptimizeRequest(const HttpRequest &request, Tenant &tenant) {
+    auto &optimizer = *tenant.optimizer;
+    HttpResponse response;
+    if (request.method == "GET") {
+        response.body = optimizerStatusToJson(optimizer, true);
+        return response;
+    }
+    auto data = parseFormEncoded(request.body);
+    auto mode = getFirstField(data, "mode").value_or("run");
+    if (mode == "run") {
+        optimizer.runOnce();
+        response.body = optimizerStatusToJson(optimizer, true);
+    } else if (mode == "auto") {
+        auto interval = toInt(getFirstField(data, "intervalSeconds").value_or("60"));
+        if (!interval || *interval <= 0) {
+            return {400, "text/plain; charset=utf-8", "Invalid intervalSeconds"};
+        }
+        optimizer.startAutomatic(std::chrono::seconds(*interval));
+        response.body = optimizerStatusToJson(optimizer, false);
+    } else if (mode == "off") {
+        optimizer.stopAutomatic();
+        response.body = optimizerStatusToJson(optimizer, false);
+    } else {
+        return {400, "text/plain; charset=utf-8", "Invalid mode"};
+    }
+    return response;
+}
+
+std::string analyticsSummaryToJson(const AnalyticsSummary &summary,
+                                   size_t workers,
+                                   std::chrono::microseconds elapsed) {
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(4);
+    oss << '{';
+    oss << "\"days\":" << summary.days << ',';
+    oss << "\"reservations\":" << summary.reservations << ',';
+    oss << "\"cancelled\":" << summary.cancelled << ',';
+    oss << "\"noShows\":" << summary.noShows << ',';
+    oss << "\"noShowRate\":" << summary.noShowRate() << ',';
+    oss << "\"completed\":" << summary.completed << ',';
+    oss << "\"averageTurnMinutes\":" << summary.averageTurnMinutes() << ',';
+    oss << "\"revenue\":" << summary.revenue.toString() << ',';
+    oss << "\"seatHours\":" << static_cast<double>(summary.openSeatMinutes) / 60.0 << ',';
+    oss << "\"revenuePerSeatHour\":" << summary.revenuePerSeatHour().toString() << ',';
+    oss << "\"workers\":" << workers << ',';
+    oss << "\"elapsedMicroseconds\":" << elapsed.count();
+    oss << '}';
+    return oss.str();
+}
+
+// Rows are weekdays from Sunday, columns hours; null where the restaurant is closed.
+std::string occupancyToJson(const AnalyticsSummary &summary) {
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(4);
+    oss << "{\"days\":" << summary.days << ",\"occupancy\":[";
+    for (size_t weekday = 0; weekday < AnalyticsSummary::kDaysPerWeek; ++weekday) {
+        oss << (weekday > 0 ? ",[" : "[");
+        for (size_t hour = 0; hour < AnalyticsSummary::kHoursPerDay; ++hour) {
+            if (hour > 0) {
+                oss << ',';
+            }
+            if (auto occupancy = summary.occupancy(weekday, hour)) {
+                oss << *occupancy;
+            } else {
+                oss << "null";
+            }
+        }
+        oss << ']';
+    }
+    oss << "]}";
+    return oss.str();
+}
+
+bool isDateText(const std::string &text) {
+    return text.size() == 10 && parseDateTime(text + " 00:00").has_value();
+}
+
+// GET /api/analytics/summary and /api/analytics/occupancy over from..to (inclusive dates, both
+// optional), with opening hours openHour..closeHour for seat capacity.
+HttpResponse handleAnalyticsRequest(const HttpRequest &request, ServerContext &context, Tenant &tenant) {
+    auto params = parseFormEncoded(request.query);
+    AnalyticsQuery query;
+    query.fromDate = getFirstField(params, "from").value_or("");
+    query.toDate = getFirstField(params, "to").value_or("");
+    if ((!query.fromDate.empty() && !isDateText(query.fromDate)) ||
+        (!query.toDate.empty() && !isDateText(query.toDate))) {
+        return {400, "text/plain; charset=utf-8", "Invalid date"};
+    }
+    auto openHour = toInt(getFirstField(params, "openHour").value_or("11"));
+    auto closeHour = toInt(getFirstField(params, "closeHour").value_or("23"));
+    if (!openHour || !closeHour || *openHour < 0 || *closeHour > 24 || *openHour >= *closeHour) {
+        return {400, "text/plain; charset=utf-8", "Invalid opening hours"};
+    }
+    query.openMinute = *openHour * 60;
+    query.closeMinute = *closeHour * 60;
+
+    auto started = std::chrono::steady_clock::now();
+    // Only the plan needs the restaurant mutex; waiting for the shared worker pool happens after
+    // it is released, so one restaurant's report never stalls another restaurant's writes.
+    AnalyticsPlan plan;
+    {
+        TimedLock lock(tenant.mutex, context.metrics);
+        plan = AnalyticsEngine::plan(tenant.restaurant, query);
+    }
+    auto summary = context.analytics->analyze(plan);
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started);
+    HttpResponse response;
+    if (request.path == "/api/analytics/summary") {
+        response.body = analyticsSummaryToJson(summary, context.analytics->getWorkerCount(), elapsed);
+    } else {
+        response.body = occupancyToJson(summary);
+    }
+    return response;
+}
+
+// Permission a route requires when enforcement is on; read-only routes other than staff,
+// customers and reports are open to everyone. The replication stream and /metrics are checked
+// in handleClient.
+std::optional<Permission> requiredPermission(const HttpRequest &request) {
+    if (request.method == "GET") {
+        if (request.path == "/api/report" || startsWith(request.path, "/api/analytics/")) {
+            return Permission::ViewReports;
+        }
+        if (request.path == "/api/staff") {
+            return Permission::ManageStaff;
+        }
+        if (startsWith(request.path, "/api/customers/")) {
+            return Permission::ViewCustomers;
+        }
+        return std::nullopt;
+    }
+    if (request.method == "POST" && (request.path == "/api/reservations" || request.path == "/api/walkins" ||
+                                     request.path == "/api/waitlist")) {
+        return Permission::CreateReservation;
+    }
+    if (request.method == "POST" && request.path == "/api/orders") {
+        return Permission::RecordOrders;
+    }
+    if (request.method == "POST" && request.path == "/api/day/close") {
+        return Permission::CloseDay;
+    }
+    if (isMutatingMethod(request.method)) {
+        return Permission::UpdateReservation;
+    }
+    return std::nullopt;
+}
+
+std::optional<HttpResponse> checkStaffPermission(const HttpRequest &request, const Tenant &tenant, Permission required) {
+    auto token = getHeader(request, "X-Staff-Token");
+    if (!token) {
+        return HttpResponse{401, "text/plain; charset=utf-8", "Missing staff token"};
+    }
+    // Tokens are only issued before the server starts accepting, so no lock is needed here.
+    const auto *staff = tenant.restaurant.findStaffByToken(*token);
+    if (!staff) {
+        return HttpResponse{401, "text/plain; charset=utf-8", "Unknown staff token"};
+    }
+    if (!staff->getRole().hasPermission(required)) {
+        return HttpResponse{403, "text/plain; charset=utf-8",
+                            "Missing permission: " + std::string(permissionName(required))};
+    }
+    return std::nullopt;
+}
+
+std::optional<HttpResponse> checkPermission(const HttpRequest &request, const Tenant &tenant) {
+    auto required = requiredPermission(request);
+    if (!required) {
+        return std::nullopt;
+    }
+    return checkStaffPermission(request, tenant, *required);
+}
+
+// For routes covering every restaurant (/metrics, the replication stream): staff holding the
+// permission at any of them may use it.
+std::optional<HttpResponse> checkServerPermission(const HttpRequest &request,
+                                                  const ServerContext &context,
+                                                  Permission required) {
+    std::optional<HttpResponse> denied;
+    for (const auto *tenant : context.tenantOrder) {
+        auto result = checkStaffPermission(request, *tenant, required);
+        if (!result) {
+            return std::nullopt;
+        }
+        // A token known to some restaurant is reported as lacking the permission, not as unknown.
+        if (!denied || result->status == 403) {
+            denied = std::move(result);
+        }
+    }
+    return denied;
+}
+
+HttpResponse handleApiRequest(HttpRequest &request, ServerContext &context) {
+    if (request.method == "GET" && request.path == "/api/restaurants") {
+        HttpResponse response;
+        response.body = restaurantsToJson(context);
+        return response;
+    }
+    auto *tenant = resolveTenant(context, request.path);
+    if (!tenant) {
+        return {404, "text/plain; charset=utf-8", "Unknown restaurant"};
+    }
+    if (context.enforcePermissions) {
+        if (auto denied = checkPermission(request, *tenant)) {
+            return *denied;
+        }
+    }
+    if (request.method == "GET" && request.path == "/api/replication") {
+        HttpResponse response;
+        response.body = replicationStatusToJson(context);
+        return response;
+    }
+    if (context.replica && isMutatingMethod(request.method)) {
+        return {405, "text/plain; charset=utf-8", "Read-only replica"};
+    }
+    if (request.path == "/api/optimize" && tenant->optimizer) {
+        if (request.method != "GET" && request.method != "POST") {
+            return {405, "text/plain; charset=utf-8", "Method Not Allowed"};
+        }
+        return handleOptimizeRequest(request, *tenant);
+    }
+    if (request.method == "GET" &&
+        (request.path == "/api/analytics/summary" || request.path == "/api/analytics/occupancy")) {
+        return handleAnalyticsRequest(request, context, *tenant);
+    }
+
+    auto dispatch = [&] {
+        TimedLock lock(tenant->mutex, context.metrics);
+        if (!isMutatingMethod(request.method)) {
+            return dispatchApiRequest(request, tenant->restaurant);
+        }
+        tenant->restaurant.beginChangeCapture();
+        try {
+            auto response = dispatchApiRequest(request, tenant->restaurant);
+            logChanges(context, *tenant);
+            return response;
+        } catch (...) {
+            // Whatever the request changed before it failed has to reach the replicas as well.
+            logChanges(context, *tenant);
+            throw;
+        }
+    };
+    auto key = isMutatingMethod(request.method) ? getHeader(request, "Idempotency-Key") : std::nullopt;
+    if (!key) {
+        return dispatch();
+    }
+    if (key->empty() || key->size() > kMaxIdempotencyKeyLength) {
+        return {400, "text/plain; charset=utf-8", "Invalid Idempotency-Key"};
+    }
+    // A repeat waits for the first attempt inside the table, before taking the restaurant mutex.
+    auto canonical = request.method + ' ' + request.path + '\n' + getHeader(request, "If-Match").value_or("") + '\n' +
+                     request.body;
+    auto [response, outcome] = tenant->idempotency.run(*key, canonical, dispatch);
+    if (outcome == IdempotencyOutcome::KeyMismatch) {
+        return {422, "text/plain; charset=utf-8", "Idempotency-Key was already used for a different request"};
+    }
+    if (outcome == IdempotencyOutcome::Replayed) {
+        response.headers.emplace_back("Idempotent-Replayed", "true");
+    }
+    return response;
+}
+
+// Throws when the record does not apply cleanly: the state here no longer matches the primary's.
+void applyReplicatedMutation(ServerContext &context, const MutationRecord &record) {
+    auto it = context.tenants.find(record.tenant);
+    if (it == context.tenants.end()) {
+        throw std::runtime_error("Replicated mutation " + std::to_string(record.sequence) +
+                                 " targets unknown restaurant " + record.tenant);
+    }
+    auto &tenant = *it->second;
+    TimedLock lock(tenant.mutex, context.metrics);
+    bool applied = tenant.restaurant.applyChanges(record.changes);
+    publishSheetSizes(tenant);
+    if (!applied) {
+        throw std::runtime_error("Replicated mutation " + std::to_string(record.sequence) +
+                                 " does not apply to restaurant " + record.tenant);
+    }
+}
+
+// Claims the listening socket of the server at `path`, then installs its state, which arrives
+// once that server has drained, so no write it accepted is lost. The log carries on in the same
+// epoch, so replicas of that server resume here where they left off.
+SocketHandle takeOverListener(ServerContext &context, const std::string &path) {
+    SocketHandle channel = connectHandoff(path);
+    if (channel == INVALID_SOCKET_HANDLE) {
+        throw std::runtime_error("No server to take over at " + path);
+    }
+    SocketHandle listener = receiveSocketHandle(channel);
+    if (listener == INVALID_SOCKET_HANDLE) {
+        closeSocket(channel);
+        throw std::runtime_error("Hand-off from " + path + " failed");
+    }
+    std::cout << "Took over the listening socket from " << path << "; waiting for its state" << std::endl;
+    std::uint64_t epoch = 0;
+    StateSnapshot snapshot;
+    bool received = receiveState(channel, epoch, snapshot);
+    closeSocket(channel);
+    try {
+        // Serving without the previous server's state would lose its writes.
+        if (!received) {
+            throw std::runtime_error("The server at " + path + " did not hand over its state");
+        }
+        installSnapshot(context, snapshot);
+    } catch (...) {
+        closeSocket(listener);
+        throw;
+    }
+    context.replication.continueFrom(epoch, snapshot.sequence);
+    std::cout << "Took over the previous server's state at mutation sequence " << snapshot.sequence << "\n";
+    return listener;
+}
 
-    sockaddr_in address{};
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(static_cast<uint16_t>(port));
+void streamReplication(SocketHandle clientFd, ServerContext &context, const HttpRequest &request) {
+    auto query = parseFormEncoded(request.query);
+    auto readNumber = [&query](const char *name) -> std::uint64_t {
+        try {
+            return std::stoull(getFirstField(query, name).value_or("0"));
+        } catch (...) {
+            return 0;
+        }
+    };
+    std::string head = "HTTP/1.1 200 OK\r\nContent-Type: application/x-booking-mutation-log\r\n"
+                       "Connection: close\r\n\r\n";
+    // The stream is long-lived and paced by the hub, not by the request deadlines.
+    setSocketBlocking(clientFd, true);
+    if (portableSend(clientFd, head.c_str(), head.size()) < 0) {
+        return;
+    }
+    context.replication.serveReplica(clientFd, describePeer(clientFd), readNumber("from"), readNumber("epoch"));
+}
 
-    if (bind(serverFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) {
-        closeSocket(serverFd);
-        throw std::runtime_error("Failed to bind socket");
+// Front-desk writes first, report and analytics polling last; everything else is a read.
+RequestPriority classifyRequest(const HttpRequest &request) {
+    if (isMutatingMethod(request.method)) {
+        return RequestPriority::FrontDesk;
+    }
+    std::string_view route = request.path;
+    if (startsWith(request.path, kTenantPathPrefix)) {
+        auto slash = route.find('/', std::string_view(kTenantPathPrefix).size());
+        route = slash == std::string_view::npos ? std::string_view{} : route.substr(slash);
+    } else if (startsWith(request.path, "/api/")) {
+        route.remove_prefix(4);
+    }
+    if (route == "/report" || route.substr(0, 11) == "/analytics/" || route == "/menu/popular" ||
+        route == "/replication" || route == "/optimize" || route == "/metrics") {
+        return RequestPriority::Background;
     }
+    return RequestPriority::Read;
+}
 
-    if (listen(serverFd, 10) < 0) {
-        closeSocket(serverFd);
-        throw std::runtime_error("Failed to listen on socket");
+// Index into kMetricRoutes for a request, before handleApiRequest strips its restaurant prefix.
+size_t metricRouteIndex(const HttpRequest &request) {
+    static const auto routes = [] {
+        std::unordered_map<std::string, size_t> routes;
+        for (size_t i = 0; i < kOtherRoute; ++i) {
+            routes.emplace(std::string(kMetricRoutes[i].method) + ' ' + kMetricRoutes[i].route, i);
+        }
+        return routes;
+    }();
+    std::string route = request.path;
+    if (startsWith(route, kTenantPathPrefix)) {
+        auto slash = route.find('/', std::string(kTenantPathPrefix).size());
+        route = slash == std::string::npos ? "/api/" : "/api" + route.substr(slash);
+    }
+    if (!startsWith(route, "/api/")) {
+        if (route != "/metrics") {
+            route = "static";
+        }
+    } else if (request.method == "OPTIONS") {
+        route = "/api/*";
+    } else {
+        for (const char *prefix : {"/api/reservations/", "/api/waitlist/", "/api/customers/"}) {
+            if (startsWith(route, prefix)) {
+                auto rest = route.substr(std::strlen(prefix));
+                auto slash = rest.find('/');
+                route = prefix + std::string(std::strcmp(prefix, "/api/customers/") == 0 ? "{phone}" : "{id}") +
+                        (slash == std::string::npos ? "" : rest.substr(slash));
+                break;
+            }
+        }
     }
+    auto it = routes.find(request.method + ' ' + route);
+    return it == routes.end() ? kOtherRoute : it->second;
+}
 
-    return serverFd;
+std::string metricLabels(size_t route) {
+    return std::string("method=\"") + kMetricRoutes[route].method + "\",route=\"" +
+           escapeLabelValue(kMetricRoutes[route].route) + '"';
 }
 
+std::string metricsToText(ServerContext &context) {
+    auto &metrics = context.metrics;
+    std::ostringstream out;
+    writeMetricHeader(out, "booking_http_responses_total", "counter", "Responses sent, by route and status code.");
+    for (size_t route = 0; route < kMetricRouteCount; ++route) {
+        for (size_t slot = 0; slot < kStatusSlots; ++slot) {
+            auto count = metrics.routes[route].responses.total(slot);
+            if (count == 0) {
+                continue;
+            }
+            out << "booking_http_responses_total{" << metricLabels(route) << ",status=\"";
+            if (slot < std::size(kCountedStatuses)) {
+                out << kCountedStatuses[slot];
+            } else {
+                out << "other";
+            }
+            out << "\"} " << count << '\n';
+        }
+    }
+
+    writeMetricHeader(out,
+                      "booking_api_handler_duration_seconds",
+                      "histogram",
+                      "Time spent in the API handler, including waiting for the restaurant lock, by route.");
+    for (size_t route = 0; route < kMetricRouteCount; ++route) {
+        if (metrics.routes[route].apiLatency.count() > 0) {
+            metrics.routes[route].apiLatency.write(out, "booking_api_handler_duration_seconds", metricLabels(route));
+        }
+    }
+    writeMetricHeader(out,
+                      "booking_request_duration_seconds",
+                      "histogram",
+                      "Time from accepting a connection to sending its response, reading the request included.");
+    metrics.requestLatency.write(out, "booking_request_duration_seconds", "");
+
+    writeMetricHeader(out, "booking_received_bytes_total", "counter", "Request bytes received.");
+    out << "booking_received_bytes_total " << metrics.bytes.total(kBytesReceived) << '\n';
+    writeMetricHeader(out, "booking_sent_bytes_total", "counter", "Response bytes sent.");
+    out << "booking_sent_bytes_total " << metrics.bytes.total(kBytesSent) << '\n';
+
+    writeMetricHeader(out,
+                      "booking_open_connections",
+                      "gauge",
+                      "Connections still sending their request (reading) or being answered (handling).");
+    out << "booking_open_connections{state=\"reading\"} "
+        << (context.reactor ? context.reactor->pendingConnections() : 0) << '\n';
+    out << "booking_open_connections{state=\"handling\"} " << context.openConnections.load() << '\n';
+    writeMetricHeader(out, "booking_worker_threads", "gauge", "Connection threads currently running.");
+    out << "booking_worker_threads " << metrics.workerThreads.load() << '\n';
+
+    writeMetricHeader(out,
+                      "booking_lock_wait_seconds",
+                      "histogram",
+                      "Time spent waiting for a restaurant mutex, all restaurants together.");
+    metrics.lockWait.write(out, "booking_lock_wait_seconds", "");
+    writeMetricHeader(out,
+                      "booking_lock_hold_seconds",
+                      "histogram",
+                      "Time a restaurant mutex was held, all restaurants together.");
+    metrics.lockHold.write(out, "booking_lock_hold_seconds", "");
+
+    auto writeSizes = [&](const char *name, const char *help, std::atomic<size_t> Tenant::*size) {
+        writeMetricHeader(out, name, "gauge", help);
+        for (auto *tenant : context.tenantOrder) {
+            out << name << "{restaurant=\"" << escapeLabelValue(tenant->id) << "\"} "
+                << (tenant->*size).load(std::memory_order_relaxed) << '\n';
+        }
+    };
+    writeSizes("booking_reservations", "Reservations on the booking sheet.", &Tenant::reservationCount);
+    writeSizes("booking_orders", "Orders on the booking sheet.", &Tenant::orderCount);
+    writeSizes("booking_tables", "Tables on the floor plan.", &Tenant::tableCount);
+    return out.str();
+}
+
+HttpResponse buildRejection(const AdmissionController::Decision &decision) {
+    HttpResponse response;
+    response.contentType = "text/plain; charset=utf-8";
+    if (decision.result == AdmissionResult::RateLimited) {
+        response.status = 429;
+        response.body = "Too many requests from this client";
+    } else {
+        response.status = 503;
+        response.body = "Server busy";
+    }
+    response.headers.emplace_back("Retry-After", std::to_string(std::max<long long>(1, decision.retryAfter.count())));
+    return response;
+}
+
+// Returns the number of bytes sent: the whole response, or 0 if the client did not take it.
+size_t sendAndClose(SocketHandle clientFd, const HttpResponse &response, const ConnectionLimits &limits) {
+    auto text = buildResponse(response);
+    bool sent = sendWithin(clientFd, text.c_str(), text.size(), limits);
+    closeSocket(clientFd);
+    return sent ? text.size() : 0;
+}
+
+std::string buildCannedResponse(int status) {
+    HttpResponse response;
+    response.status = status;
+    response.contentType = "text/plain; charset=utf-8";
+    response.body = statusMessage(status);
+    if (status == 503) {
+        response.headers.emplace_back("Retry-After", "1");
+    }
+    return buildResponse(response);
+}
+
+// Runs on its own thread once the reactor has read the whole request; the socket is still
+// non-blocking, so the response goes out under the write deadlines.
+void handleClient(SocketHandle clientFd,
+                  const std::string &bytes,
+                  const std::string &clientHost,
+                  std::chrono::steady_clock::time_point accepted,
+                  ServerContext &context) {
+    auto &metrics = context.metrics;
+    metrics.bytes.add(kBytesReceived, bytes.size());
+    size_t route = kOtherRoute;
+    auto respond = [&](const HttpResponse &response) {
+        metrics.bytes.add(kBytesSent, sendAndClose(clientFd, response, context.connectionLimits));
+        metrics.routes[route].responses.add(statusSlot(response.status));
+        metrics.requestLatency.observe(std::chrono::steady_clock::now() - accepted);
+    };
+
+    HttpRequest request;
+    if (!parseHttpRequest(bytes, request)) {
+        respond({400, "text/plain; charset=utf-8", "Bad request"});
+        return;
+    }
+
+    if (request.method == "GET" && request.path == kReplicationStreamPath && !context.replica) {
+        if (context.enforcePermissions) {
+            if (auto denied = checkServerPermission(request, context, Permission::StreamReplication)) {
+                respond(*denied);
+                return;
+            }
+        }
+        streamReplication(clientFd, context, request);
+        closeSocket(clientFd);
+        return;
+    }
+
+    bool isApiRequest = startsWith(request.path, "/api/");
+    route = metricRouteIndex(request);
+
+    // Preflights cost nothing, so they skip the queue.
+    AdmissionController::Decision admission;
+    if (request.method != "OPTIONS") {
+        admission = context.admission->admit(clientHost, classifyRequest(request));
+        if (admission.result != AdmissionResult::Admitted) {
+            auto response = buildRejection(admission);
+            applyCorsHeaders(response, isApiRequest);
+            respond(response);
+            return;
+        }
+    }
+
+    HttpResponse response;
+    if (request.method == "OPTIONS" && isApiRequest) {
+        response = buildPreflightResponse();
+    } else if (isApiRequest) {
+        auto started = std::chrono::steady_clock::now();
+        response = handleApiRequest(request, context);
+        metrics.routes[route].apiLatency.observe(std::chrono::steady_clock::now() - started);
+        applyCorsHeaders(response, true);
+    } else if (request.method == "GET" && request.path == "/metrics") {
+        auto denied = context.enforcePermissions ? checkServerPermission(request, context, Permission::ViewReports)
+                                                 : std::nullopt;
+        response = denied ? *denied : HttpResponse{200, "text/plain; version=0.0.4; charset=utf-8", metricsToText(context)};
+    } else {
+        response = serveStaticFile(context.staticRoot, request.path);
+        applyCorsHeaders(response, false);
+    }
+    respond(response);
+}
+
+}  // namespace
+
 void runWebServer(Restaurant &restaurant, const std::string &staticDir, int port) {
+    WebServerOptions options;
+    options.staticDir = staticDir;
+    options.port = port;
+    runWebServer(restaurant, options);
+}
+
+void runWebServer(Restaurant &restaurant, const WebServerOptions &options) {
+    runWebServer(std::vector<HostedRestaurant>{{"1", &restaurant}}, options);
+}
+
+void runWebServer(const std::vector<HostedRestaurant> &restaurants, const WebServerOptions &options) {
+    if (restaurants.empty()) {
+        throw std::runtime_error("No restaurants to serve");
+    }
+    ServerContext context;
+    for (const auto &hosted : restaurants) {
+        auto tenant = std::unique_ptr<Tenant>(new Tenant{hosted.id, *hosted.restaurant, {}, nullptr});
+        publishSheetSizes(*tenant);
+        context.tenantOrder.push_back(tenant.get());
+        if (!context.tenants.emplace(hosted.id, std::move(tenant)).second) {
+            throw std::runtime_error("Duplicate restaurant id: " + hosted.id);
+        }
+    }
+    context.staticRoot = options.staticDir;
+    context.replication.setSnapshotSource([&context] { return snapshotState(context); });
+    context.enforcePermissions = options.enforcePermissions;
+    context.analytics = std::make_unique<AnalyticsEngine>();
+    context.admission = std::make_unique<AdmissionController>(options.admission);
+    // Enough threads for every slot and its queue, with headroom for slow readers.
+    context.maxConnections = context.admission->getOptions().maxInFlight * 8;
+    context.connectionLimits = options.connections;
+
     [[maybe_unused]] SocketEnvironment socketEnv;
 
-    SocketHandle serverFd = createListeningSocket(port);
+    SocketHandle serverFd = options.takeOverFrom ? takeOverListener(context, *options.takeOverFrom)
+                                                 : createListeningSocket(options.port);
 
-    std::cout << "Web server running on http://localhost:" << port << "\n";
+    std::cout << "Web server running on http://localhost:" << options.port << "\n";
 #ifdef AF_INET6
-    std::cout << "Web server also available via http://[::1]:" << port << "\n";
+    std::cout << "Web server also available via http://[::1]:" << options.port << "\n";
 #endif
 
-    std::mutex mutex;
-    while (true) {
-        sockaddr_storage clientAddress{};
-        socklen_t clientLen = sizeof(clientAddress);
-        SocketHandle clientFd = accept(serverFd, reinterpret_cast<sockaddr *>(&clientAddress), &clientLen);
-        if (clientFd == INVALID_SOCKET_HANDLE) {
-#ifdef _WIN32
-            int error = WSAGetLastError();
-            if (error == WSAEINTR) {
-                continue;
+    if (context.tenantOrder.size() > 1) {
+        std::cout << "Serving " << context.tenantOrder.size() << " restaurants under " << kTenantPathPrefix
+                  << "{id}/; plain /api/ routes go to restaurant " << context.tenantOrder.front()->id << "\n";
+    }
+    if (options.enforcePermissions) {
+        std::cout << "Staff tokens (send as X-Staff-Token):\n";
+        for (const auto *tenant : context.tenantOrder) {
+            for (const auto &member : tenant->restaurant.getStaff()) {
+                std::cout << "  [" << tenant->id << "] " << member->getName() << " (" << member->getRole().getName()
+                          << "): " << tenant->restaurant.issueStaffToken(*member) << "\n";
             }
-#else
-            if (errno == EINTR) {
-                continue;
+        }
+        std::cout << std::flush;
+    }
+    if (options.replicaOf) {
+        std::string host;
+        int primaryPort = 0;
+        if (!parseHostPort(*options.replicaOf, host, primaryPort)) {
+            closeSocket(serverFd);
+            throw std::runtime_error("Invalid --replica-of address: " + *options.replicaOf);
+        }
+        context.replica = std::make_unique<ReplicaClient>(
+            host,
+            primaryPort,
+            options.replicaToken.value_or(""),
+            [&context](const MutationRecord &record) { applyReplicatedMutation(context, record); },
+            [&context](const StateSnapshot &snapshot) { installSnapshot(context, snapshot); });
+        context.replica->start();
+        std::cout << "Read-only replica following " << host << ':' << primaryPort << "\n";
+    } else {
+        for (auto *tenant : context.tenantOrder) {
+            tenant->optimizer = createTableOptimizer(context, *tenant);
+            if (options.optimizeInterval) {
+                tenant->optimizer->startAutomatic(*options.optimizeInterval);
             }
-#endif
-            continue;
         }
-        std::thread worker(handleClient, clientFd, std::ref(restaurant), std::ref(mutex), staticDir);
-        worker.detach();
+        if (options.optimizeInterval) {
+            std::cout << "Table optimizer running every " << options.optimizeInterval->count() << "s\n";
+        }
+    }
+
+    // A successor connecting here gets the listening socket, and this server then drains.
+    SocketHandle successor = INVALID_SOCKET_HANDLE;
+    SocketHandle handoffFd = INVALID_SOCKET_HANDLE;
+    std::thread handoffThread;
+    if (options.handoffSocket) {
+        handoffFd = createHandoffListener(*options.handoffSocket);
+        handoffThread = std::thread([handoffFd, serverFd, &successor] {
+            while (!shutdownRequested.load()) {
+                PollDescriptor descriptor{};
+                descriptor.fd = handoffFd;
+                descriptor.events = POLLIN;
+                if (portablePoll(&descriptor, 1, 250) <= 0) {
+                    continue;
+                }
+                SocketHandle channel = accept(handoffFd, nullptr, nullptr);
+                if (channel == INVALID_SOCKET_HANDLE) {
+                    continue;
+                }
+                if (!sendSocketHandle(channel, serverFd)) {
+                    closeSocket(channel);
+                    continue;
+                }
+                successor = channel;
+                shutdownRequested = true;
+            }
+        });
+        std::cout << "Successors can take over through " << *options.handoffSocket << "\n";
+    }
+
+    // Periodic work on the primary's sheets, each change logged like a request's: seating waiting
+    // parties at tables whose seatings have run out, and closing days if asked to.
+    std::thread housekeeping;
+    if (!options.replicaOf) {
+        housekeeping = std::thread([&context, dayRollover = options.dayRollover] {
+            while (!shutdownRequested.load()) {
+                auto today = formatDateTime(std::chrono::system_clock::now()).substr(0, 10);
+                for (auto *tenant : context.tenantOrder) {
+                    TimedLock lock(tenant->mutex, context.metrics);
+                    tenant->restaurant.beginChangeCapture();
+                    if (dayRollover && today > tenant->restaurant.getBookingSheet().getDate()) {
+                        tenant->restaurant.rollOver(today);
+                    }
+                    tenant->restaurant.getBookingSheet().seatWaitingParties();
+                    logChanges(context, *tenant);
+                }
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+            }
+        });
+        if (options.dayRollover) {
+            std::cout << "Days roll over at local midnight\n";
+        }
+    }
+    std::signal(SIGTERM, requestShutdown);
+    std::signal(SIGINT, requestShutdown);
+
+    // Requests are read here, on this thread; only complete ones get a worker.
+    context.reactor = std::make_unique<ConnectionReactor>(
+        serverFd,
+        options.connections,
+        frameHttpRequest,
+        [&context](SocketHandle clientFd,
+                   std::string bytes,
+                   const std::string &clientHost,
+                   ConnectionReactor::Clock::time_point accepted) {
+            if (context.openConnections.fetch_add(1) >= context.maxConnections) {
+                context.openConnections.fetch_sub(1);
+                return false;
+            }
+            std::thread worker([clientFd, bytes = std::move(bytes), clientHost, accepted, &context] {
+                context.metrics.workerThreads.fetch_add(1);
+                handleClient(clientFd, bytes, clientHost, accepted, context);
+                context.metrics.workerThreads.fetch_sub(1);
+                context.reactor->release(clientHost);
+                {
+                    std::lock_guard<std::mutex> lock(context.drainMutex);
+                    context.openConnections.fetch_sub(1);
+                }
+                context.drained.notify_all();
+            });
+            worker.detach();
+            return true;
+        },
+        [&context](int status) {
+            auto text = buildCannedResponse(status);
+            context.metrics.bytes.add(kBytesSent, text.size());
+            context.metrics.routes[kUnreadRoute].responses.add(statusSlot(status));
+            return text;
+        });
+    auto drainDeadline = context.reactor->run(shutdownRequested, options.drainTimeout);
+    // A successor holds its own copy; without one, new clients are now refused rather than queued.
+    closeSocket(serverFd);
+    std::cout << "Stopped accepting connections; draining" << std::endl;
+
+    if (handoffThread.joinable()) {
+        handoffThread.join();
+        // Removed before the successor, waiting on the log below, can bind the same path.
+        closeHandoffListener(handoffFd, *options.handoffSocket);
+    }
+    for (auto *tenant : context.tenantOrder) {
+        if (tenant->optimizer) {
+            tenant->optimizer->stopAutomatic();
+        }
+    }
+    if (housekeeping.joinable()) {
+        housekeeping.join();
+    }
+    if (context.replica) {
+        context.replica->stop();
+    }
+    // Replication streams are connection threads too; they end once their replica has the whole log.
+    context.replication.drain();
+    {
+        std::unique_lock<std::mutex> lock(context.drainMutex);
+        context.drained.wait_until(lock, drainDeadline, [&context] { return context.openConnections.load() == 0; });
+    }
+    auto unfinished = context.openConnections.load();
+    if (unfinished > 0) {
+        std::cerr << unfinished << " connections were still open when the drain timed out" << std::endl;
+    }
+
+    // Held until the process ends: connections the drain gave up on block on their restaurant
+    // instead of changing it behind the state handed to the successor.
+    auto frozen = lockAllTenants(context);
+    auto lastSequence = context.replication.getLog().lastSequence();
+    if (successor != INVALID_SOCKET_HANDLE) {
+        if (!context.replication.sendState(successor, snapshotLockedState(context))) {
+            std::cerr << "Failed to send the state to the successor" << std::endl;
+        }
+        closeSocket(successor);
+    }
+    std::cout << (successor != INVALID_SOCKET_HANDLE ? "Handed over" : "Shut down") << " at mutation sequence "
+              << lastSequence << std::endl;
+    if (unfinished > 0) {
+        // Those threads still use the context and the restaurants, which the caller destroys as
+        // soon as this returns. End the process here, without running any destructors, and with
+        // a failure status: their requests were cut off.
+        std::cerr << std::flush;
+        std::_Exit(EXIT_FAILURE);
     }
 }
 
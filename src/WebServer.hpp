@@ -1,12 +1,60 @@
 #pragma once
 
+#include "Admission.hpp"
+#include "Net.hpp"
 #include "ReservationSystem.hpp"
 
+#include <chrono>
+#include <optional>
 #include <string>
+#include <vector>
 
 namespace booking {
 
+struct WebServerOptions {
+    int port = 8080;
+    std::string staticDir;
+    // "host:port" of a primary to follow; the server then only answers read-only API routes.
+    std::optional<std::string> replicaOf;
+    // Staff token sent when following the primary; needed when the primary enforces permissions,
+    // where the stream requires StreamReplication.
+    std::optional<std::string> replicaToken;
+    // Require an X-Staff-Token header whose role grants each API route's permission. Tokens are
+    // issued for every staff member at startup and printed to stdout.
+    bool enforcePermissions = false;
+    // Re-pack upcoming reservations onto tables in the background at this interval; the
+    // optimizer can also be run or switched on through /api/optimize.
+    std::optional<std::chrono::seconds> optimizeInterval;
+    // Close each restaurant's day once the local date has passed it, as POST /api/day/close
+    // would. Primary only; replicas follow the rollover through the mutation log.
+    bool dayRollover = false;
+    // In-flight bounds, priorities and per-client rate limits; see AdmissionController.
+    AdmissionOptions admission;
+    // Deadlines for reading requests and writing responses, and connections per client; see
+    // ConnectionReactor.
+    ConnectionLimits connections;
+    // After SIGTERM or SIGINT, or once a successor has taken over, requests already in flight get
+    // this long to finish, and replicas to receive the rest of the mutation log.
+    std::chrono::seconds drainTimeout{30};
+    // Unix socket on which a successor started with takeOverFrom can claim the listening socket
+    // and this server's state. POSIX only.
+    std::optional<std::string> handoffSocket;
+    // The handoffSocket of a running server: take over its listening socket instead of binding
+    // the port, and replay its mutation log once it has drained. Start the successor with the
+    // same restaurants and seed data.
+    std::optional<std::string> takeOverFrom;
+};
+
+// A restaurant served under /api/r/{id}/...; the caller keeps it alive while the server runs.
+struct HostedRestaurant {
+    std::string id;
+    Restaurant *restaurant = nullptr;
+};
+
 void runWebServer(Restaurant &restaurant, const std::string &staticDir, int port = 8080);
+void runWebServer(Restaurant &restaurant, const WebServerOptions &options);
+// Serves several restaurants from one process, each with its own lock. The first also answers
+// the unprefixed /api/... routes. Returns once a SIGTERM, SIGINT or hand-off has been drained.
+void runWebServer(const std::vector<HostedRestaurant> &restaurants, const WebServerOptions &options);
 
 }  // namespace booking
-
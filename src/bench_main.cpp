@@ -0,0 +1,479 @@
+// Microbenchmarks for the booking core. Each case runs against a restaurant built once per
+// parameter set (tables, reservations, orders per reservation) and reports time, heap
+// allocations and throughput per operation. --json writes one object per line, which --compare
+// reads back as the baseline.
+//
+//   booking_bench [--filter TEXT] [--min-time-ms N] [--max-reservations N] [--json]
+//                 [--compare BASELINE.json] [--max-regression PERCENT]
+
+#include "JsonSerialization.hpp"
+#include "ReservationSystem.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <new>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace {
+std::atomic<std::size_t> gAllocations{0};
+std::atomic<std::size_t> gAllocatedBytes{0};
+
+void countAllocation(std::size_t size) {
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+    gAllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+}
+}  // namespace
+
+// Every heap allocation in the process goes through these, so a case's allocations are the
+// difference in the counters across its timed batch.
+void *operator new(std::size_t size) {
+    countAllocation(size);
+    if (void *memory = std::malloc(size == 0 ? 1 : size)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+    countAllocation(size);
+    auto align = static_cast<std::size_t>(alignment);
+#ifdef _WIN32
+    void *memory = _aligned_malloc(size == 0 ? 1 : size, align);
+#else
+    // aligned_alloc wants a size that is a multiple of the alignment.
+    void *memory = std::aligned_alloc(align, (std::max<std::size_t>(size, 1) + align - 1) / align * align);
+#endif
+    if (memory) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment) { return operator new(size, alignment); }
+
+void operator delete(void *memory) noexcept { std::free(memory); }
+void operator delete[](void *memory) noexcept { std::free(memory); }
+void operator delete(void *memory, std::size_t) noexcept { std::free(memory); }
+void operator delete[](void *memory, std::size_t) noexcept { std::free(memory); }
+
+#ifdef _WIN32
+void operator delete(void *memory, std::align_val_t) noexcept { _aligned_free(memory); }
+void operator delete[](void *memory, std::align_val_t) noexcept { _aligned_free(memory); }
+void operator delete(void *memory, std::size_t, std::align_val_t) noexcept { _aligned_free(memory); }
+void operator delete[](void *memory, std::size_t, std::align_val_t) noexcept { _aligned_free(memory); }
+#else
+void operator delete(void *memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void *memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete(void *memory, std::size_t, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void *memory, std::size_t, std::align_val_t) noexcept { std::free(memory); }
+#endif
+
+namespace {
+
+using booking::BookingSheet;
+using booking::Customer;
+using booking::MenuItem;
+using booking::Money;
+using booking::Restaurant;
+using booking::Table;
+
+using Clock = std::chrono::steady_clock;
+using TimePoint = std::chrono::system_clock::time_point;
+
+constexpr int kTableCounts[] = {5, 50, 500, 5000};
+constexpr int kReservationCounts[] = {100, 10'000, 1'000'000};
+constexpr int kOrderCounts[] = {0, 1, 4};
+// Held fixed while another parameter varies.
+constexpr int kDefaultTables = 50;
+constexpr int kDefaultReservations = 10'000;
+constexpr int kDefaultOrders = 1;
+constexpr int kCustomerPool = 20'000;
+constexpr int kServiceSlots = 56;  // Quarter hours from 10:00 to 24:00.
+
+struct FixtureKey {
+    int tables = 0;
+    int reservations = 0;
+    int ordersPerReservation = 0;
+
+    bool operator<(const FixtureKey &other) const {
+        return std::tie(tables, reservations, ordersPerReservation) <
+               std::tie(other.tables, other.reservations, other.ordersPerReservation);
+    }
+};
+
+struct Fixture {
+    std::unique_ptr<Restaurant> restaurant;
+    // Start times the availability cases cycle through, so no query repeats back to back.
+    std::vector<TimePoint> queryTimes;
+};
+
+// Tables of 2 to 8 seats, joined in pairs; reservations spread over the day, each with its
+// orders of two lines. Parties that find no table stay on the sheet unassigned.
+Fixture buildFixture(const FixtureKey &key) {
+    Fixture fixture;
+    fixture.restaurant = std::make_unique<Restaurant>("Bench", "Bench Street 1", BookingSheet{"2024-05-20"});
+    auto &restaurant = *fixture.restaurant;
+    auto &sheet = restaurant.getBookingSheet();
+    for (int id = 1; id <= key.tables; ++id) {
+        sheet.addTable(Table{id, 2 + 2 * (id % 4), id % 3 == 0 ? "Patio" : "Hall"});
+        if (id % 2 == 0) {
+            sheet.joinTables(id - 1, id);
+        }
+    }
+    restaurant.addMenuItem(MenuItem{"Seared Salmon", "Entree", Money::fromCents(2450)});
+    restaurant.addMenuItem(MenuItem{"Garden Salad", "Starter", Money::fromCents(850)});
+    restaurant.addMenuItem(MenuItem{"Tiramisu", "Dessert", Money::fromCents(750)});
+    const auto &menu = restaurant.getMenu();
+
+    auto opening = *booking::parseDateTime("2024-05-20 10:00");
+    for (int slot = 0; slot < kServiceSlots; ++slot) {
+        fixture.queryTimes.push_back(opening + std::chrono::minutes(15 * slot));
+    }
+    for (int i = 0; i < key.reservations; ++i) {
+        auto guest = i % kCustomerPool;
+        Customer customer{"Guest " + std::to_string(guest), "1390000" + std::to_string(10000 + guest)};
+        auto &reservation = sheet.createReservation(customer,
+                                                    1 + i % 8,
+                                                    fixture.queryTimes[static_cast<size_t>(i % kServiceSlots)],
+                                                    std::chrono::minutes(90));
+        for (int o = 0; o < key.ordersPerReservation; ++o) {
+            auto &order = sheet.recordOrder(reservation.getId());
+            sheet.addOrderItem(order.getId(), menu[static_cast<size_t>(o) % menu.size()], 1);
+            sheet.addOrderItem(order.getId(), menu[static_cast<size_t>(o + 1) % menu.size()], 2);
+        }
+    }
+    return fixture;
+}
+
+struct BenchCase {
+    std::string name;
+    FixtureKey key;
+    // Records one operation touches, for the throughput column.
+    double itemsPerOp = 1;
+    // Returns something derived from the result so the work cannot be optimised away.
+    std::function<std::size_t(Fixture &, std::uint64_t iteration)> run;
+
+    std::string id() const {
+        return name + "/tables=" + std::to_string(key.tables) + "/reservations=" + std::to_string(key.reservations) +
+               "/orders=" + std::to_string(key.ordersPerReservation);
+    }
+};
+
+TimePoint queryTime(const Fixture &fixture, std::uint64_t iteration) {
+    return fixture.queryTimes[iteration % fixture.queryTimes.size()];
+}
+
+std::vector<BenchCase> buildCases(int maxReservations) {
+    std::vector<BenchCase> cases;
+    // Availability and table status scale with both tables and bookings.
+    std::vector<FixtureKey> availabilityKeys;
+    for (int tables : kTableCounts) {
+        availabilityKeys.push_back({tables, kDefaultReservations, 0});
+    }
+    for (int reservations : kReservationCounts) {
+        if (reservations != kDefaultReservations) {
+            availabilityKeys.push_back({kDefaultTables * 10, reservations, 0});
+        }
+    }
+    for (const auto &key : availabilityKeys) {
+        auto tables = static_cast<double>(key.tables);
+        cases.push_back({"findAllAvailableTableIds", key, tables, [](Fixture &fixture, std::uint64_t i) {
+                             const auto &sheet = fixture.restaurant->getBookingSheet();
+                             return sheet
+                                 .findAllAvailableTableIds(1 + static_cast<int>(i % 8),
+                                                           queryTime(fixture, i),
+                                                           std::chrono::minutes(90))
+                                 .size();
+                         }});
+        // Whether one party fits anywhere: the single-table availability probe.
+        cases.push_back({"findAvailableTableId", key, tables, [](Fixture &fixture, std::uint64_t i) {
+                             const auto &sheet = fixture.restaurant->getBookingSheet();
+                             auto id = sheet.findAvailableTableId(1 + static_cast<int>(i % 8),
+                                                                  queryTime(fixture, i),
+                                                                  std::chrono::minutes(90));
+                             return static_cast<std::size_t>(id.value_or(0));
+                         }});
+        // Pinned to the fixture's service day, so tables come out occupied and reserved rather
+        // than all free as they would against today's wall clock.
+        cases.push_back({"updateTableStatuses", key, tables, [](Fixture &fixture, std::uint64_t i) {
+                             auto &sheet = fixture.restaurant->getBookingSheet();
+                             sheet.updateTableStatuses(queryTime(fixture, i));
+                             return sheet.getTables().size();
+                         }});
+    }
+
+    // Reports and serialisation scale with bookings and their orders.
+    std::vector<FixtureKey> recordKeys;
+    for (int reservations : kReservationCounts) {
+        recordKeys.push_back({kDefaultTables, reservations, kDefaultOrders});
+    }
+    for (int orders : kOrderCounts) {
+        if (orders != kDefaultOrders) {
+            recordKeys.push_back({kDefaultTables, kDefaultReservations, orders});
+        }
+    }
+    for (const auto &key : recordKeys) {
+        auto reservations = static_cast<double>(key.reservations);
+        auto orders = reservations * key.ordersPerReservation;
+        cases.push_back({"generateReport", key, 1, [](Fixture &fixture, std::uint64_t) {
+                             return fixture.restaurant->getBookingSheet().generateReport().getSeries().size();
+                         }});
+        auto pages = static_cast<std::uint64_t>(std::max(1, key.reservations / 100));
+        cases.push_back({"generateReport/breakdownPage100", key, 100, [pages](Fixture &fixture, std::uint64_t i) {
+                             auto report = fixture.restaurant->getBookingSheet().generateReport(
+                                 booking::ReportPage{static_cast<size_t>(i % pages * 100), 100});
+                             return report.getReservationBreakdown().size();
+                         }});
+        cases.push_back({"reportToJson", key, 1, [](Fixture &fixture, std::uint64_t) {
+                             auto report = fixture.restaurant->getBookingSheet().generateReport(booking::ReportPage{0, 100});
+                             return booking::reportToJson(report, true).size();
+                         }});
+        cases.push_back({"reservationsToJson", key, reservations, [](Fixture &fixture, std::uint64_t) {
+                             return booking::reservationsToJson(*fixture.restaurant).size();
+                         }});
+        if (key.ordersPerReservation > 0) {
+            cases.push_back({"ordersToJson", key, orders, [](Fixture &fixture, std::uint64_t) {
+                                 return booking::ordersToJson(*fixture.restaurant).size();
+                             }});
+        }
+    }
+    // tablesToJson walks every booking for every table, so it only runs on the smaller sheets.
+    for (int tables : kTableCounts) {
+        if (tables <= 500) {
+            FixtureKey key{tables, 1'000, kDefaultOrders};
+            cases.push_back({"tablesToJson", key, static_cast<double>(tables), [](Fixture &fixture, std::uint64_t) {
+                                 return booking::tablesToJson(*fixture.restaurant).size();
+                             }});
+        }
+    }
+
+    cases.erase(std::remove_if(cases.begin(), cases.end(),
+                               [&](const BenchCase &entry) { return entry.key.reservations > maxReservations; }),
+                cases.end());
+    return cases;
+}
+
+struct BenchResult {
+    std::string id;
+    std::uint64_t iterations = 0;
+    double nsPerOp = 0;
+    double allocationsPerOp = 0;
+    double bytesPerOp = 0;
+    double opsPerSecond = 0;
+    double itemsPerSecond = 0;
+    std::optional<double> baselineNsPerOp;
+};
+
+volatile std::size_t gSink = 0;
+
+// Doubles the batch until one takes at least `minTime`, and reports that batch.
+BenchResult measure(const BenchCase &entry, Fixture &fixture, std::chrono::milliseconds minTime) {
+    gSink = gSink + entry.run(fixture, 0);  // Warm-up: first-touch page faults and lazily built caches.
+    std::uint64_t iterations = 1;
+    std::uint64_t next = 0;
+    while (true) {
+        auto allocationsBefore = gAllocations.load(std::memory_order_relaxed);
+        auto bytesBefore = gAllocatedBytes.load(std::memory_order_relaxed);
+        auto started = Clock::now();
+        for (std::uint64_t i = 0; i < iterations; ++i) {
+            gSink = gSink + entry.run(fixture, next++);
+        }
+        auto elapsed = Clock::now() - started;
+        if (elapsed >= minTime) {
+            BenchResult result;
+            result.id = entry.id();
+            result.iterations = iterations;
+            auto count = static_cast<double>(iterations);
+            result.nsPerOp = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / count;
+            result.allocationsPerOp = static_cast<double>(gAllocations.load(std::memory_order_relaxed) - allocationsBefore) / count;
+            result.bytesPerOp = static_cast<double>(gAllocatedBytes.load(std::memory_order_relaxed) - bytesBefore) / count;
+            result.opsPerSecond = 1e9 / result.nsPerOp;
+            result.itemsPerSecond = result.opsPerSecond * entry.itemsPerOp;
+            return result;
+        }
+        // Aim just past minTime next, without growing more than tenfold on a noisy short batch.
+        auto elapsedNs = std::max<double>(1, static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        auto target = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(minTime).count()) * 1.2;
+        iterations = static_cast<std::uint64_t>(std::clamp(iterations * target / elapsedNs,
+                                                           static_cast<double>(iterations) * 2,
+                                                           static_cast<double>(iterations) * 10));
+    }
+}
+
+std::optional<double> numberField(const std::string &line, const std::string &key) {
+    auto marker = "\"" + key + "\":";
+    auto pos = line.find(marker);
+    if (pos == std::string::npos) {
+        return std::nullopt;
+    }
+    try {
+        return std::stod(line.substr(pos + marker.size()));
+    } catch (...) {
+        return std::nullopt;
+    }
+}
+
+// Reads nsPerOp by case id from an earlier --json run.
+std::map<std::string, double> loadBaseline(const std::string &path) {
+    std::map<std::string, double> baseline;
+    std::ifstream input(path);
+    std::string line;
+    const std::string idMarker = "\"id\":\"";
+    while (std::getline(input, line)) {
+        auto start = line.find(idMarker);
+        if (start == std::string::npos) {
+            continue;
+        }
+        start += idMarker.size();
+        auto end = line.find('"', start);
+        auto nsPerOp = numberField(line, "nsPerOp");
+        if (end != std::string::npos && nsPerOp) {
+            baseline[line.substr(start, end - start)] = *nsPerOp;
+        }
+    }
+    return baseline;
+}
+
+double changePercent(const BenchResult &result) {
+    return (result.nsPerOp / *result.baselineNsPerOp - 1.0) * 100.0;
+}
+
+void printTextRow(const BenchResult &result) {
+    std::cout << std::left << std::setw(84) << result.id << std::right << std::fixed << std::setprecision(1)
+              << std::setw(16) << result.nsPerOp << std::setw(12) << result.allocationsPerOp << std::setw(14)
+              << result.bytesPerOp << std::setprecision(0) << std::setw(16) << result.itemsPerSecond;
+    if (result.baselineNsPerOp) {
+        std::cout << std::showpos << std::setprecision(1) << std::setw(10) << changePercent(result) << '%'
+                  << std::noshowpos;
+    }
+    std::cout << std::endl;
+}
+
+void printJsonRow(const BenchResult &result, bool last) {
+    std::cout << "{\"id\":\"" << result.id << "\",\"iterations\":" << result.iterations << std::fixed
+              << std::setprecision(2) << ",\"nsPerOp\":" << result.nsPerOp << ",\"allocationsPerOp\":"
+              << result.allocationsPerOp << ",\"bytesPerOp\":" << result.bytesPerOp << ",\"opsPerSecond\":" << result.opsPerSecond << ",\"itemsPerSecond\":" << result.itemsPerSecond;
+    if (result.baselineNsPerOp) {
+        std::cout << std::setprecision(2) << ",\"baselineNsPerOp\":" << *result.baselineNsPerOp
+                  << ",\"changePercent\":" << changePercent(result);
+    }
+    std::cout << '}' << (last ? "" : ",") << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    std::string filter;
+    std::chrono::milliseconds minTime(200);
+    int maxReservations = 1'000'000;
+    bool json = false;
+    std::optional<std::string> comparePath;
+    std::optional<double> maxRegression;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        try {
+            if (arg == "--filter" && hasValue) {
+                filter = argv[++i];
+            } else if (arg == "--min-time-ms" && hasValue) {
+                minTime = std::chrono::milliseconds(std::stoi(argv[++i]));
+            } else if (arg == "--max-reservations" && hasValue) {
+                maxReservations = std::stoi(argv[++i]);
+            } else if (arg == "--json") {
+                json = true;
+            } else if (arg == "--compare" && hasValue) {
+                comparePath = argv[++i];
+            } else if (arg == "--max-regression" && hasValue) {
+                maxRegression = std::stod(argv[++i]);
+            } else {
+                std::cerr << "Usage: " << argv[0]
+                          << " [--filter TEXT] [--min-time-ms N] [--max-reservations N] [--json]"
+                             " [--compare BASELINE.json] [--max-regression PERCENT]"
+                          << std::endl;
+                return 1;
+            }
+        } catch (...) {
+            std::cerr << "Invalid value for " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    std::map<std::string, double> baseline;
+    if (comparePath) {
+        baseline = loadBaseline(*comparePath);
+        if (baseline.empty()) {
+            std::cerr << "No benchmark results found in " << *comparePath << std::endl;
+            return 1;
+        }
+    }
+
+#ifndef NDEBUG
+    std::cerr << "warning: built without optimisation; configure with -DCMAKE_BUILD_TYPE=Release for real figures"
+              << std::endl;
+#endif
+    auto cases = buildCases(maxReservations);
+    cases.erase(std::remove_if(cases.begin(), cases.end(),
+                               [&](const BenchCase &entry) { return entry.id().find(filter) == std::string::npos; }),
+                cases.end());
+    // Cases sharing a fixture run together, so each sheet is built once and freed before the next.
+    std::stable_sort(cases.begin(), cases.end(), [](const BenchCase &lhs, const BenchCase &rhs) { return lhs.key < rhs.key; });
+
+    if (json) {
+        std::cout << '[' << std::endl;
+    } else {
+        std::cout << std::left << std::setw(84) << "case" << std::right << std::setw(16) << "ns/op" << std::setw(12)
+                  << "allocs/op" << std::setw(14) << "bytes/op" << std::setw(16) << "items/s"
+                  << (baseline.empty() ? "" : "  vs base") << std::endl;
+    }
+    std::optional<FixtureKey> builtKey;
+    Fixture fixture;
+    int regressions = 0;
+    for (size_t i = 0; i < cases.size(); ++i) {
+        const auto &entry = cases[i];
+        if (!builtKey || *builtKey < entry.key || entry.key < *builtKey) {
+            fixture = Fixture{};
+            auto started = Clock::now();
+            fixture = buildFixture(entry.key);
+            builtKey = entry.key;
+            std::cerr << "fixture tables=" << entry.key.tables << " reservations=" << entry.key.reservations
+                      << " orders=" << entry.key.ordersPerReservation << " built in "
+                      << std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - started).count() << " ms"
+                      << std::endl;
+        }
+        auto result = measure(entry, fixture, minTime);
+        auto base = baseline.find(result.id);
+        if (base != baseline.end()) {
+            result.baselineNsPerOp = base->second;
+            if (maxRegression && changePercent(result) > *maxRegression) {
+                ++regressions;
+            }
+        }
+        if (json) {
+            printJsonRow(result, i + 1 == cases.size());
+        } else {
+            printTextRow(result);
+        }
+    }
+    if (json) {
+        std::cout << ']' << std::endl;
+    }
+    if (regressions > 0) {
+        std::cerr << regressions << " cases slowed down by more than " << *maxRegression << "%" << std::endl;
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,799 @@
+// Load generator for restaurant_booking_server. Replays a weighted mix of API calls in phases
+// read from a scenario file (or a built-in steady mix) and reports latency percentiles, status
+// codes and errors per phase.
+//
+// Closed loop: each connection sends its next request as soon as the last one is answered, so the
+// offered load follows the server. Open loop: requests are due at a constant rate whatever the
+// server does, and latency is measured from when a request was due rather than when a connection
+// got round to sending it, so a stalled server shows up as latency instead of as fewer requests.
+//
+//   booking_loadgen [--host HOST] [--port N] [--scenario FILE] [--mode open|closed]
+//                   [--rate N] [--connections N] [--duration SECONDS] [--keep-alive]
+//                   [--mix NAME=WEIGHT,...] [--timeout-ms N] [--date YYYY-MM-DD] [--token TOKEN]
+
+#include "Net.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using booking::SocketHandle;
+
+// Log-linear buckets in the style of HdrHistogram: exact below 128 us, then 64 sub-buckets per
+// power of two, so every recorded latency is off by under 1.6% and the table has a fixed size
+// however long the run.
+class LatencyHistogram {
+public:
+    LatencyHistogram() : counts_(kLinearBuckets + kMaxShift * kSubBuckets, 0) {}
+
+    void record(std::uint64_t micros) {
+        ++counts_[bucketIndex(micros)];
+        ++count_;
+        max_ = std::max(max_, micros);
+    }
+
+    void merge(const LatencyHistogram &other) {
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        count_ += other.count_;
+        max_ = std::max(max_, other.max_);
+    }
+
+    std::uint64_t count() const { return count_; }
+    std::uint64_t max() const { return max_; }
+
+    // The highest value of the bucket holding the given percentile, capped at the true maximum.
+    std::uint64_t percentile(double percent) const {
+        if (count_ == 0) {
+            return 0;
+        }
+        auto rank = static_cast<std::uint64_t>(std::ceil(percent / 100.0 * static_cast<double>(count_)));
+        rank = std::max<std::uint64_t>(rank, 1);
+        std::uint64_t seen = 0;
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            seen += counts_[i];
+            if (seen >= rank) {
+                return std::min(bucketCeiling(i), max_);
+            }
+        }
+        return max_;
+    }
+
+private:
+    static constexpr size_t kLinearBuckets = 128;
+    static constexpr size_t kSubBuckets = 64;
+    // Covers latencies up to about 2^46 us, far beyond any request timeout.
+    static constexpr size_t kMaxShift = 40;
+
+    static size_t bucketIndex(std::uint64_t value) {
+        if (value < kLinearBuckets) {
+            return static_cast<size_t>(value);
+        }
+        size_t shift = 1;
+        while ((value >> shift) >= kLinearBuckets) {
+            ++shift;
+        }
+        if (shift > kMaxShift) {
+            return kLinearBuckets + kMaxShift * kSubBuckets - 1;
+        }
+        return kLinearBuckets + (shift - 1) * kSubBuckets + static_cast<size_t>((value >> shift) - kSubBuckets);
+    }
+
+    static std::uint64_t bucketCeiling(size_t index) {
+        if (index < kLinearBuckets) {
+            return index;
+        }
+        auto shift = (index - kLinearBuckets) / kSubBuckets + 1;
+        auto sub = (index - kLinearBuckets) % kSubBuckets + kSubBuckets;
+        return ((static_cast<std::uint64_t>(sub) + 1) << shift) - 1;
+    }
+
+    std::vector<std::uint64_t> counts_;
+    std::uint64_t count_ = 0;
+    std::uint64_t max_ = 0;
+};
+
+// One weighted line of a phase. The path and body may hold placeholders, filled in per request:
+// {n} a number unique to the run, {party} a party size, {time} a dinner slot on --date (already
+// form-encoded) and {reservation} the id of a reservation this run has created.
+struct RequestTemplate {
+    std::string name;
+    double weight = 0;
+    std::string method;
+    std::string path;
+    std::string body;
+};
+
+struct Phase {
+    std::string name;
+    std::chrono::milliseconds duration{10000};
+    double rate = 100;
+    size_t connections = 8;
+    std::vector<RequestTemplate> requests;
+};
+
+enum class LoopMode { Closed, Open };
+
+struct RunOptions {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    LoopMode mode = LoopMode::Open;
+    bool keepAlive = false;
+    std::chrono::milliseconds timeout{5000};
+    std::string date = "2024-05-20";
+    std::string token;
+};
+
+struct PhaseStats {
+    LatencyHistogram latency;
+    std::map<int, std::uint64_t> statuses;
+    std::uint64_t connectFailures = 0;
+    std::uint64_t timeouts = 0;
+    std::uint64_t transportErrors = 0;
+    // Requests dropped because they act on a reservation and none had been created yet.
+    std::uint64_t skipped = 0;
+    std::uint64_t connectionsOpened = 0;
+
+    void merge(const PhaseStats &other) {
+        latency.merge(other.latency);
+        for (const auto &[status, count] : other.statuses) {
+            statuses[status] += count;
+        }
+        connectFailures += other.connectFailures;
+        timeouts += other.timeouts;
+        transportErrors += other.transportErrors;
+        skipped += other.skipped;
+        connectionsOpened += other.connectionsOpened;
+    }
+};
+
+// Ids of reservations created during the run, kept to the most recent few thousand.
+class ReservationPool {
+public:
+    void add(std::string id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (ids_.size() < kCapacity) {
+            ids_.push_back(std::move(id));
+        } else {
+            ids_[next_++ % kCapacity] = std::move(id);
+        }
+    }
+
+    std::optional<std::string> pick(std::mt19937 &random) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (ids_.empty()) {
+            return std::nullopt;
+        }
+        return ids_[random() % ids_.size()];
+    }
+
+private:
+    static constexpr size_t kCapacity = 4096;
+    std::mutex mutex_;
+    std::vector<std::string> ids_;
+    size_t next_ = 0;
+};
+
+// Used when no --scenario is given: mostly reads, with a steady trickle of bookings.
+const char *const kDefaultScenario = R"(
+phase steady seconds=10 rate=100
+request tables        30 GET  /api/tables
+request reservations  20 GET  /api/reservations
+request availability  25 GET  /api/availability?partySize={party}&from={time}
+request book          15 POST /api/reservations name=Guest+{n}&phone=1390000{n}&partySize={party}&time={time}
+request report        10 GET  /api/report?limit=20
+)";
+
+std::string trim(const std::string &text) {
+    auto begin = text.find_first_not_of(" \t\r");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    return text.substr(begin, text.find_last_not_of(" \t\r") - begin + 1);
+}
+
+// Scenario files are line based: "phase NAME [seconds=N] [rate=N] [connections=N]" starts a
+// phase and each following "request NAME WEIGHT METHOD PATH [BODY]" adds to its mix. Blank lines
+// and lines starting with '#' are ignored.
+std::vector<Phase> parseScenario(std::istream &input) {
+    std::vector<Phase> phases;
+    std::string line;
+    int lineNumber = 0;
+    auto fail = [&](const std::string &message) {
+        throw std::runtime_error("line " + std::to_string(lineNumber) + ": " + message);
+    };
+    while (std::getline(input, line)) {
+        ++lineNumber;
+        line = trim(line);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream fields(line);
+        std::string keyword;
+        fields >> keyword;
+        if (keyword == "phase") {
+            Phase phase;
+            if (!(fields >> phase.name)) {
+                fail("phase needs a name");
+            }
+            std::string setting;
+            while (fields >> setting) {
+                auto equals = setting.find('=');
+                if (equals == std::string::npos) {
+                    fail("expected key=value, got " + setting);
+                }
+                auto key = setting.substr(0, equals);
+                double value = 0;
+                try {
+                    value = std::stod(setting.substr(equals + 1));
+                } catch (...) {
+                    fail("invalid value for " + key);
+                }
+                if (value <= 0) {
+                    fail(key + " must be positive");
+                }
+                if (key == "seconds") {
+                    phase.duration = std::chrono::milliseconds(static_cast<long long>(value * 1000));
+                } else if (key == "rate") {
+                    phase.rate = value;
+                } else if (key == "connections") {
+                    phase.connections = static_cast<size_t>(value);
+                } else {
+                    fail("unknown phase setting " + key);
+                }
+            }
+            phases.push_back(std::move(phase));
+        } else if (keyword == "request") {
+            if (phases.empty()) {
+                fail("request before any phase");
+            }
+            RequestTemplate request;
+            if (!(fields >> request.name >> request.weight >> request.method >> request.path) || request.weight < 0) {
+                fail("expected: request NAME WEIGHT METHOD PATH [BODY]");
+            }
+            fields >> request.body;
+            phases.back().requests.push_back(std::move(request));
+        } else {
+            fail("unknown keyword " + keyword);
+        }
+    }
+    if (phases.empty()) {
+        throw std::runtime_error("no phases defined");
+    }
+    for (const auto &phase : phases) {
+        if (phase.requests.empty()) {
+            throw std::runtime_error("phase " + phase.name + " has no requests");
+        }
+    }
+    return phases;
+}
+
+// Applies "--mix name=weight,..." to every phase holding a request of that name.
+void applyMix(std::vector<Phase> &phases, const std::string &mix) {
+    std::istringstream entries(mix);
+    std::string entry;
+    while (std::getline(entries, entry, ',')) {
+        auto equals = entry.find('=');
+        if (equals == std::string::npos) {
+            throw std::runtime_error("expected name=weight in --mix, got " + entry);
+        }
+        auto name = entry.substr(0, equals);
+        auto weight = std::stod(entry.substr(equals + 1));
+        if (weight < 0) {
+            throw std::runtime_error("negative weight for " + name);
+        }
+        bool found = false;
+        for (auto &phase : phases) {
+            for (auto &request : phase.requests) {
+                if (request.name == name) {
+                    request.weight = weight;
+                    found = true;
+                }
+            }
+        }
+        if (!found) {
+            throw std::runtime_error("no request named " + name + " in the scenario");
+        }
+    }
+    for (const auto &phase : phases) {
+        bool anyWeight = std::any_of(phase.requests.begin(), phase.requests.end(), [](const RequestTemplate &request) {
+            return request.weight > 0;
+        });
+        if (!anyWeight) {
+            throw std::runtime_error("every request in phase " + phase.name + " has weight 0");
+        }
+    }
+}
+
+// Fills in a template's placeholders; false when it needs a reservation and there is none yet.
+bool expandPlaceholders(const std::string &text,
+                        const RunOptions &options,
+                        std::uint64_t sequence,
+                        std::mt19937 &random,
+                        ReservationPool &reservations,
+                        std::string &out) {
+    out.clear();
+    size_t pos = 0;
+    while (pos < text.size()) {
+        auto open = text.find('{', pos);
+        auto close = open == std::string::npos ? std::string::npos : text.find('}', open);
+        if (close == std::string::npos) {
+            out.append(text, pos, std::string::npos);
+            break;
+        }
+        out.append(text, pos, open - pos);
+        auto name = text.substr(open + 1, close - open - 1);
+        if (name == "n") {
+            out += std::to_string(sequence);
+        } else if (name == "party") {
+            // Mostly couples and foursomes, like a real dinner book.
+            static const int kPartySizes[] = {2, 2, 2, 2, 3, 4, 4, 4, 5, 6, 1, 8};
+            out += std::to_string(kPartySizes[random() % std::size(kPartySizes)]);
+        } else if (name == "time") {
+            // A quarter hour between 17:00 and 21:45.
+            auto minutes = 17 * 60 + 15 * static_cast<int>(random() % 20);
+            std::ostringstream time;
+            time << options.date << '+' << std::setw(2) << std::setfill('0') << minutes / 60 << "%3A" << std::setw(2)
+                 << minutes % 60;
+            out += time.str();
+        } else if (name == "reservation") {
+            auto id = reservations.pick(random);
+            if (!id) {
+                return false;
+            }
+            out += *id;
+        } else {
+            out.append(text, open, close - open + 1);
+        }
+        pos = close + 1;
+    }
+    return true;
+}
+
+enum class ExchangeResult { Ok, ConnectFailed, Timeout, TransportError };
+
+// A client connection that is reused across requests in --keep-alive mode for as long as the
+// server keeps it open.
+class Connection {
+public:
+    Connection(const RunOptions &options, PhaseStats &stats) : options_(options), stats_(stats) {}
+    Connection(const Connection &) = delete;
+    Connection &operator=(const Connection &) = delete;
+    ~Connection() { close(); }
+
+    ExchangeResult exchange(const std::string &request, int &status, std::string &body) {
+        bool reused = socket_ != booking::INVALID_SOCKET_HANDLE;
+        auto result = attempt(request, status, body);
+        // A kept-alive connection may have been closed by the server since its last reply; that
+        // is not the new request's fault, so it gets one retry on a fresh connection.
+        if (reused && result == ExchangeResult::TransportError && responseBytes_ == 0) {
+            result = attempt(request, status, body);
+        }
+        return result;
+    }
+
+private:
+    void close() {
+        if (socket_ != booking::INVALID_SOCKET_HANDLE) {
+            booking::closeSocket(socket_);
+            socket_ = booking::INVALID_SOCKET_HANDLE;
+        }
+    }
+
+    ExchangeResult attempt(const std::string &request, int &status, std::string &body) {
+        responseBytes_ = 0;
+        if (socket_ == booking::INVALID_SOCKET_HANDLE) {
+            socket_ = booking::connectToHost(options_.host, options_.port);
+            if (socket_ == booking::INVALID_SOCKET_HANDLE) {
+                return ExchangeResult::ConnectFailed;
+            }
+            ++stats_.connectionsOpened;
+        }
+        if (booking::portableSend(socket_, request.data(), request.size()) < 0) {
+            close();
+            return ExchangeResult::TransportError;
+        }
+        auto result = readResponse(status, body);
+        if (result != ExchangeResult::Ok || !options_.keepAlive || closeAfterResponse_) {
+            close();
+        }
+        return result;
+    }
+
+    // Waits up to the request timeout for more of the response. 0 means the server closed.
+    int receiveSome(char *data, size_t length, Clock::time_point deadline) {
+        auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - Clock::now()).count();
+        booking::PollDescriptor descriptor{};
+        descriptor.fd = socket_;
+        descriptor.events = POLLIN;
+        if (remaining <= 0 || booking::portablePoll(&descriptor, 1, static_cast<int>(remaining)) <= 0) {
+            return -2;
+        }
+        return booking::portableRecv(socket_, data, length);
+    }
+
+    ExchangeResult readResponse(int &status, std::string &body) {
+        auto deadline = Clock::now() + options_.timeout;
+        std::string buffer;
+        char temp[8192];
+        size_t headerEnd = std::string::npos;
+        while ((headerEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+            int received = receiveSome(temp, sizeof(temp), deadline);
+            if (received == -2) {
+                return ExchangeResult::Timeout;
+            }
+            if (received <= 0) {
+                return ExchangeResult::TransportError;
+            }
+            responseBytes_ += static_cast<size_t>(received);
+            buffer.append(temp, static_cast<size_t>(received));
+        }
+
+        std::istringstream head(buffer.substr(0, headerEnd));
+        std::string statusLine;
+        std::getline(head, statusLine);
+        std::istringstream statusFields(statusLine);
+        std::string version;
+        if (!(statusFields >> version >> status)) {
+            return ExchangeResult::TransportError;
+        }
+        std::optional<size_t> contentLength;
+        closeAfterResponse_ = false;
+        std::string header;
+        while (std::getline(head, header)) {
+            auto colon = header.find(':');
+            if (colon == std::string::npos) {
+                continue;
+            }
+            auto name = header.substr(0, colon);
+            std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+            auto value = trim(header.substr(colon + 1));
+            if (name == "content-length") {
+                contentLength = static_cast<size_t>(std::stoul(value));
+            } else if (name == "connection" && value.find("close") != std::string::npos) {
+                closeAfterResponse_ = true;
+            }
+        }
+
+        body = buffer.substr(headerEnd + 4);
+        while (!contentLength || body.size() < *contentLength) {
+            int received = receiveSome(temp, sizeof(temp), deadline);
+            if (received == -2) {
+                return ExchangeResult::Timeout;
+            }
+            if (received == 0 && !contentLength) {
+                closeAfterResponse_ = true;
+                break;
+            }
+            if (received <= 0) {
+                return ExchangeResult::TransportError;
+            }
+            body.append(temp, static_cast<size_t>(received));
+        }
+        if (contentLength) {
+            body.resize(*contentLength);
+        }
+        return ExchangeResult::Ok;
+    }
+
+    const RunOptions &options_;
+    PhaseStats &stats_;
+    SocketHandle socket_ = booking::INVALID_SOCKET_HANDLE;
+    size_t responseBytes_ = 0;
+    bool closeAfterResponse_ = false;
+};
+
+std::string buildRequest(const RequestTemplate &request,
+                         const std::string &path,
+                         const std::string &body,
+                         const RunOptions &options) {
+    std::ostringstream oss;
+    oss << request.method << ' ' << path << " HTTP/1.1\r\n"
+        << "Host: " << options.host << ':' << options.port << "\r\n"
+        << "Connection: " << (options.keepAlive ? "keep-alive" : "close") << "\r\n";
+    if (!options.token.empty()) {
+        oss << "X-Staff-Token: " << options.token << "\r\n";
+    }
+    if (!body.empty() || request.method == "POST") {
+        oss << "Content-Type: application/x-www-form-urlencoded\r\n"
+            << "Content-Length: " << body.size() << "\r\n";
+    }
+    oss << "\r\n" << body;
+    return oss.str();
+}
+
+// Picks up the id from a successful POST /api/reservations reply.
+void rememberReservation(const std::string &body, ReservationPool &reservations) {
+    const std::string marker = "\"id\":\"";
+    auto start = body.find(marker);
+    if (start == std::string::npos) {
+        return;
+    }
+    start += marker.size();
+    auto end = body.find('"', start);
+    if (end != std::string::npos) {
+        reservations.add(body.substr(start, end - start));
+    }
+}
+
+struct PhaseRun {
+    const Phase &phase;
+    const RunOptions &options;
+    Clock::time_point start;
+    Clock::time_point end;
+    // Open loop: the index of the next arrival, which fixes when it is due.
+    std::atomic<std::uint64_t> &nextArrival;
+    std::atomic<std::uint64_t> &sequence;
+    ReservationPool &reservations;
+};
+
+void runConnection(PhaseRun &run, PhaseStats &stats, unsigned seed) {
+    std::mt19937 random(seed);
+    std::vector<double> weights;
+    for (const auto &request : run.phase.requests) {
+        weights.push_back(request.weight);
+    }
+    std::discrete_distribution<size_t> choose(weights.begin(), weights.end());
+    auto arrivalInterval = std::chrono::duration<double>(1.0 / run.phase.rate);
+    Connection connection(run.options, stats);
+    std::string path;
+    std::string body;
+    std::string responseBody;
+
+    while (true) {
+        Clock::time_point due;
+        if (run.options.mode == LoopMode::Open) {
+            auto arrival = run.nextArrival.fetch_add(1);
+            due = run.start +
+                  std::chrono::duration_cast<Clock::duration>(arrivalInterval * static_cast<double>(arrival));
+            if (due >= run.end) {
+                break;
+            }
+            std::this_thread::sleep_until(due);
+        } else {
+            due = Clock::now();
+            if (due >= run.end) {
+                break;
+            }
+        }
+
+        const auto &request = run.phase.requests[choose(random)];
+        auto sequence = run.sequence.fetch_add(1);
+        if (!expandPlaceholders(request.path, run.options, sequence, random, run.reservations, path) ||
+            !expandPlaceholders(request.body, run.options, sequence, random, run.reservations, body)) {
+            ++stats.skipped;
+            continue;
+        }
+        int status = 0;
+        auto result = connection.exchange(buildRequest(request, path, body, run.options), status, responseBody);
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - due);
+        switch (result) {
+            case ExchangeResult::Ok:
+                stats.latency.record(static_cast<std::uint64_t>(std::max<long long>(0, elapsed.count())));
+                ++stats.statuses[status];
+                if (status == 201 && request.method == "POST" && path == "/api/reservations") {
+                    rememberReservation(responseBody, run.reservations);
+                }
+                break;
+            case ExchangeResult::ConnectFailed:
+                ++stats.connectFailures;
+                break;
+            case ExchangeResult::Timeout:
+                ++stats.timeouts;
+                break;
+            case ExchangeResult::TransportError:
+                ++stats.transportErrors;
+                break;
+        }
+        if (result == ExchangeResult::ConnectFailed) {
+            // Keep a dead server from turning the closed loop into a busy loop.
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+}
+
+std::string formatMillis(std::uint64_t micros) {
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(2) << static_cast<double>(micros) / 1000.0 << " ms";
+    return oss.str();
+}
+
+void printStats(const std::string &title, const PhaseStats &stats, std::chrono::duration<double> elapsed) {
+    const auto &latency = stats.latency;
+    auto seconds = std::max(elapsed.count(), 1e-9);
+    std::uint64_t errorResponses = 0;
+    for (const auto &[status, count] : stats.statuses) {
+        if (status >= 400) {
+            errorResponses += count;
+        }
+    }
+    // Formatted apart so the fixed precision does not stick to std::cout.
+    std::ostringstream rate;
+    rate << std::fixed << std::setprecision(1) << seconds << " s (" << static_cast<double>(latency.count()) / seconds
+         << "/s)";
+    std::cout << title << ": " << latency.count() << " responses in " << rate.str() << '\n';
+    std::cout << "  latency   p50 " << formatMillis(latency.percentile(50)) << "   p99 "
+              << formatMillis(latency.percentile(99)) << "   p99.9 " << formatMillis(latency.percentile(99.9))
+              << "   max " << formatMillis(latency.max()) << '\n';
+    std::cout << "  status   ";
+    for (const auto &[status, count] : stats.statuses) {
+        std::cout << ' ' << status << " x" << count;
+    }
+    std::cout << "   (" << errorResponses << " error responses)\n";
+    std::cout << "  failures  connect " << stats.connectFailures << "   timeout " << stats.timeouts << "   transport "
+              << stats.transportErrors << "   skipped " << stats.skipped << "   connections opened "
+              << stats.connectionsOpened << std::endl;
+}
+
+PhaseStats runPhase(const Phase &phase,
+                    const RunOptions &options,
+                    std::atomic<std::uint64_t> &sequence,
+                    ReservationPool &reservations) {
+    std::atomic<std::uint64_t> nextArrival{0};
+    auto start = Clock::now();
+    PhaseRun run{phase, options, start, start + phase.duration, nextArrival, sequence, reservations};
+    std::vector<PhaseStats> perConnection(phase.connections);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < phase.connections; ++i) {
+        auto seed = static_cast<unsigned>(sequence.load() * 31 + i);
+        threads.emplace_back([&run, &perConnection, i, seed] { runConnection(run, perConnection[i], seed); });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    PhaseStats total;
+    for (const auto &stats : perConnection) {
+        total.merge(stats);
+    }
+    return total;
+}
+
+std::optional<double> positiveNumber(const std::string &text) {
+    try {
+        auto value = std::stod(text);
+        if (value > 0) {
+            return value;
+        }
+    } catch (...) {
+    }
+    return std::nullopt;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    RunOptions options;
+    std::optional<std::string> scenarioPath;
+    std::optional<std::string> mix;
+    std::optional<double> rate;
+    std::optional<double> duration;
+    std::optional<size_t> connections;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        std::optional<double> number;
+        if (hasValue && (arg == "--port" || arg == "--rate" || arg == "--connections" || arg == "--duration" ||
+                         arg == "--timeout-ms")) {
+            number = positiveNumber(argv[i + 1]);
+            if (!number) {
+                std::cerr << "Invalid value for " << arg << std::endl;
+                return 1;
+            }
+        }
+        if (arg == "--host" && hasValue) {
+            options.host = argv[++i];
+        } else if (arg == "--port" && number) {
+            options.port = static_cast<int>(*number);
+            ++i;
+        } else if (arg == "--scenario" && hasValue) {
+            scenarioPath = argv[++i];
+        } else if (arg == "--mode" && hasValue && (std::string(argv[i + 1]) == "open" || std::string(argv[i + 1]) == "closed")) {
+            options.mode = std::string(argv[++i]) == "open" ? LoopMode::Open : LoopMode::Closed;
+        } else if (arg == "--rate" && number) {
+            rate = *number;
+            ++i;
+        } else if (arg == "--connections" && number) {
+            connections = static_cast<size_t>(*number);
+            ++i;
+        } else if (arg == "--duration" && number) {
+            duration = *number;
+            ++i;
+        } else if (arg == "--keep-alive") {
+            options.keepAlive = true;
+        } else if (arg == "--mix" && hasValue) {
+            mix = argv[++i];
+        } else if (arg == "--timeout-ms" && number) {
+            options.timeout = std::chrono::milliseconds(static_cast<long long>(*number));
+            ++i;
+        } else if (arg == "--date" && hasValue) {
+            options.date = argv[++i];
+        } else if (arg == "--token" && hasValue) {
+            options.token = argv[++i];
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--host HOST] [--port N] [--scenario FILE] [--mode open|closed] [--rate N]"
+                         " [--connections N] [--duration SECONDS] [--keep-alive] [--mix NAME=WEIGHT,...]"
+                         " [--timeout-ms N] [--date YYYY-MM-DD] [--token TOKEN]"
+                      << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<Phase> phases;
+    try {
+        if (scenarioPath) {
+            std::ifstream input(*scenarioPath);
+            if (!input) {
+                std::cerr << "Cannot open scenario " << *scenarioPath << std::endl;
+                return 1;
+            }
+            phases = parseScenario(input);
+        } else {
+            std::istringstream input(kDefaultScenario);
+            phases = parseScenario(input);
+        }
+        if (mix) {
+            applyMix(phases, *mix);
+        }
+    } catch (const std::exception &ex) {
+        std::cerr << (scenarioPath ? *scenarioPath : "built-in scenario") << ": " << ex.what() << std::endl;
+        return 1;
+    }
+    // Flags given on the command line win over every phase's own settings.
+    for (auto &phase : phases) {
+        if (rate) {
+            phase.rate = *rate;
+        }
+        if (duration) {
+            phase.duration = std::chrono::milliseconds(static_cast<long long>(*duration * 1000));
+        }
+        if (connections) {
+            phase.connections = *connections;
+        }
+    }
+
+    booking::SocketEnvironment sockets;
+    std::atomic<std::uint64_t> sequence{1};
+    ReservationPool reservations;
+    PhaseStats total;
+    std::chrono::duration<double> totalElapsed{0};
+    for (const auto &phase : phases) {
+        std::cout << "Phase " << phase.name << ": "
+                  << (options.mode == LoopMode::Open ? "open loop at " : "closed loop");
+        if (options.mode == LoopMode::Open) {
+            std::cout << phase.rate << " requests/s";
+        }
+        std::cout << " over " << phase.connections << (options.keepAlive ? " keep-alive" : "") << " connections for "
+                  << std::chrono::duration<double>(phase.duration).count() << " s" << std::endl;
+        auto started = Clock::now();
+        auto stats = runPhase(phase, options, sequence, reservations);
+        auto elapsed = Clock::now() - started;
+        printStats(phase.name, stats, elapsed);
+        total.merge(stats);
+        totalElapsed += elapsed;
+    }
+    if (phases.size() > 1) {
+        printStats("total", total, totalElapsed);
+    }
+    return 0;
+}
@@ -1,18 +1,27 @@
-﻿#include "ReservationSystem.hpp"
+﻿#include "Analytics.hpp"
+#include "ReservationSystem.hpp"
 #include "SeedData.hpp"
 
+#include <chrono>
+#include <iomanip>
 #include <iostream>
 #include <limits>
+#include <string>
 
+using booking::AnalyticsEngine;
+using booking::AnalyticsQuery;
+using booking::AnalyticsSummary;
 using booking::BookingSheet;
 using booking::Customer;
 using booking::FrontDeskStaff;
 using booking::Manager;
 using booking::MenuItem;
+using booking::ReportPage;
 using booking::Reservation;
 using booking::ReservationStatus;
 using booking::Restaurant;
 using booking::Table;
+using booking::seedHistory;
 using booking::seedRestaurant;
 
 namespace {
@@ -42,19 +51,33 @@ void showTables(const Restaurant &restaurant) {
     }
 }
 
+// "3" for one table, "3+4" for tables pushed together.
+template <typename TableIds>
+std::string formatTableIds(const TableIds &tableIds) {
+    std::string text;
+    for (int id : tableIds) {
+        if (!text.empty()) {
+            text += '+';
+        }
+        text += std::to_string(id);
+    }
+    return text;
+}
+
 void listReservations(const Restaurant &restaurant) {
-    const auto &reservations = restaurant.getBookingSheet().getReservations();
+    const auto &sheet = restaurant.getBookingSheet();
+    const auto &reservations = sheet.getReservations();
     if (reservations.empty()) {
         std::cout << "暂无预订记录。\n";
         return;
     }
     std::cout << "所有预订:\n";
     for (const auto &reservation : reservations) {
-        std::cout << "  编号:" << reservation.getId() << " 客人:" << reservation.getCustomer().getName()
+        std::cout << "  编号:" << reservation.getId() << " 客人:" << sheet.getCustomer(reservation).getName()
                   << " 人数:" << reservation.getPartySize() << " 时间:"
                   << booking::formatDateTime(reservation.getDateTime());
         if (reservation.getTableId()) {
-            std::cout << " 桌号:" << *reservation.getTableId();
+            std::cout << " 桌号:" << formatTableIds(reservation.getTableIds());
         }
         std::cout << " 状态:";
         switch (reservation.getStatus()) {
@@ -112,21 +135,27 @@ void createReservationFlow(Restaurant &restaurant) {
 
     auto &sheet = restaurant.getBookingSheet();
     auto tableIds = sheet.findAllAvailableTableIds(partySize, *timePoint, std::chrono::minutes(kDefaultDurationMinutes));
-    if (tableIds.empty()) {
-        std::cout << "无可用桌位，预订失败。\n";
-        return;
-    }
-    std::cout << "可用桌位:";
-    for (int id : tableIds) {
-        std::cout << ' ' << id;
+    if (!tableIds.empty()) {
+        std::cout << "可用桌位:";
+        for (int id : tableIds) {
+            std::cout << ' ' << id;
+        }
+        std::cout << "\n";
+    } else {
+        auto combined =
+            sheet.findAvailableTableSet(partySize, *timePoint, std::chrono::minutes(kDefaultDurationMinutes));
+        if (combined.empty()) {
+            std::cout << "无可用桌位，预订失败。\n";
+            return;
+        }
+        std::cout << "无单桌可容纳，可拼桌: " << formatTableIds(combined) << "\n";
     }
-    std::cout << "\n";
 
     Customer customer{name, phone, email, preference};
     auto &reservation = sheet.createReservation(customer, partySize, *timePoint,
                                                 std::chrono::minutes(kDefaultDurationMinutes), notes);
     if (reservation.getTableId()) {
-        std::cout << "预订成功，分配桌号 " << *reservation.getTableId() << " ，编号 " << reservation.getId() << "。\n";
+        std::cout << "预订成功，分配桌号 " << formatTableIds(reservation.getTableIds()) << " ，编号 " << reservation.getId() << "。\n";
     } else {
         std::cout << "预订已创建，但暂未分配桌位，编号 " << reservation.getId() << "。\n";
     }
@@ -139,47 +168,44 @@ void walkInFlow(Restaurant &restaurant) {
     std::string notes = readLine("备注(可选): ");
 
     Customer customer{name, phone};
-    auto &reservation = restaurant.getBookingSheet().recordWalkIn(customer, partySize, notes);
-    if (reservation.getTableId()) {
-        std::cout << "已为散客安排桌号 " << *reservation.getTableId() << " ，预订编号 " << reservation.getId()
-                  << "。\n";
-    } else {
-        std::cout << "已登记散客，暂无法安排桌位。编号 " << reservation.getId() << "。\n";
+    auto &sheet = restaurant.getBookingSheet();
+    auto outcome = sheet.admitWalkIn(customer, partySize, notes);
+    if (outcome.turnedAway) {
+        std::cout << "店内桌位拼桌后也无法容纳 " << partySize << " 人，未加入候位队列。\n";
+        return;
+    }
+    if (outcome.reservation) {
+        std::cout << "已为散客安排桌号 " << formatTableIds(outcome.reservation->getTableIds()) << " ，预订编号 "
+                  << outcome.reservation->getId() << "。\n";
+        return;
+    }
+    auto estimates = sheet.estimateWaitlist();
+    const auto &estimate = estimates.back();
+    std::cout << "暂无空桌，已加入候位队列，候位编号 " << *outcome.waitlistId << "，同桌型前方还有 "
+              << estimate.partiesAhead << " 组";
+    if (estimate.wait) {
+        std::cout << "，预计等待约 " << estimate.wait->count() << " 分钟";
     }
+    std::cout << "。\n";
 }
 
 void updateReservationStatus(Restaurant &restaurant, ReservationStatus status, const std::string &actionText) {
-    std::string id = readLine("输入预订编号: ");
-    auto reservation = restaurant.getBookingSheet().findReservationById(id);
-    if (!reservation) {
+    auto id = booking::RecordId::parse(readLine("输入预订编号: "));
+    if (!id || !restaurant.getBookingSheet().updateReservationStatus(*id, status)) {
         std::cout << "未找到对应预订。\n";
         return;
     }
-    switch (status) {
-        case ReservationStatus::Seated:
-            reservation->markSeated();
-            break;
-        case ReservationStatus::Completed:
-            reservation->markCompleted();
-            break;
-        case ReservationStatus::Cancelled:
-            reservation->cancel();
-            break;
-        default:
-            reservation->updateStatus(status);
-            break;
-    }
     std::cout << actionText << "成功。\n";
 }
 
 void recordOrderFlow(Restaurant &restaurant) {
-    std::string reservationId = readLine("预订编号: ");
-    auto reservation = restaurant.getBookingSheet().findReservationById(reservationId);
+    auto reservationId = booking::RecordId::parse(readLine("预订编号: "));
+    auto reservation = reservationId ? restaurant.getBookingSheet().findReservationById(*reservationId) : nullptr;
     if (!reservation) {
         std::cout << "未找到预订。\n";
         return;
     }
-    auto &order = restaurant.getBookingSheet().recordOrder(reservationId);
+    auto &order = restaurant.getBookingSheet().recordOrder(*reservationId);
     std::cout << "开始录入点餐，订单编号 " << order.getId() << "。输入空行结束。\n";
     while (true) {
         std::string itemName = readLine("菜品名称: ");
@@ -192,9 +218,9 @@ void recordOrderFlow(Restaurant &restaurant) {
             continue;
         }
         int quantity = readInt("数量: ");
-        order.addItem(*item, quantity);
+        restaurant.getBookingSheet().addOrderItem(order.getId(), *item, quantity);
     }
-    std::cout << "订单总计: " << booking::formatCurrency(order.calculateTotal()) << "。\n";
+    std::cout << "订单总计: " << booking::formatCurrency(order.getTotal()) << "。\n";
 }
 
 void showMenu(const Restaurant &restaurant) {
@@ -214,10 +240,55 @@ void showStaff(const Restaurant &restaurant) {
 }
 
 void generateReport(const Restaurant &restaurant) {
-    auto report = restaurant.generateDailyReport();
+    ReportPage everything;
+    everything.limit = restaurant.getBookingSheet().getReservations().size();
+    auto report = restaurant.generateDailyReport(everything);
     std::cout << report.summary();
 }
 
+void analyticsFlow(const Restaurant &restaurant, AnalyticsEngine &engine) {
+    AnalyticsQuery query;
+    query.fromDate = readLine("起始日期(YYYY-MM-DD, 留空表示不限): ");
+    query.toDate = readLine("结束日期(YYYY-MM-DD, 留空表示不限): ");
+    auto started = std::chrono::steady_clock::now();
+    auto summary = engine.analyze(restaurant, query);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+    if (summary.days == 0) {
+        std::cout << "所选日期范围内没有数据。\n";
+        return;
+    }
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "统计天数: " << summary.days << "，预订 " << summary.reservations << " 笔，取消 " << summary.cancelled
+              << " 笔，未到店 " << summary.noShows << " 笔\n";
+    std::cout << "未到店率: " << summary.noShowRate() * 100 << "%\n";
+    std::cout << "平均翻台时长: " << summary.averageTurnMinutes() << " 分钟\n";
+    std::cout << "营业额: " << booking::formatCurrency(summary.revenue) << "，每座位小时营收 "
+              << booking::formatCurrency(summary.revenuePerSeatHour()) << '\n';
+    std::cout << "上座率(%)，按星期与小时:\n    ";
+    auto firstHour = static_cast<size_t>(query.openMinute / 60);
+    auto lastHour = static_cast<size_t>((query.closeMinute + 59) / 60);
+    for (auto hour = firstHour; hour < lastHour; ++hour) {
+        std::cout << std::setw(4) << hour;
+    }
+    std::cout << '\n';
+    const char *weekdays[] = {"周日", "周一", "周二", "周三", "周四", "周五", "周六"};
+    std::cout << std::setprecision(0);
+    for (size_t weekday = 0; weekday < AnalyticsSummary::kDaysPerWeek; ++weekday) {
+        std::cout << weekdays[weekday];
+        for (auto hour = firstHour; hour < lastHour; ++hour) {
+            if (auto occupancy = summary.occupancy(weekday, hour)) {
+                std::cout << std::setw(4) << *occupancy * 100;
+            } else {
+                std::cout << "   -";
+            }
+        }
+        std::cout << '\n';
+    }
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << std::setprecision(6);
+    std::cout << "(" << engine.getWorkerCount() << " 个线程，用时 " << elapsed.count() << " 毫秒)\n";
+}
+
 void refreshStatus(Restaurant &restaurant) {
     restaurant.getBookingSheet().updateTableStatuses();
 }
@@ -235,15 +306,28 @@ void displayMenu() {
     std::cout << "9. 查看菜单\n";
     std::cout << "10. 查看员工\n";
     std::cout << "11. 生成经营报表\n";
+    std::cout << "12. 多日经营分析\n";
     std::cout << "0. 退出\n";
     std::cout << "请选择操作: ";
 }
 
 }  // namespace
 
-int main() {
+int main(int argc, char **argv) {
     Restaurant restaurant{"美味餐厅", "上海市黄浦区中山东一路12号", BookingSheet{"2024-05-20"}};
     seedRestaurant(restaurant);
+    // --history-days N archives N generated days before the live one for the analytics menu.
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::string(argv[i]) == "--history-days") {
+            try {
+                seedHistory(restaurant, std::stoi(argv[i + 1]));
+            } catch (...) {
+                std::cerr << "Invalid --history-days value" << std::endl;
+                return 1;
+            }
+        }
+    }
+    AnalyticsEngine analytics;
 
     bool running = true;
     while (running) {
@@ -292,6 +376,9 @@ int main() {
             case 11:
                 generateReport(restaurant);
                 break;
+            case 12:
+                analyticsFlow(restaurant, analytics);
+                break;
             case 0:
                 running = false;
                 break;
@@ -3,9 +3,12 @@
 #include "WebServer.hpp"
 
 #include <algorithm>
+#include <chrono>
 #include <filesystem>
 #include <iostream>
+#include <memory>
 #include <optional>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -15,19 +18,164 @@ using booking::Restaurant;
 int main(int argc, char **argv) {
     int port = 8080;
     std::filesystem::path staticDir = "web";
-    if (argc > 1) {
+    booking::WebServerOptions options;
+    int historyDays = 0;
+    long long keepDays = 0;
+    int restaurantCount = 1;
+    std::vector<std::string> positional;
+    // Reads the positive integer after a flag, or reports the flag and returns nullopt.
+    auto positiveArgument = [&](int &i, const std::string &flag) -> std::optional<long long> {
+        if (i + 1 >= argc) {
+            std::cerr << flag << " requires a value" << std::endl;
+            return std::nullopt;
+        }
         try {
-            port = std::stoi(argv[1]);
+            auto value = std::stoll(argv[++i]);
+            if (value > 0) {
+                return value;
+            }
+        } catch (...) {
+        }
+        std::cerr << "Invalid " << flag << " value" << std::endl;
+        return std::nullopt;
+    };
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--replica-of") {
+            if (i + 1 >= argc) {
+                std::cerr << "--replica-of requires host:port" << std::endl;
+                return 1;
+            }
+            options.replicaOf = argv[++i];
+        } else if (arg == "--replica-token") {
+            if (i + 1 >= argc) {
+                std::cerr << "--replica-token requires a staff token" << std::endl;
+                return 1;
+            }
+            options.replicaToken = argv[++i];
+        } else if (arg == "--enforce-permissions") {
+            options.enforcePermissions = true;
+        } else if (arg == "--day-rollover") {
+            options.dayRollover = true;
+        } else if (arg == "--optimize-every") {
+            if (i + 1 >= argc) {
+                std::cerr << "--optimize-every requires a number of seconds" << std::endl;
+                return 1;
+            }
+            try {
+                options.optimizeInterval = std::chrono::seconds(std::stoi(argv[++i]));
+            } catch (...) {
+                std::cerr << "Invalid --optimize-every value" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--history-days") {
+            if (i + 1 >= argc) {
+                std::cerr << "--history-days requires a number of days" << std::endl;
+                return 1;
+            }
+            try {
+                historyDays = std::stoi(argv[++i]);
+            } catch (...) {
+                std::cerr << "Invalid --history-days value" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--max-in-flight") {
+            if (i + 1 >= argc) {
+                std::cerr << "--max-in-flight requires a request count" << std::endl;
+                return 1;
+            }
+            try {
+                auto limit = std::stoi(argv[++i]);
+                if (limit <= 0) {
+                    throw std::invalid_argument("non-positive");
+                }
+                options.admission.maxInFlight = static_cast<size_t>(limit);
+            } catch (...) {
+                std::cerr << "Invalid --max-in-flight value" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--client-rate") {
+            if (i + 1 >= argc) {
+                std::cerr << "--client-rate requires requests per second" << std::endl;
+                return 1;
+            }
+            try {
+                options.admission.clientRequestsPerSecond = std::stod(argv[++i]);
+                options.admission.clientBurst = options.admission.clientRequestsPerSecond * 2;
+            } catch (...) {
+                std::cerr << "Invalid --client-rate value" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--header-timeout" || arg == "--body-timeout" || arg == "--idle-timeout") {
+            auto seconds = positiveArgument(i, arg);
+            if (!seconds) {
+                return 1;
+            }
+            auto &timeout = arg == "--header-timeout" ? options.connections.headerTimeout
+                            : arg == "--body-timeout" ? options.connections.bodyTimeout
+                                                      : options.connections.idleTimeout;
+            timeout = std::chrono::seconds(*seconds);
+        } else if (arg == "--min-rate") {
+            auto bytesPerSecond = positiveArgument(i, arg);
+            if (!bytesPerSecond) {
+                return 1;
+            }
+            options.connections.minBytesPerSecond = static_cast<size_t>(*bytesPerSecond);
+        } else if (arg == "--max-connections-per-client") {
+            auto limit = positiveArgument(i, arg);
+            if (!limit) {
+                return 1;
+            }
+            options.connections.maxConnectionsPerClient = static_cast<size_t>(*limit);
+        } else if (arg == "--drain-timeout") {
+            auto seconds = positiveArgument(i, arg);
+            if (!seconds) {
+                return 1;
+            }
+            options.drainTimeout = std::chrono::seconds(*seconds);
+        } else if (arg == "--handoff-socket" || arg == "--take-over") {
+            if (i + 1 >= argc) {
+                std::cerr << arg << " requires a socket path" << std::endl;
+                return 1;
+            }
+            (arg == "--handoff-socket" ? options.handoffSocket : options.takeOverFrom) = argv[++i];
+        } else if (arg == "--keep-days") {
+            auto days = positiveArgument(i, arg);
+            if (!days) {
+                return 1;
+            }
+            keepDays = *days;
+        } else if (arg == "--restaurants") {
+            if (i + 1 >= argc) {
+                std::cerr << "--restaurants requires a count" << std::endl;
+                return 1;
+            }
+            try {
+                restaurantCount = std::stoi(argv[++i]);
+            } catch (...) {
+                restaurantCount = 0;
+            }
+            if (restaurantCount <= 0) {
+                std::cerr << "Invalid --restaurants value" << std::endl;
+                return 1;
+            }
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    if (positional.size() > 0) {
+        try {
+            port = std::stoi(positional[0]);
         } catch (...) {
             std::cerr << "Invalid port, fallback to 8080" << std::endl;
             port = 8080;
         }
     }
-    if (argc > 2) {
-        staticDir = argv[2];
+    if (positional.size() > 1) {
+        staticDir = positional[1];
     }
 
-    bool userProvidedStaticDir = argc > 2;
+    bool userProvidedStaticDir = positional.size() > 1;
     auto existsDir = [](const std::filesystem::path &p) {
         return std::filesystem::exists(p) && std::filesystem::is_directory(p);
     };
@@ -88,11 +236,23 @@ int main(int argc, char **argv) {
     staticDir = *resolved;
     std::cout << "Serving static files from: " << staticDir << std::endl;
 
-    Restaurant restaurant{"美味餐厅", "上海市黄浦区中山东一路12号", BookingSheet{"2024-05-20"}};
-    booking::seedRestaurant(restaurant);
+    // Locations are numbered from 1; the first keeps the original name and answers plain /api/ routes.
+    std::vector<std::unique_ptr<Restaurant>> restaurants;
+    std::vector<booking::HostedRestaurant> hosted;
+    for (int number = 1; number <= restaurantCount; ++number) {
+        std::string name = number == 1 ? "美味餐厅" : "美味餐厅" + std::to_string(number) + "号店";
+        restaurants.push_back(
+            std::make_unique<Restaurant>(name, "上海市黄浦区中山东一路12号", BookingSheet{"2024-05-20"}));
+        booking::seedRestaurant(*restaurants.back());
+        restaurants.back()->setArchiveRetention(static_cast<size_t>(keepDays));
+        booking::seedHistory(*restaurants.back(), historyDays);
+        hosted.push_back(booking::HostedRestaurant{std::to_string(number), restaurants.back().get()});
+    }
 
     try {
-        booking::runWebServer(restaurant, staticDir.string(), port);
+        options.port = port;
+        options.staticDir = staticDir.string();
+        booking::runWebServer(hosted, options);
     } catch (const std::exception &ex) {
         std::cerr << "Failed to start web server: " << ex.what() << std::endl;
         return 1;
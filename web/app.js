@@ -1198,7 +1198,8 @@ async function submitForm(form, url, feedbackEl, successMessage) {
       const text = await response.text();
       throw new Error(text || "提交失败");
     }
-    feedbackEl.textContent = successMessage;
+    const result = await response.json().catch(() => ({}));
+    feedbackEl.textContent = typeof successMessage === "function" ? successMessage(result) : successMessage;
     feedbackEl.style.color = "#10b981";
     form.reset();
     await loadTables();
@@ -1218,7 +1219,13 @@ reservationForm.addEventListener("submit", (event) => {
 
 walkInForm.addEventListener("submit", (event) => {
   event.preventDefault();
-  submitForm(walkInForm, "/api/walkins", walkInFeedback, "散客登记成功！");
+  submitForm(walkInForm, "/api/walkins", walkInFeedback, (result) => {
+    if (result.seated === false) {
+      const eta = result.etaMinutes == null ? "暂无法预估" : `约 ${result.etaMinutes} 分钟`;
+      return `暂无空桌，已加入候位（编号 ${result.id}，第 ${result.position} 位，预计等待${eta}）`;
+    }
+    return "散客登记成功！";
+  });
 });
 
 addOrderItemButton.addEventListener("click", () => {